@@ -0,0 +1,262 @@
+// fade benchmark: runs a duck and its release through the duck controller on
+// the simulated backend for every fade curve, with and without late ticks,
+// and reports how long each fade actually takes next to fAttackMS and
+// fReleaseMS, and how even its steps are. needs no audio stack, so it builds
+// and runs anywhere, e.g. on linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -pthread -o fade-benchmark
+//       bench/FadeBenchmark.cpp src/AllocationCounter.cpp
+//       src/CommandExecutor.cpp src/DuckController.cpp src/Fade.cpp
+//       src/GainComputer.cpp src/LevelDetector.cpp src/Log.cpp src/Metrics.cpp
+//       src/NameMatcher.cpp src/SimulatedBackend.cpp src/VoiceGate.cpp
+//   ./fade-benchmark [results.json]
+//
+// every volume written to the controlled session is logged with its time. a
+// fade starts with the write of the volume it starts from and ends with the
+// write of its target. fades are computed from the time elapsed, so they take
+// their configured duration however late the ticks run, give or take the last
+// tick: exits with 1 if a fade is off by more than the tick lateness plus
+// TOLERANCE_MS, or does not land exactly on its target. the steps between the
+// writes are reported as the mean and standard deviation of their interval
+// and of their change in volume.
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "DuckController.h"
+#include "SimulatedBackend.h"
+
+static const double ATTACK_MS = 1000.0;
+static const double RELEASE_MS = 1500.0;
+
+// the trigger plays from BURST_START_MS for BURST_MS, long enough for the
+// attack to finish, and the release finishes before the run ends
+static const double BURST_START_MS = 1000.0;
+static const double BURST_MS = 4000.0;
+static const double RUN_MS = 10000.0;
+
+// on top of the tick lateness, the resolution of a simulated notification
+static const double TOLERANCE_MS =
+    SimulatedBackend::NOTIFICATION_RESOLUTION_MS;
+
+// a simulated backend that logs every volume written to the controlled
+// session
+class LoggingBackend : public SimulatedBackend {
+  public:
+    struct Write {
+        double timeMS;
+        float volume;
+    };
+
+    Clock &clock;
+    NameId controlled;
+    std::vector<Write> writes;
+
+    LoggingBackend(Clock &clock)
+        : SimulatedBackend(clock), clock(clock),
+          controlled(names.intern(L"controlled.exe")) {}
+
+    void setSessionVolume(size_t index, float volume) override {
+        if (getExecutableNameId(index) == controlled)
+            writes.push_back({clock.nowMS(), volume});
+        SimulatedBackend::setSessionVolume(index, volume);
+    }
+};
+
+struct Scenario {
+    FadeCurve curve;
+    const char *curveName;
+
+    // how late each wait between ticks may run
+    double jitterMS;
+};
+
+// one fade, from the write of its start volume to the write of its target
+struct FadeResult {
+    double configuredMS;
+    double actualMS;
+    bool landed;
+    size_t steps;
+    double meanIntervalMS;
+    double stdDevIntervalMS;
+    double meanStep;
+    double stdDevStep;
+};
+
+struct Result {
+    Scenario scenario;
+    FadeResult attack;
+    FadeResult release;
+};
+
+// finds the first fade at or after writes[begin] from the given volume to the
+// target, and moves begin past its last write
+static FadeResult measureFade(const std::vector<LoggingBackend::Write> &writes,
+                              size_t &begin, float from, float to,
+                              double configuredMS) {
+    FadeResult result = {};
+    result.configuredMS = configuredMS;
+
+    while (begin < writes.size() && writes[begin].volume != from)
+        begin++;
+    if (begin == writes.size())
+        return result;
+
+    size_t end = begin;
+    while (end < writes.size() && writes[end].volume != to)
+        end++;
+    if (end == writes.size())
+        return result;
+
+    result.actualMS = writes[end].timeMS - writes[begin].timeMS;
+    result.landed = true;
+    result.steps = end - begin;
+
+    double intervalSum = 0.0, intervalSquares = 0.0;
+    double stepSum = 0.0, stepSquares = 0.0;
+    for (size_t i = begin + 1; i <= end; i++) {
+        double interval = writes[i].timeMS - writes[i - 1].timeMS;
+        double step = std::abs(writes[i].volume - writes[i - 1].volume);
+        intervalSum += interval;
+        intervalSquares += interval * interval;
+        stepSum += step;
+        stepSquares += step * step;
+    }
+    if (result.steps > 0) {
+        double n = (double)result.steps;
+        result.meanIntervalMS = intervalSum / n;
+        result.meanStep = stepSum / n;
+        double intervalVariance = intervalSquares / n -
+                                  result.meanIntervalMS * result.meanIntervalMS;
+        double stepVariance =
+            stepSquares / n - result.meanStep * result.meanStep;
+        result.stdDevIntervalMS = std::sqrt(std::fmax(0.0, intervalVariance));
+        result.stdDevStep = std::sqrt(std::fmax(0.0, stepVariance));
+    }
+
+    begin = end + 1;
+    return result;
+}
+
+static Result runScenario(const Scenario &scenario) {
+    VirtualClock clock;
+    LoggingBackend backend(clock);
+    backend.setTickJitter(scenario.jitterMS);
+
+    DuckSettings settings;
+    DuckTarget target;
+    target.executable = L"controlled.exe";
+    target.attackMS = (float)ATTACK_MS;
+    target.releaseMS = (float)RELEASE_MS;
+    target.attackCurve = scenario.curve;
+    target.releaseCurve = scenario.curve;
+    settings.targets.push_back(target);
+
+    SettingsStore<DuckSettings> settingsStore(settings);
+    DuckController controller(backend, clock, settingsStore,
+                              [](CommandKind, const std::wstring &) {});
+
+    backend.addSession(L"controlled.exe", PeakCurves::constant(0.5f),
+                       target.volumeMax);
+    backend.addSession(L"player.exe",
+                       PeakCurves::burst(BURST_START_MS, BURST_MS, 0.5f));
+    backend.run(controller, RUN_MS);
+
+    Result result;
+    result.scenario = scenario;
+    size_t begin = 0;
+    result.attack = measureFade(backend.writes, begin, target.volumeMax,
+                                target.volumeMin, ATTACK_MS);
+    result.release = measureFade(backend.writes, begin, target.volumeMin,
+                                 target.volumeMax, RELEASE_MS);
+    return result;
+}
+
+static bool withinTolerance(const FadeResult &fade, double jitterMS) {
+    return fade.landed &&
+           std::abs(fade.actualMS - fade.configuredMS) <=
+               jitterMS + TOLERANCE_MS;
+}
+
+static void writeFadeJSON(std::ostream &out, const char *name,
+                          const FadeResult &fade) {
+    out << "\"" << name << "\": {\"configuredMS\": " << fade.configuredMS
+        << ", \"actualMS\": " << fade.actualMS
+        << ", \"landed\": " << (fade.landed ? "true" : "false")
+        << ", \"steps\": " << fade.steps
+        << ", \"meanIntervalMS\": " << fade.meanIntervalMS
+        << ", \"stdDevIntervalMS\": " << fade.stdDevIntervalMS
+        << ", \"meanStep\": " << fade.meanStep
+        << ", \"stdDevStep\": " << fade.stdDevStep << "}";
+}
+
+static void writeJSON(std::ostream &out, const std::vector<Result> &results) {
+    out << "{\n  \"benchmark\": \"fade\",\n  \"results\": [";
+    const char *separator = "\n";
+    for (auto &result : results) {
+        out << separator << "    {\"curve\": \"" << result.scenario.curveName
+            << "\", \"jitterMS\": " << result.scenario.jitterMS << ", ";
+        writeFadeJSON(out, "attack", result.attack);
+        out << ", ";
+        writeFadeJSON(out, "release", result.release);
+        out << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void printFade(const Scenario &scenario, const char *name,
+                      const FadeResult &fade) {
+    std::printf("%-11s %7.1f %-8s %9.0f %9.1f %6zu %8.1f %8.2f %8.4f %8.4f\n",
+                scenario.curveName, scenario.jitterMS, name, fade.configuredMS,
+                fade.actualMS, fade.steps, fade.meanIntervalMS,
+                fade.stdDevIntervalMS, fade.meanStep, fade.stdDevStep);
+}
+
+int main(int argc, char **argv) {
+    const char *outputPath = (argc > 1) ? argv[1] : "fade-benchmark.json";
+
+    const Scenario scenarios[] = {
+        {FadeCurve::Linear, "linear", 0.0},
+        {FadeCurve::Linear, "linear", 15.6},
+        {FadeCurve::Decibel, "decibel", 0.0},
+        {FadeCurve::Decibel, "decibel", 15.6},
+        {FadeCurve::SCurve, "scurve", 0.0},
+        {FadeCurve::SCurve, "scurve", 15.6},
+        {FadeCurve::EqualPower, "equalpower", 0.0},
+        {FadeCurve::EqualPower, "equalpower", 15.6},
+    };
+
+    std::vector<Result> results;
+    bool accurate = true;
+    std::printf("%-11s %7s %-8s %9s %9s %6s %8s %8s %8s %8s\n", "curve",
+                "late ms", "fade", "target ms", "actual ms", "steps",
+                "step ms", "std dev", "step", "std dev");
+    for (auto &scenario : scenarios) {
+        Result result = runScenario(scenario);
+        results.push_back(result);
+        accurate = accurate &&
+                   withinTolerance(result.attack, scenario.jitterMS) &&
+                   withinTolerance(result.release, scenario.jitterMS);
+        printFade(scenario, "attack", result.attack);
+        printFade(scenario, "release", result.release);
+    }
+
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    writeJSON(file, results);
+
+    if (!accurate) {
+        std::fprintf(stderr, "A fade missed its target or its duration by "
+                             "more than the tick lateness plus %.1f ms\n",
+                     TOLERANCE_MS);
+        return 1;
+    }
+    return 0;
+}
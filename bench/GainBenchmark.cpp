@@ -0,0 +1,325 @@
+// gain benchmark: runs the gain computer that sets the depth of a duck on
+// synthetic level sequences, and reports its curve, how deep each sequence is
+// ducked and how often the depth moves, with and without the look-back, and
+// what the kernel costs per slot. needs no audio stack, so it builds and runs
+// anywhere, e.g. on linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -o gain-benchmark
+//       bench/GainBenchmark.cpp src/GainComputer.cpp
+//   ./gain-benchmark [results.json]
+//
+// the sequences are levels as the level detector would give them, one every
+// 20ms (the default fDetectorSampleMS), for the default curve with a range of
+// 24dB. a depth move is a change of the gain by a 1dB step or more, which is
+// when the duck controller fades to a new depth.
+// before that the curve is checked: no duck below the knee, a slope of
+// 1 - 1/ratio above it, no gap or step across it, the range as the deepest
+// gain, and the look-back holding the deepest gain for its whole window. exits
+// with 1 if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "GainComputer.h"
+
+static const double SAMPLE_MS = 20.0;
+static const double SEQUENCE_MS = 10000.0;
+static const double LOOKBACK_MS = 500.0;
+static const float DEPTH_STEP_DB = 1.0f;
+
+// a pseudo-random number from 0 to 1 for each sample, from a fixed hash so
+// runs stay deterministic
+static float noise(std::uint32_t sample) {
+    std::uint32_t x = sample * 2654435761u;
+    x ^= x >> 15;
+    return (float)(x & 0xffff) / 65535.0f;
+}
+
+struct Sequence {
+    const char *name;
+    std::function<float(std::uint32_t sample)> level;
+};
+
+struct SequenceResult {
+    const char *name;
+    bool lookback;
+    float deepestDB;
+    float meanDB; // over the samples that were ducked at all
+    size_t depthMoves;
+};
+
+struct KernelResult {
+    size_t slots;
+    double nsPerSlot;
+    double nsPerSlotSample;
+};
+
+static GainCurve defaultCurve() {
+    GainCurve curve;
+    curve.rangeDB = 24.0f;
+    return curve;
+}
+
+// the gain of the curve alone for a level in dB
+static float gainAt(const GainCurve &curve, float levelDB) {
+    GainComputer computer;
+    computer.setCurves({curve}, 1);
+    float level = std::pow(10.0f, levelDB / 20.0f);
+    float gainDB;
+    computer.computeGainDB(&level, &gainDB);
+    return gainDB;
+}
+
+static bool check(bool passed, const char *what) {
+    if (!passed)
+        std::fprintf(stderr, "Check failed: %s\n", what);
+    return passed;
+}
+
+static bool checkCurve() {
+    const float TOLERANCE_DB = 0.01f;
+    GainCurve curve = defaultCurve();
+    float kneeBottomDB = curve.thresholdDB - curve.kneeDB * 0.5f;
+    float kneeTopDB = curve.thresholdDB + curve.kneeDB * 0.5f;
+    bool passed = true;
+
+    bool silent = true;
+    for (float levelDB : {-120.0f, -60.0f, -40.0f, kneeBottomDB - 0.01f,
+                          kneeBottomDB})
+        silent = silent && gainAt(curve, levelDB) == 0.0f;
+    passed &= check(silent, "levels below the knee are not ducked");
+
+    float slope = (gainAt(curve, -10.0f) - gainAt(curve, -20.0f)) / 10.0f;
+    passed &= check(std::abs(slope + (1.0f - 1.0f / curve.ratio)) < 0.001f,
+                    "above the knee the duck deepens by 1 - 1/ratio per dB");
+
+    // the knee meets the straight line above it, and neither jumps nor turns
+    // back on the way through
+    float hardDB =
+        (1.0f / curve.ratio - 1.0f) * (kneeTopDB - curve.thresholdDB);
+    passed &= check(std::abs(gainAt(curve, kneeTopDB) - hardDB) < TOLERANCE_DB,
+                    "the knee ends on the line above it");
+    bool continuous = true;
+    float previousDB = gainAt(curve, kneeBottomDB - 1.0f);
+    for (float levelDB = kneeBottomDB - 1.0f; levelDB <= kneeTopDB + 1.0f;
+         levelDB += 0.01f) {
+        float gainDB = gainAt(curve, levelDB);
+        continuous = continuous && gainDB <= previousDB &&
+                     previousDB - gainDB < 0.01f + TOLERANCE_DB;
+        previousDB = gainDB;
+    }
+    passed &= check(continuous, "the gain is continuous across the knee");
+
+    // the default curve only reaches -22.5dB at 0dB, so a narrower range
+    // clamps it
+    GainCurve clamped = curve;
+    clamped.rangeDB = 12.0f;
+    passed &= check(gainAt(clamped, 0.0f) == -12.0f &&
+                        gainAt(clamped, -10.0f) == -12.0f &&
+                        std::abs(gainAt(clamped, -20.0f) -
+                                 gainAt(curve, -20.0f)) < TOLERANCE_DB,
+                    "the range is the deepest gain");
+    GainCurve off = curve;
+    off.rangeDB = 0.0f;
+    passed &= check(gainAt(off, 0.0f) == 0.0f, "a range of 0 turns it off");
+
+    // one loud sample holds for the whole window, next to a slot that stays
+    // quiet, and a louder one deepens the duck straight away
+    size_t window = (size_t)(LOOKBACK_MS / SAMPLE_MS);
+    GainComputer computer;
+    computer.setCurves({curve, curve}, window);
+    float loudDB = gainAt(curve, -10.0f);
+    float levels[2] = {std::pow(10.0f, -10.0f / 20.0f), 0.0f};
+    computer.sample(levels);
+    bool held =
+        computer.getGainDB(0) == loudDB && computer.getGainDB(1) == 0.0f;
+    levels[0] = std::pow(10.0f, -20.0f / 20.0f);
+    for (size_t i = 1; i < window; i++) {
+        computer.sample(levels);
+        held = held && computer.getGainDB(0) == loudDB &&
+               computer.getGainDB(1) == 0.0f;
+    }
+    computer.sample(levels);
+    held = held && computer.getGainDB(0) == gainAt(curve, -20.0f);
+    levels[0] = 1.0f;
+    computer.sample(levels);
+    held = held && computer.getGainDB(0) == gainAt(curve, 0.0f);
+    computer.reset();
+    held = held && computer.getGainDB(0) == 0.0f;
+    passed &= check(held, "the look-back holds the deepest gain of its window");
+
+    return passed;
+}
+
+static SequenceResult runSequence(const Sequence &sequence, bool lookback) {
+    GainComputer computer;
+    size_t window = lookback ? (size_t)(LOOKBACK_MS / SAMPLE_MS) : 1;
+    computer.setCurves({defaultCurve()}, window);
+
+    SequenceResult result = {sequence.name, lookback, 0.0f, 0.0f, 0};
+    float depthDB = 0.0f;
+    double duckedSumDB = 0.0;
+    size_t ducked = 0;
+    for (std::uint32_t i = 0; i < SEQUENCE_MS / SAMPLE_MS; i++) {
+        float level = sequence.level(i);
+        computer.sample(&level);
+        float gainDB = computer.getGainDB(0);
+
+        result.deepestDB = (std::min)(result.deepestDB, gainDB);
+        if (gainDB < 0.0f) {
+            duckedSumDB += gainDB;
+            ducked++;
+        }
+        if (std::abs(gainDB - depthDB) >= DEPTH_STEP_DB) {
+            depthDB = gainDB;
+            result.depthMoves++;
+        }
+    }
+    result.meanDB = ducked ? (float)(duckedSumDB / ducked) : 0.0f;
+    return result;
+}
+
+static KernelResult runKernel(size_t slots) {
+    GainComputer computer;
+    computer.setCurves(std::vector<GainCurve>(slots, defaultCurve()),
+                       (size_t)(LOOKBACK_MS / SAMPLE_MS));
+
+    std::vector<float> levels(slots);
+    std::vector<float> gains(slots);
+    for (size_t slot = 0; slot < slots; slot++)
+        levels[slot] = noise((std::uint32_t)slot);
+
+    const size_t ITERATIONS = 4000000 / slots + 1000;
+    const int RUNS = 5;
+    KernelResult result = {slots, 0.0, 0.0};
+    float sink = 0.0f;
+    for (int run = 0; run < RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ITERATIONS; i++) {
+            computer.computeGainDB(levels.data(), gains.data());
+            sink += gains[i % slots];
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < ITERATIONS; i++) {
+            computer.sample(levels.data());
+            sink += computer.getGainDB(i % slots);
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        auto perSlot = [&](std::chrono::steady_clock::duration duration) {
+            return (double)std::chrono::duration_cast<
+                       std::chrono::nanoseconds>(duration)
+                       .count() /
+                   (ITERATIONS * slots);
+        };
+        double kernel = perSlot(middle - start);
+        double sample = perSlot(end - middle);
+        if (run == 0 || kernel < result.nsPerSlot)
+            result.nsPerSlot = kernel;
+        if (run == 0 || sample < result.nsPerSlotSample)
+            result.nsPerSlotSample = sample;
+    }
+
+    // keeps the loops from being optimised away
+    if (sink > 0.0f)
+        std::printf("gains above 0dB\n");
+    return result;
+}
+
+static void writeJSON(std::ostream &out,
+                      const std::vector<SequenceResult> &sequences,
+                      const std::vector<KernelResult> &kernels) {
+    out << "{\n  \"benchmark\": \"gain\",\n  \"sequences\": [";
+    const char *separator = "\n";
+    for (auto &result : sequences) {
+        out << separator << "    {\"sequence\": \"" << result.name
+            << "\", \"lookback\": " << (result.lookback ? "true" : "false")
+            << ", \"deepestDB\": " << result.deepestDB
+            << ", \"meanDB\": " << result.meanDB
+            << ", \"depthMoves\": " << result.depthMoves << "}";
+        separator = ",\n";
+    }
+    out << "\n  ],\n  \"kernel\": [";
+    separator = "\n";
+    for (auto &result : kernels) {
+        out << separator << "    {\"slots\": " << result.slots
+            << ", \"nsPerSlot\": " << result.nsPerSlot
+            << ", \"nsPerSlotSample\": " << result.nsPerSlotSample << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    const char *outputPath = (argc > 1) ? argv[1] : "gain-benchmark.json";
+
+    bool passed = checkCurve();
+    std::printf("curve checks: %s\n\n", passed ? "passed" : "FAILED");
+
+    // the static curve, without the look-back
+    GainComputer curve;
+    curve.setCurves({defaultCurve()}, 1);
+    std::printf("%10s %10s\n", "level dB", "gain dB");
+    for (float levelDB : {-60.0f, -36.0f, -33.0f, -30.0f, -27.0f, -20.0f,
+                          -10.0f, 0.0f}) {
+        float level = std::pow(10.0f, levelDB / 20.0f);
+        float gainDB;
+        curve.computeGainDB(&level, &gainDB);
+        std::printf("%10.1f %10.2f\n", levelDB, gainDB);
+    }
+
+    const Sequence sequences[] = {
+        // a notification chime: -26dB for 300ms every 2s
+        {"chime",
+         [](std::uint32_t i) {
+             return (std::fmod(i * SAMPLE_MS, 2000.0) < 300.0) ? 0.05f
+                                                               : 0.0f;
+         }},
+        // speech in a video: -16dB words with gaps, varying by a few dB
+        {"speech",
+         [](std::uint32_t i) {
+             bool word = std::fmod(i * SAMPLE_MS, 400.0) < 300.0;
+             return word ? 0.1f + 0.1f * noise(i) : 0.01f;
+         }},
+        // a loud game cutscene: around -6dB, varying by several dB
+        {"cutscene",
+         [](std::uint32_t i) { return 0.3f + 0.4f * noise(i); }},
+    };
+
+    std::vector<SequenceResult> sequenceResults;
+    std::printf("\n%-10s %10s %12s %10s %12s\n", "sequence", "look-back",
+                "deepest dB", "mean dB", "depth moves");
+    for (auto &sequence : sequences) {
+        for (bool lookback : {false, true}) {
+            SequenceResult result = runSequence(sequence, lookback);
+            sequenceResults.push_back(result);
+            std::printf("%-10s %10s %12.1f %10.1f %12zu\n", result.name,
+                        lookback ? "yes" : "no", result.deepestDB,
+                        result.meanDB, result.depthMoves);
+        }
+    }
+
+    std::vector<KernelResult> kernelResults;
+    std::printf("\n%8s %12s %16s\n", "slots", "ns/slot", "ns/slot sample");
+    for (size_t slots : {1, 8, 64, 512}) {
+        KernelResult result = runKernel(slots);
+        kernelResults.push_back(result);
+        std::printf("%8zu %12.2f %16.2f\n", slots, result.nsPerSlot,
+                    result.nsPerSlotSample);
+    }
+
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    writeJSON(file, sequenceResults, kernelResults);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// onset latency benchmark: runs the duck controller against the simulated
+// backend with sessions that start playing now and then, and reports how long
+// after a session goes active the duck is written. needs no audio stack, so
+// it builds and runs anywhere, e.g. on linux, from the repository root (as one
+// line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -pthread -o onset-latency-benchmark
+//       bench/OnsetLatencyBenchmark.cpp src/AllocationCounter.cpp
+//       src/CommandExecutor.cpp src/DuckController.cpp src/Fade.cpp
+//       src/GainComputer.cpp src/LevelDetector.cpp src/Log.cpp src/Metrics.cpp
+//       src/NameMatcher.cpp src/SimulatedBackend.cpp src/VoiceGate.cpp
+//   ./onset-latency-benchmark [results.json]
+//
+// every scenario runs an hour of virtual time, with a burst of audio from a
+// triggering session every ONSET_EVERY_MS, long enough for the duck to come
+// back up in between. the onset latency is the time from the session going
+// active until the first volume of the duck is written, with the attack made
+// instant so the duck is a single write. the controller sleeps in between,
+// parked or at the fTickInactiveMS safety net, so the duck is only this quick
+// if session activity wakes it. exits with 1 if any onset takes longer than
+// MAX_ONSET_MS plus the lateness of the ticks, or is missed.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "DuckController.h"
+#include "SimulatedBackend.h"
+
+static const double HOUR_MS = 3600000.0;
+static const double ONSET_EVERY_MS = 10000.0;
+static const double BURST_MS = 3000.0;
+
+// a notification, and a sample of the meter after it
+static const double MAX_ONSET_MS =
+    SimulatedBackend::NOTIFICATION_RESOLUTION_MS + 20.0;
+
+struct Scenario {
+    const char *name;
+
+    // see DuckSettings::tickInactiveMS
+    float tickInactiveMS;
+
+    // whether the triggering session is created for each burst, rather than
+    // existing throughout and going active
+    bool newSessions;
+
+    // how late each wait between ticks may run
+    double jitterMS;
+};
+
+struct Result {
+    Scenario scenario;
+    size_t ticks;
+    size_t onsets;
+    size_t ducks;
+    double meanOnsetMS;
+    double maxOnsetMS;
+};
+
+// when the burst k starts. the onsets drift against the tick and sample
+// intervals so every phase of them is measured.
+static double burstOnsetMS(size_t k) {
+    return 5000.0 + k * ONSET_EVERY_MS + std::fmod(k * 7.3, 50.0);
+}
+
+static Result runScenario(const Scenario &scenario) {
+    VirtualClock clock;
+    SimulatedBackend backend(clock);
+    backend.setTickJitter(scenario.jitterMS);
+
+    DuckSettings settings;
+    settings.tickInactiveMS = scenario.tickInactiveMS;
+    DuckTarget target;
+    target.executable = L"controlled.exe";
+    target.attackMS = 0.0f;
+    settings.targets.push_back(target);
+
+    SettingsStore<DuckSettings> settingsStore(settings);
+    DuckController controller(backend, clock, settingsStore,
+                              [](CommandKind, const std::wstring &) {});
+
+    backend.addSession(L"controlled.exe", PeakCurves::constant(0.5f),
+                       target.volumeMax);
+
+    size_t count = 0;
+    while (burstOnsetMS(count) + ONSET_EVERY_MS <= HOUR_MS)
+        count++;
+
+    if (scenario.newSessions) {
+        for (size_t k = 0; k < count; k++) {
+            double onsetMS = burstOnsetMS(k);
+            backend.addSession(L"player.exe", PeakCurves::constant(0.5f), 1.0f,
+                               onsetMS, onsetMS + BURST_MS);
+        }
+    } else {
+        backend.addSession(L"player.exe", [](double timeMS) {
+            if (timeMS < burstOnsetMS(0))
+                return 0.0f;
+            double onsetMS =
+                burstOnsetMS((size_t)((timeMS - 5000.0) / ONSET_EVERY_MS));
+            return (timeMS >= onsetMS && timeMS < onsetMS + BURST_MS) ? 0.5f
+                                                                       : 0.0f;
+        });
+    }
+
+    Result result = {};
+    result.scenario = scenario;
+
+    // run up to a second into every burst, when the duck is written but the
+    // release has not started yet
+    double onsetSumMS = 0.0;
+    for (size_t k = 0; k < count; k++) {
+        double onsetMS = burstOnsetMS(k);
+        result.ticks += backend.run(controller, onsetMS + 1000.0);
+        result.onsets++;
+        if (backend.getScriptedVolume(L"controlled.exe") != target.volumeMin)
+            continue;
+
+        double onsetLatencyMS =
+            backend.getScriptedLastVolumeSetMS(L"controlled.exe") - onsetMS;
+        result.ducks++;
+        onsetSumMS += onsetLatencyMS;
+        result.maxOnsetMS = (std::max)(result.maxOnsetMS, onsetLatencyMS);
+    }
+    result.ticks += backend.run(controller, HOUR_MS);
+
+    result.meanOnsetMS = result.ducks ? onsetSumMS / result.ducks : 0.0;
+    return result;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<Result> &results) {
+    out << "{\n  \"benchmark\": \"onset-latency\",\n  \"results\": [";
+    const char *separator = "\n";
+    for (auto &result : results) {
+        out << separator << "    {\"scenario\": \"" << result.scenario.name
+            << "\", \"ticks\": " << result.ticks
+            << ", \"onsets\": " << result.onsets
+            << ", \"ducks\": " << result.ducks
+            << ", \"meanOnsetMS\": " << result.meanOnsetMS
+            << ", \"maxOnsetMS\": " << result.maxOnsetMS << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    const char *outputPath =
+        (argc > 1) ? argv[1] : "onset-latency-benchmark.json";
+
+    const Scenario scenarios[] = {
+        {"parked", 0.0f, false, 0.0},
+        {"parked, new sessions", 0.0f, true, 0.0},
+        {"safety net", 30000.0f, false, 0.0},
+        {"parked, late ticks", 0.0f, false, 15.6},
+    };
+
+    std::vector<Result> results;
+    bool withinBound = true;
+    std::printf("%-22s %8s %7s %6s %10s %10s\n", "scenario", "ticks/h",
+                "onsets", "ducks", "onset ms", "max ms");
+    for (auto &scenario : scenarios) {
+        Result result = runScenario(scenario);
+        results.push_back(result);
+        withinBound = withinBound && result.ducks == result.onsets &&
+                      result.maxOnsetMS <= MAX_ONSET_MS + scenario.jitterMS;
+        std::printf("%-22s %8zu %7zu %6zu %10.1f %10.1f\n", scenario.name,
+                    result.ticks, result.onsets, result.ducks,
+                    result.meanOnsetMS, result.maxOnsetMS);
+    }
+
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    writeJSON(file, results);
+
+    if (!withinBound) {
+        std::fprintf(stderr, "An onset was missed or took longer than %.1f ms "
+                             "plus the tick lateness\n",
+                     MAX_ONSET_MS);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+// sidechain benchmark: runs the duck controller against the simulated backend
+// with a scripted microphone, and reports how quickly talking into it ducks
+// the target, how often the controller wakes up for it and what the voice gate
+// costs. needs no audio stack, so it builds and runs anywhere, e.g. on linux,
+// from the repository root (as one line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -pthread -o sidechain-benchmark
+//       bench/SidechainBenchmark.cpp src/AllocationCounter.cpp
+//       src/CommandExecutor.cpp src/DuckController.cpp src/Fade.cpp
+//       src/GainComputer.cpp src/LevelDetector.cpp src/Log.cpp src/Metrics.cpp
+//       src/NameMatcher.cpp src/SimulatedBackend.cpp src/VoiceGate.cpp
+//   ./sidechain-benchmark [results.json]
+//
+// every scenario runs an hour of virtual time. the microphone level is a
+// synthetic meter trace: a noise floor, with utterances of words and the gaps
+// between them on top. the onset latency is the time from the first word of
+// an utterance until the duck is written, with the attack made instant so the
+// duck is a single write. the controller samples the microphone every
+// fDetectorSampleMS, which bounds the latency. the cost of sampling is shown
+// by how often the controller ticks and reads the meter, and by the cost of
+// the voice gate itself.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "DuckController.h"
+#include "SimulatedBackend.h"
+#include "VoiceGate.h"
+
+static const double HOUR_MS = 3600000.0;
+
+// an utterance every UTTERANCE_EVERY_MS, long enough for the duck to come
+// back up in between
+static const double UTTERANCE_EVERY_MS = 8000.0;
+static const double UTTERANCE_MS = 2000.0;
+static const double WORD_MS = 300.0;
+static const double WORD_GAP_MS = 100.0;
+static const float WORD_LEVEL = 0.3f;
+
+struct Scenario {
+    const char *name;
+
+    // whether anything records the microphone, and whether anyone talks
+    bool capturing;
+    bool talking;
+
+    // how late each wait between ticks may run
+    double jitterMS;
+};
+
+struct Result {
+    Scenario scenario;
+    size_t ticks;
+    size_t meterReads;
+    size_t utterances;
+    size_t ducks;
+    double meanOnsetMS;
+    double maxOnsetMS;
+};
+
+// a noise floor between 0.005 and 0.03 that changes every ms, from a fixed
+// hash so runs stay deterministic
+static float noiseFloor(double timeMS) {
+    std::uint32_t x = (std::uint32_t)timeMS * 2654435761u;
+    x ^= x >> 15;
+    return 0.005f + 0.025f * (float)(x & 0xffff) / 65535.0f;
+}
+
+// when the utterance k starts, in ms since the recording started. the onsets
+// drift against the sample interval so every phase of it is measured.
+static double utteranceOnsetMS(size_t k) {
+    return 1000.0 + k * UTTERANCE_EVERY_MS + std::fmod(k * 7.3, 20.0);
+}
+
+static float microphoneLevel(double timeMS, bool talking) {
+    float level = noiseFloor(timeMS);
+    if (!talking || timeMS < utteranceOnsetMS(0))
+        return level;
+
+    size_t k = (size_t)((timeMS - 1000.0) / UTTERANCE_EVERY_MS);
+    double intoMS = timeMS - utteranceOnsetMS(k);
+    bool word = intoMS >= 0.0 && intoMS < UTTERANCE_MS &&
+                std::fmod(intoMS, WORD_MS + WORD_GAP_MS) < WORD_MS;
+    return word ? WORD_LEVEL : level;
+}
+
+static Result runScenario(const Scenario &scenario) {
+    VirtualClock clock;
+    SimulatedBackend backend(clock);
+    backend.setTickJitter(scenario.jitterMS);
+
+    DuckSettings settings;
+    settings.sidechainEnabled = true;
+    DuckTarget target;
+    target.executable = L"controlled.exe";
+    target.attackMS = 0.0f;
+    settings.targets.push_back(target);
+
+    SettingsStore<DuckSettings> settingsStore(settings);
+    DuckController controller(backend, clock, settingsStore,
+                              [](CommandKind, const std::wstring &) {});
+
+    // the target plays throughout, and can trigger nothing by itself
+    backend.addSession(L"controlled.exe", PeakCurves::constant(0.5f),
+                       target.volumeMax);
+    if (scenario.capturing) {
+        bool talking = scenario.talking;
+        backend.setCapture(
+            [talking](double timeMS) {
+                return microphoneLevel(timeMS, talking);
+            },
+            0.0, HOUR_MS);
+    }
+
+    Result result = {};
+    result.scenario = scenario;
+
+    // run up to a second into every utterance, when the duck is written but
+    // the release has not started yet
+    double onsetSumMS = 0.0;
+    for (size_t k = 0; scenario.talking; k++) {
+        double onsetMS = utteranceOnsetMS(k);
+        if (onsetMS + UTTERANCE_EVERY_MS > HOUR_MS)
+            break;
+
+        result.ticks += backend.run(controller, onsetMS + 1000.0);
+        result.utterances++;
+        if (backend.getScriptedVolume(L"controlled.exe") != target.volumeMin)
+            continue;
+
+        double onsetLatencyMS =
+            backend.getScriptedLastVolumeSetMS(L"controlled.exe") - onsetMS;
+        result.ducks++;
+        onsetSumMS += onsetLatencyMS;
+        result.maxOnsetMS = (std::max)(result.maxOnsetMS, onsetLatencyMS);
+    }
+    result.ticks += backend.run(controller, HOUR_MS);
+
+    if (!scenario.talking)
+        result.ducks = backend.getScriptedVolumeSetCount(L"controlled.exe");
+    result.meterReads = backend.getCapturePeakReadCount();
+    result.meanOnsetMS = result.ducks ? onsetSumMS / result.ducks : 0.0;
+    return result;
+}
+
+// the cost of the gate alone, over a trace of a minute of talking sampled
+// every ms
+static double measureGateNSPerSample() {
+    std::vector<float> trace((size_t)HOUR_MS / 60);
+    for (size_t i = 0; i < trace.size(); i++)
+        trace[i] = microphoneLevel((double)i, true);
+
+    VoiceGate gate;
+    gate.configure(0.1f, 0.05f, 400.0);
+
+    const int RUNS = 5;
+    double best = 0.0;
+    size_t open = 0;
+    for (int run = 0; run < RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < trace.size(); i++)
+            open += gate.sample((double)i, trace[i]);
+        auto duration = std::chrono::steady_clock::now() - start;
+
+        double ns =
+            (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                duration)
+                .count() /
+            trace.size();
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+
+    // keeps the loop from being optimised away
+    if (open == 0)
+        std::printf("the gate never opened\n");
+    return best;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<Result> &results,
+                      double gateNSPerSample) {
+    out << "{\n  \"benchmark\": \"sidechain\",\n  \"gateNSPerSample\": "
+        << gateNSPerSample << ",\n  \"results\": [";
+    const char *separator = "\n";
+    for (auto &result : results) {
+        out << separator << "    {\"scenario\": \"" << result.scenario.name
+            << "\", \"ticks\": " << result.ticks
+            << ", \"meterReads\": " << result.meterReads
+            << ", \"utterances\": " << result.utterances
+            << ", \"ducks\": " << result.ducks
+            << ", \"meanOnsetMS\": " << result.meanOnsetMS
+            << ", \"maxOnsetMS\": " << result.maxOnsetMS << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    const char *outputPath = (argc > 1) ? argv[1] : "sidechain-benchmark.json";
+
+    const Scenario scenarios[] = {
+        {"no recording", false, false, 0.0},
+        {"quiet call", true, false, 0.0},
+        {"talking", true, true, 0.0},
+        {"talking, late ticks", true, true, 5.0},
+    };
+
+    std::vector<Result> results;
+    std::printf("%-20s %8s %8s %10s %6s %10s %10s\n", "scenario", "ticks/h",
+                "reads/h", "utterances", "ducks", "onset ms", "max ms");
+    for (auto &scenario : scenarios) {
+        Result result = runScenario(scenario);
+        results.push_back(result);
+        std::printf("%-20s %8zu %8zu %10zu %6zu %10.1f %10.1f\n",
+                    scenario.name, result.ticks, result.meterReads,
+                    result.utterances, result.ducks, result.meanOnsetMS,
+                    result.maxOnsetMS);
+    }
+
+    double gateNSPerSample = measureGateNSPerSample();
+    std::printf("voice gate: %.2f ns/sample\n", gateNSPerSample);
+
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    writeJSON(file, results, gateNSPerSample);
+    return 0;
+}
@@ -0,0 +1,171 @@
+// tick benchmark: runs the duck controller against the simulated backend with
+// a growing number of sessions and excluded executables, and reports the cost
+// of a tick in ns, allocations and bytes. needs no audio stack, so it builds
+// and runs anywhere, e.g. on linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -pthread -o tick-benchmark
+//       bench/TickBenchmark.cpp src/AllocationCounter.cpp
+//       src/CommandExecutor.cpp src/DuckController.cpp src/Fade.cpp
+//       src/GainComputer.cpp src/LevelDetector.cpp src/Log.cpp src/Metrics.cpp
+//       src/NameMatcher.cpp src/SimulatedBackend.cpp src/VoiceGate.cpp
+//   ./tick-benchmark [results.json]
+//
+// a table is printed, and the results are written as json (by default to
+// tick-benchmark.json) so runs of different releases can be compared. each
+// scenario is measured several times and the fastest run is reported, which
+// is the least disturbed by the rest of the system.
+// the simulated backend runs its script on every tick, so the numbers include
+// the cost of the synthetic sessions too. it is small next to the controller
+// but it grows with the session count all the same.
+// a tick in the steady state must not allocate at all. the controller only
+// asserts this in debug builds, so the benchmark exits with 1 if any scenario
+// allocated, which catches it in the release build measured here.
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "DuckController.h"
+#include "SimulatedBackend.h"
+
+struct Scenario {
+    size_t sessions;
+    size_t exclusions;
+
+    // every tenth session plays audio, so the meters are read and the
+    // controlled session is ducked
+    bool playing;
+};
+
+struct Result {
+    Scenario scenario;
+    size_t ticks;
+    double nsPerTick;
+    double allocationsPerTick;
+    double bytesPerTick;
+};
+
+static Result runScenario(const Scenario &scenario) {
+    VirtualClock clock;
+    SimulatedBackend backend(clock);
+
+    DuckSettings settings;
+    // a parked controller waits forever, which the back to back ticks below
+    // cannot, so idle scenarios tick at the old safety net instead
+    settings.tickInactiveMS = 30000.0f;
+    DuckTarget target;
+    target.executable = L"controlled.exe";
+    settings.targets.push_back(target);
+
+    // half of the excluded names belong to sessions, the rest never appear
+    for (size_t i = 0; i < scenario.exclusions; i++) {
+        std::wstring name = (i % 2 == 0)
+                                ? L"session" + std::to_wstring(i / 2) + L".exe"
+                                : L"missing" + std::to_wstring(i) + L".exe";
+        settings.excludedExecutables.push_back(name);
+    }
+
+    SettingsStore<DuckSettings> settingsStore(settings);
+    DuckController controller(backend, clock, settingsStore,
+                              [](CommandKind, const std::wstring &) {});
+
+    backend.addSession(L"controlled.exe", PeakCurves::constant(0.5f), 0.2f);
+    for (size_t i = 1; i < scenario.sessions; i++) {
+        float level = (scenario.playing && i % 10 == 1) ? 0.5f : 0.0f;
+        backend.addSession(L"session" + std::to_wstring(i - 1) + L".exe",
+                           PeakCurves::constant(level));
+    }
+
+    // settle the duck and any fades before measuring
+    backend.run(controller, 10000.0);
+
+    // ticks are timed back to back, the clock advancing by the time each
+    // asks to wait, so every tick sees a steady state
+    const size_t TICKS = 2000000 / (scenario.sessions + 100);
+    const int RUNS = 5;
+
+    Result result;
+    result.scenario = scenario;
+    result.ticks = TICKS;
+    result.nsPerTick = 0.0;
+
+    size_t allocationsBefore = AllocationCounter::getThreadCount();
+    size_t bytesBefore = AllocationCounter::getThreadBytes();
+
+    for (int run = 0; run < RUNS; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < TICKS; i++)
+            clock.waitMS(controller.tick(false));
+        auto duration = std::chrono::steady_clock::now() - start;
+
+        double nsPerTick =
+            (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                duration)
+                .count() /
+            TICKS;
+        if (run == 0 || nsPerTick < result.nsPerTick)
+            result.nsPerTick = nsPerTick;
+    }
+
+    size_t allocations =
+        AllocationCounter::getThreadCount() - allocationsBefore;
+    size_t bytes = AllocationCounter::getThreadBytes() - bytesBefore;
+    result.allocationsPerTick = (double)allocations / (TICKS * RUNS);
+    result.bytesPerTick = (double)bytes / (TICKS * RUNS);
+    return result;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<Result> &results) {
+    out << "{\n  \"benchmark\": \"tick\",\n  \"results\": [";
+    const char *separator = "\n";
+    for (auto &result : results) {
+        out << separator << "    {\"sessions\": " << result.scenario.sessions
+            << ", \"exclusions\": " << result.scenario.exclusions
+            << ", \"playing\": " << (result.scenario.playing ? "true" : "false")
+            << ", \"ticks\": " << result.ticks
+            << ", \"nsPerTick\": " << result.nsPerTick
+            << ", \"allocationsPerTick\": " << result.allocationsPerTick
+            << ", \"bytesPerTick\": " << result.bytesPerTick << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    const char *outputPath = (argc > 1) ? argv[1] : "tick-benchmark.json";
+
+    std::vector<Result> results;
+    bool allocated = false;
+    std::printf("%8s %10s %8s %12s %12s %12s\n", "sessions", "exclusions",
+                "playing", "ns/tick", "allocs/tick", "bytes/tick");
+
+    for (size_t sessions : {1, 10, 100, 1000}) {
+        for (size_t exclusions : {0, 20, 200}) {
+            for (bool playing : {false, true}) {
+                Result result = runScenario({sessions, exclusions, playing});
+                results.push_back(result);
+                allocated = allocated || result.allocationsPerTick > 0.0;
+                std::printf("%8zu %10zu %8s %12.0f %12.3f %12.1f\n", sessions,
+                            exclusions, playing ? "yes" : "no",
+                            result.nsPerTick, result.allocationsPerTick,
+                            result.bytesPerTick);
+            }
+        }
+    }
+
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    writeJSON(file, results);
+
+    if (allocated) {
+        std::fprintf(stderr, "Ticks allocated in the steady state\n");
+        return 1;
+    }
+    return 0;
+}
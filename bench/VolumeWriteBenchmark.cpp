@@ -0,0 +1,173 @@
+// volume write benchmark: runs the volume write filter of the pipeline on
+// the volumes of scripted fades, and reports how many of them are written and
+// where each fade lands. needs no audio stack, so it builds and runs anywhere,
+// e.g. on linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -o volume-write-benchmark
+//       bench/VolumeWriteBenchmark.cpp src/Fade.cpp src/VolumeWriteFilter.cpp
+//   ./volume-write-benchmark [results.json]
+//
+// the controller offers a volume every tick of a fade, as the actuator would
+// get them. a fade lands when the last volume offered is the last one
+// written. the mixer scenario ducks, has the user drag the ducked session up
+// in the mixer, and has the controller duck it again, which must be written
+// even though the filter wrote the same volume before. exits with 1 if any
+// scenario does not land.
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include "Fade.h"
+#include "VolumeWriteFilter.h"
+
+static const SessionKey SESSION = 1;
+static const float VOLUME_MIN = 0.2f;
+static const float VOLUME_MAX = 1.0f;
+
+struct Scenario {
+    const char *name;
+    float stepDB;
+    double intervalMS;
+    double tickMS;
+    double fadeMS;
+
+    // whether the user drags the session up in the mixer once it is ducked
+    bool mixer;
+};
+
+struct Result {
+    Scenario scenario;
+    size_t offered;
+    size_t written;
+    size_t heldStep;
+    size_t heldRate;
+    bool landed;
+};
+
+// the writes of the filter, as the actuator applies them to the session
+struct Session {
+    float volume = VOLUME_MAX;
+    std::uint32_t changes = 0;
+};
+
+static void offer(VolumeWriteFilter &filter, Session &session, float volume,
+                  double nowMS, Result &result) {
+    result.offered++;
+    switch (filter.offer(SESSION, volume, session.changes, nowMS)) {
+    case VolumeWriteDecision::Write:
+        session.volume = volume;
+        result.written++;
+        break;
+    case VolumeWriteDecision::HeldStep:
+        result.heldStep++;
+        break;
+    case VolumeWriteDecision::HeldRate:
+        result.heldRate++;
+        break;
+    case VolumeWriteDecision::Unchanged:
+        break;
+    }
+}
+
+// offer every tick of a fade from one volume to another, then let whatever
+// is held back come due
+static void runFade(VolumeWriteFilter &filter, Session &session,
+                    const Scenario &scenario, float from, float to,
+                    double &nowMS, Result &result) {
+    Fade fade;
+    fade.start(from, to, nowMS, scenario.fadeMS, FadeCurve::Decibel);
+    double endMS = nowMS + scenario.fadeMS;
+    for (; nowMS <= endMS; nowMS += scenario.tickMS)
+        offer(filter, session, fade.volumeAt(nowMS), nowMS, result);
+    offer(filter, session, to, nowMS, result);
+
+    std::vector<VolumeWriteFilter::Write> due;
+    for (double dueMS = filter.takeDue(nowMS, due); dueMS >= 0.0;
+         dueMS = filter.takeDue(nowMS, due))
+        nowMS = dueMS;
+    for (auto &write : due) {
+        session.volume = write.volume;
+        result.written++;
+    }
+}
+
+static Result runScenario(const Scenario &scenario) {
+    VolumeWriteFilter filter;
+    filter.configure(scenario.stepDB, scenario.intervalMS);
+    Session session;
+    Result result = {};
+    result.scenario = scenario;
+
+    double nowMS = 0.0;
+    runFade(filter, session, scenario, VOLUME_MAX, VOLUME_MIN, nowMS, result);
+    result.landed = session.volume == VOLUME_MIN;
+
+    if (scenario.mixer) {
+        // the user drags the ducked session up, and the controller, which
+        // reads the new volume with the new change count, ducks it again
+        nowMS += 1000.0;
+        session.volume = 0.8f;
+        session.changes++;
+        runFade(filter, session, scenario, session.volume, VOLUME_MIN, nowMS,
+                result);
+        result.landed = result.landed && session.volume == VOLUME_MIN;
+    }
+    return result;
+}
+
+static void writeJSON(std::ostream &out, const std::vector<Result> &results) {
+    out << "{\n  \"benchmark\": \"volumeWrite\",\n  \"results\": [";
+    const char *separator = "\n";
+    for (auto &result : results) {
+        out << separator << "    {\"scenario\": \"" << result.scenario.name
+            << "\", \"offered\": " << result.offered
+            << ", \"written\": " << result.written
+            << ", \"heldStep\": " << result.heldStep
+            << ", \"heldRate\": " << result.heldRate
+            << ", \"landed\": " << (result.landed ? "true" : "false") << "}";
+        separator = ",\n";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    const char *outputPath =
+        (argc > 1) ? argv[1] : "volume-write-benchmark.json";
+
+    const Scenario scenarios[] = {
+        {"unfiltered", 0.0f, 0.0, 10.0, 300.0, false},
+        {"fade", 0.5f, 30.0, 10.0, 300.0, false},
+        {"fast ticks", 0.5f, 30.0, 1.0, 300.0, false},
+        {"instant", 0.5f, 30.0, 10.0, 0.0, false},
+        {"mixer", 0.5f, 30.0, 10.0, 300.0, true},
+        {"mixer, instant", 0.5f, 30.0, 10.0, 0.0, true},
+    };
+
+    std::vector<Result> results;
+    bool landed = true;
+    std::printf("%-16s %8s %8s %10s %10s %7s\n", "scenario", "offered",
+                "written", "held step", "held rate", "landed");
+    for (auto &scenario : scenarios) {
+        Result result = runScenario(scenario);
+        results.push_back(result);
+        landed = landed && result.landed;
+        std::printf("%-16s %8zu %8zu %10zu %10zu %7s\n", scenario.name,
+                    result.offered, result.written, result.heldStep,
+                    result.heldRate, result.landed ? "yes" : "NO");
+    }
+
+    std::ofstream file(outputPath);
+    if (!file.is_open()) {
+        std::fprintf(stderr, "Failed to write %s\n", outputPath);
+        return 1;
+    }
+    writeJSON(file, results);
+
+    if (!landed) {
+        std::fprintf(stderr, "A fade did not land on its target\n");
+        return 1;
+    }
+    return 0;
+}
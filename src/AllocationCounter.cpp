@@ -0,0 +1,26 @@
+#include "AllocationCounter.h"
+
+#include <cstdlib>
+#include <new>
+
+// trivially initialised so it is safe to touch from any allocation, including
+// those made while a thread is starting or exiting
+static thread_local size_t threadAllocationCount = 0;
+static thread_local size_t threadAllocationBytes = 0;
+
+size_t AllocationCounter::getThreadCount() { return threadAllocationCount; }
+
+size_t AllocationCounter::getThreadBytes() { return threadAllocationBytes; }
+
+void *operator new(size_t size) {
+    threadAllocationCount++;
+    threadAllocationBytes += size;
+    void *block = std::malloc(size ? size : 1);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void operator delete(void *block) noexcept { std::free(block); }
+
+void operator delete(void *block, size_t) noexcept { std::free(block); }
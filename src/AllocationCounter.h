@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+
+// allocationcounter counts the heap allocations made through the global
+// operator new by each thread, and the bytes they requested, so hot paths can
+// check that they do not allocate. the global operator new/delete are replaced in
+// AllocationCounter.cpp.
+namespace AllocationCounter {
+// number of allocations made by the calling thread so far
+size_t getThreadCount();
+
+// number of bytes requested by those allocations
+size_t getThreadBytes();
+} // namespace AllocationCounter
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "NameTable.h"
+#include "SessionRegistry.h"
+
+// audiobackend is the platform-neutral view of the audio system that the duck
+// controller works against. sessions are addressed by index, and indices (and
+// any values read through them) are only valid until the next call to
+// updateSessions().
+// backends report failures by throwing std::runtime_error.
+class AudioBackend {
+  protected:
+    // executable names of sessions are interned here, once per session
+    NameTable names;
+
+  public:
+    virtual ~AudioBackend() {}
+
+    // backends wrapping another one share its table, so the ids match
+    virtual NameTable &getNameTable() { return names; }
+
+    // bring the session list up to date. returns whether any session was
+    // added, removed or changed state since the last call.
+    virtual bool updateSessions() = 0;
+
+    // called from any thread when a session is added or becomes active, i.e.
+    // when new audio may be playing. must be set before sessions are watched.
+    virtual void setActivityCallback(std::function<void()> callback) = 0;
+
+    virtual size_t getSessionCount() = 0;
+    virtual SessionKey getSessionKey(size_t index) = 0;
+    virtual SessionState getSessionState(size_t index) = 0;
+
+    // interned executable name of the session in the form of "abc.exe", or
+    // NameTable::Unknown if it could not be determined. stays the same for the
+    // lifetime of the session.
+    virtual NameId getExecutableNameId(size_t index) = 0;
+
+    // write the current peak level of each channel of the session, from 0.0
+    // to 1.0, into levels. returns the number of channels written, at most
+    // maxChannels.
+    virtual size_t getChannelPeakLevels(size_t index, float *levels,
+                                        size_t maxChannels) = 0;
+
+    // session volume is the volume level set on the mixer, from 0.0 to 1.0
+    virtual float getSessionVolume(size_t index) = 0;
+    virtual void setSessionVolume(size_t index, float volume) = 0;
+
+    // how many times the volume of the session was changed by anything other
+    // than setSessionVolume(), e.g. by the user in the mixer. only compared
+    // for changes, so a volume read once stays valid while this stays the
+    // same. backends that cannot tell always return 0.
+    virtual std::uint32_t getVolumeChangeCount(size_t) { return 0; }
+
+    // the current peak level of the microphone (the capture endpoints the
+    // backend listens to), from 0.0 to 1.0, for the voice sidechain. returns
+    // false without reading any meter while nothing records from them, or if
+    // the backend does not capture at all. something starting to record calls
+    // the activity callback, like a session becoming active.
+    virtual bool getCapturePeakLevel(float &) { return false; }
+
+    // set the volume of the session with the given key, if it still exists.
+    // backends that support it can be called on this from one other thread
+    // while the rest is used, e.g. by the actuator of a PipelineBackend. the
+    // default looks the session up by index, so is only safe on the same
+    // thread.
+    virtual void setSessionVolumeByKey(SessionKey key, float volume) {
+        for (size_t i = 0; i < getSessionCount(); i++) {
+            if (getSessionKey(i) == key) {
+                setSessionVolume(i, volume);
+                return;
+            }
+        }
+    }
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+
+// clock is the time source of the engine, so that the same tick logic can run
+// in real time or in virtual time when simulating.
+// waits can be cut short with wake(), which is how session activity, settings
+// reloads and quit requests get the engine to tick immediately.
+class Clock {
+  public:
+    // a wait this long only ends when woken
+    static constexpr double FOREVER_MS =
+        std::numeric_limits<double>::infinity();
+
+    virtual ~Clock() {}
+
+    // milliseconds since an arbitrary fixed point
+    virtual double nowMS() = 0;
+
+    // block the calling thread for up to the given number of milliseconds, or
+    // until wake() is called. returns whether it was woken early.
+    virtual bool waitMS(double ms) = 0;
+
+    // like waitMS(), but for short waits that must not overshoot, such as the
+    // steps of a fade. clocks without a more precise wait use waitMS().
+    virtual bool waitPreciseMS(double ms) { return waitMS(ms); }
+
+    // wake the thread blocked in waitMS(), or make the next wait return
+    // immediately if no thread is waiting. can be called from any thread.
+    virtual void wake() = 0;
+};
+
+// steadyclock runs in real time using std::chrono::steady_clock
+class SteadyClock : public Clock {
+  private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool woken = false;
+
+  public:
+    double nowMS() override {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    bool waitMS(double ms) override {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool wasWoken = true;
+        if (ms >= FOREVER_MS)
+            condition.wait(lock, [this] { return woken; });
+        else
+            wasWoken = condition.wait_for(
+                lock, std::chrono::duration<double, std::milli>(ms),
+                [this] { return woken; });
+        woken = false;
+        return wasWoken;
+    }
+
+    void wake() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            woken = true;
+        }
+        condition.notify_one();
+    }
+};
+
+// virtualclock only moves when waited on, so waiting returns immediately and an
+// hour of ticks can be replayed in milliseconds
+class VirtualClock : public Clock {
+  private:
+    double now = 0.0;
+    bool woken = false;
+
+  public:
+    double nowMS() override { return now; }
+
+    bool waitMS(double ms) override {
+        if (woken) {
+            woken = false;
+            return true;
+        }
+        if (ms > 0.0)
+            now += ms;
+        return false;
+    }
+
+    void wake() override { woken = true; }
+};
@@ -0,0 +1,103 @@
+#include "CommandExecutor.h"
+
+#include "Log.h"
+
+CommandExecutor::CommandExecutor(CommandLauncher launch,
+                                 MetricsRegistry &metrics)
+    : launch(launch), submitted(metrics.counter("command.submitted")),
+      coalesced(metrics.counter("command.coalesced")),
+      completed(metrics.counter("command.completed")),
+      exitedNonZero(metrics.counter("command.exitedNonZero")),
+      timedOut(metrics.counter("command.timedOut")),
+      failed(metrics.counter("command.failed")),
+      duration(metrics.histogram("command.duration")) {
+    worker = std::thread(&CommandExecutor::run, this);
+}
+
+CommandExecutor::~CommandExecutor() { stop(); }
+
+void CommandExecutor::submit(CommandKind kind, const std::wstring &command,
+                             double timeoutMS) {
+    if (command.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return;
+
+        submitted.add();
+
+        // a queued command of the opposite kind has not run yet, so the two
+        // cancel out. a repeat of the same kind is redundant.
+        if (!queue.empty()) {
+            if (queue.back().kind != kind) {
+                queue.pop_back();
+                coalesced.add(2);
+                return;
+            }
+            coalesced.add();
+            return;
+        }
+
+        queue.push_back({kind, command, timeoutMS});
+    }
+    wake.notify_one();
+}
+
+void CommandExecutor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (worker.joinable())
+        worker.join();
+}
+
+void CommandExecutor::run() {
+    while (true) {
+        Command command;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            command = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        CommandResult result;
+        try {
+            result = launch(command.command, command.timeoutMS);
+        } catch (std::exception &exception) {
+            LOG_WARNING("failed to run command", {}, exception.what());
+        }
+
+        if (!result.started) {
+            failed.add();
+            continue;
+        }
+        duration.record((std::uint64_t)(result.durationMS * 1000000.0));
+        if (result.timedOut) {
+            timedOut.add();
+        } else {
+            completed.add();
+            if (result.exitCode != 0)
+                exitedNonZero.add();
+        }
+
+        if (result.timedOut) {
+            LOG_WARNING((command.kind == CommandKind::Duck)
+                            ? "duck command killed after timeout"
+                            : "unduck command killed after timeout",
+                        {{"ms", result.durationMS}});
+        } else {
+            LOG_INFO((command.kind == CommandKind::Duck)
+                         ? "duck command exited"
+                         : "unduck command exited",
+                     {{"code", (double)result.exitCode},
+                      {"ms", result.durationMS}});
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Metrics.h"
+
+enum class CommandKind { Duck, Unduck };
+
+// outcome of running a single command
+struct CommandResult {
+    bool started = false;
+    bool timedOut = false;
+    unsigned long exitCode = 0;
+    double durationMS = 0.0;
+};
+
+// runs a command to completion, killing it once timeoutMS has passed
+using CommandLauncher =
+    std::function<CommandResult(const std::wstring &command, double timeoutMS)>;
+
+// commandexecutor runs duck/unduck commands on its own worker thread so the
+// engine tick never waits on a child process.
+// a command that is still queued when the opposite command is submitted (e.g.,
+// a duck quickly followed by an unduck) cancels out with it, so neither is
+// launched, and a repeat of a queued command is merged into it. this bounds
+// the queue to a single command waiting behind the one that is running.
+// how the commands went is recorded into the metrics registry: how many were
+// submitted, cancelled or merged before they started (coalesced), exited by
+// themselves (completed, and of those exitedNonZero), were killed after their
+// timeout (timedOut) or could not be started (failed), and how long the ones
+// that started ran for.
+class CommandExecutor {
+  private:
+    struct Command {
+        CommandKind kind;
+        std::wstring command;
+        double timeoutMS;
+    };
+
+    CommandLauncher launch;
+
+    Counter &submitted;
+    Counter &coalesced;
+    Counter &completed;
+    Counter &exitedNonZero;
+    Counter &timedOut;
+    Counter &failed;
+    LatencyHistogram &duration;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Command> queue;
+    bool stopping = false;
+    std::thread worker;
+
+    void run();
+
+  public:
+    // registers its metrics in the given registry
+    CommandExecutor(CommandLauncher launch, MetricsRegistry &metrics);
+    ~CommandExecutor();
+
+    // queue a command without waiting for it. empty commands are ignored.
+    void submit(CommandKind kind, const std::wstring &command,
+                double timeoutMS);
+
+    // stop accepting commands, let the queued ones finish and join the worker
+    void stop();
+};
@@ -0,0 +1,681 @@
+#include "DuckController.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "AllocationCounter.h"
+#include "Log.h"
+
+const std::int32_t DuckController::UNMATCHED;
+
+// the depth of a duck curve only follows the level in steps of this, so small
+// changes in level do not keep turning the fade around. curves that would
+// duck by less do not trigger the duck at all.
+static const float DEPTH_STEP_DB = 1.0f;
+
+const char *getPowerProfileName(PowerProfile profile) {
+    switch (profile) {
+    case PowerProfile::Battery:
+        return "battery";
+    case PowerProfile::Away:
+        return "away";
+    case PowerProfile::Parked:
+        return "parked";
+    default:
+        return "normal";
+    }
+}
+
+DuckController::DuckController(AudioBackend &backend, Clock &clock,
+                               SettingsStore<DuckSettings> &settingsStore,
+                               CommandRunner runCommand)
+    : backend(backend), clock(clock), settingsStore(settingsStore),
+      runCommand(runCommand) {}
+
+void DuckController::updateStatus() {
+    bool changed = !statusBuilt || statusFound.size() != targets.size();
+    for (size_t t = 0; !changed && t < targets.size(); t++)
+        changed = statusFound[t] != (targets[t].lead >= 0);
+    if (!changed)
+        return;
+
+    tickAllocates = true;
+    statusBuilt = true;
+    statusFound.resize(targets.size());
+
+    std::wstring found;
+    for (size_t t = 0; t < targets.size(); t++) {
+        statusFound[t] = targets[t].lead >= 0;
+        if (!statusFound[t])
+            continue;
+        if (!found.empty())
+            found += L", ";
+        found += targets[t].executable;
+    }
+
+    if (found.empty()) {
+        // failure to find controlled executables is not fatal.
+        LOG_INFO("cannot find controlled executable, will keep looking");
+    }
+
+    std::lock_guard<std::mutex> lock(statusMutex);
+    if (!found.empty())
+        statusString = L"Found and controlling " + found;
+    else
+        statusString = L"Controlled executable not found";
+}
+
+void DuckController::fireCommand(CommandKind kind,
+                                 const std::wstring &command) {
+    tickAllocates = true;
+    runCommand(kind, command);
+}
+
+void DuckController::setDucked(TargetState &target, bool ducked) {
+    if (target.ducked == ducked)
+        return;
+
+    target.ducked = ducked;
+    if (ducked) {
+        if (duckedCount++ == 0)
+            fireCommand(CommandKind::Duck, settings->commandOnDuck);
+    } else {
+        if (--duckedCount == 0)
+            fireCommand(CommandKind::Unduck, settings->commandOnUnduck);
+    }
+}
+
+void DuckController::setState(TargetState &target, DuckState state) {
+    target.state = state;
+    if (state == DuckState::Ducked)
+        setDucked(target, true);
+    else if (state != DuckState::Attacking)
+        setDucked(target, false);
+}
+
+float DuckController::getVolume(size_t index) {
+    std::uint32_t changes = backend.getVolumeChangeCount(index);
+    if (shadowVolumes[index] < 0.0f || shadowChanges[index] != changes) {
+        shadowVolumes[index] = backend.getSessionVolume(index);
+        shadowChanges[index] = changes;
+        frame.volumes[index] = shadowVolumes[index];
+        frame.flags[index] |= SessionFrame::VolumeValid;
+    }
+    return shadowVolumes[index];
+}
+
+void DuckController::setVolume(size_t index, float volume) {
+    backend.setSessionVolume(index, volume);
+    shadowVolumes[index] = volume;
+}
+
+void DuckController::startFade(size_t index, float from, float to,
+                               double nowMS) {
+    const DuckTarget &target = settings->targets[index];
+
+    // volumes outside of the range jump straight into it, as they always have
+    from = (std::min)((std::max)(from, target.volumeMin), target.volumeMax);
+
+    // the fade times are for the whole range, so turning a fade around halfway
+    // takes half the time
+    bool down = to < from;
+    float range = target.volumeMax - target.volumeMin;
+    double durationMS = 0.0;
+    if (range > 0.0f)
+        durationMS = (down ? target.attackMS : target.releaseMS) *
+                     std::abs(to - from) / range;
+
+    targets[index].fade.start(from, to, nowMS, durationMS,
+                              down ? target.attackCurve : target.releaseCurve);
+}
+
+void DuckController::applySettings() {
+    if (settingsApplied && settingsRevision == settings->revision)
+        return;
+
+    tickAllocates = true;
+    settingsApplied = true;
+    settingsRevision = settings->revision;
+
+    // names are matched again as they are next seen
+    std::vector<std::wstring> patterns;
+    patterns.reserve(settings->targets.size());
+    for (auto &target : settings->targets)
+        patterns.push_back(target.executable);
+    excludedMatcher.compile(settings->excludedExecutables);
+    targetMatcher.compile(patterns);
+    voiceGate.configure(settings->sidechainOpenLevel,
+                        settings->sidechainCloseLevel,
+                        settings->sidechainHangoverMS);
+    std::vector<std::int32_t> previousNameTargets;
+    previousNameTargets.swap(nameTargets);
+    nameFlags.assign(backend.getNameTable().size(), 0);
+    nameTargets.assign(backend.getNameTable().size(), UNMATCHED);
+
+    gainCurvesStale = true;
+
+    // targets that are still in the settings keep their fade and ducked state
+    std::vector<TargetState> previous;
+    previous.swap(targets);
+    std::vector<bool> kept(previous.size(), false);
+    targets.resize(settings->targets.size());
+    size_t previousDuckedCount = duckedCount;
+    duckedCount = 0;
+
+    int lowestPriority = 0;
+    for (size_t t = 0; t < settings->targets.size(); t++) {
+        const DuckTarget &target = settings->targets[t];
+        if (t == 0 || target.priority < lowestPriority)
+            lowestPriority = target.priority;
+
+        for (size_t p = 0; p < previous.size(); p++) {
+            if (!kept[p] && previous[p].executable == target.executable) {
+                targets[t] = std::move(previous[p]);
+                kept[p] = true;
+                break;
+            }
+        }
+        targets[t].executable = target.executable;
+        targets[t].volumeRestore = target.volumeRestore;
+        if (targets[t].ducked)
+            duckedCount++;
+    }
+
+    // dropping the last ducked target unducks
+    releaseDroppedTargets(previous, kept, previousNameTargets);
+    if (previousDuckedCount > 0 && duckedCount == 0)
+        fireCommand(CommandKind::Unduck, settings->commandOnUnduck);
+
+    // targets with the lowest priority cannot duck any other target, so their
+    // meters never need reading
+    for (size_t t = 0; t < targets.size(); t++)
+        targets[t].sampled = settings->targets[t].priority > lowestPriority;
+
+    statusBuilt = false;
+}
+
+void DuckController::releaseDroppedTargets(
+    const std::vector<TargetState> &previous, const std::vector<bool> &kept,
+    const std::vector<std::int32_t> &previousNameTargets) {
+    size_t count = backend.getSessionCount();
+    for (size_t i = 0; i < count; i++) {
+        NameId name = backend.getExecutableNameId(i);
+        if (name >= previousNameTargets.size())
+            continue;
+
+        // bypassed targets were restored already
+        std::int32_t target = previousNameTargets[name];
+        if (target < 0 || kept[target] ||
+            previous[target].state == DuckState::Bypassed ||
+            getNameTarget(name) >= 0)
+            continue;
+
+        // the shadow volumes are only kept while the session list stays the
+        // same
+        if (i < shadowVolumes.size())
+            setVolume(i, previous[target].volumeRestore);
+        else
+            backend.setSessionVolume(i, previous[target].volumeRestore);
+    }
+}
+
+void DuckController::matchName(NameId id) {
+    if (id >= nameTargets.size()) {
+        tickAllocates = true;
+        nameFlags.resize(id + 1, 0);
+        nameTargets.resize(id + 1, UNMATCHED);
+    }
+    if (nameTargets[id] != UNMATCHED)
+        return;
+
+    auto &name = backend.getNameTable().getName(id);
+    std::uint8_t flags = 0;
+    if (excludedMatcher.match(name) != NameMatcher::NoMatch)
+        flags |= SessionFrame::Excluded;
+
+    // the first target whose pattern matches gets the sessions
+    std::int32_t target = targetMatcher.match(name);
+    if (target != NameMatcher::NoMatch)
+        flags |= SessionFrame::Controlled;
+
+    nameFlags[id] = flags;
+    nameTargets[id] = target;
+}
+
+std::uint8_t DuckController::getNameFlags(NameId id) {
+    matchName(id);
+    return nameFlags[id];
+}
+
+std::int32_t DuckController::getNameTarget(NameId id) {
+    matchName(id);
+    return nameTargets[id];
+}
+
+void DuckController::sampleSessions(bool sessionsChanged,
+                                    size_t &activeCount) {
+    applySettings();
+
+    activeCount = 0;
+    size_t count = backend.getSessionCount();
+    frame.resize(count);
+
+    for (size_t i = 0; i < count; i++) {
+        NameId name = backend.getExecutableNameId(i);
+        std::uint8_t flags = getNameFlags(name);
+        std::int32_t target = getNameTarget(name);
+
+        // inactive sessions are not playing anything, skip the meter read
+        bool canTrigger = !(flags & SessionFrame::Excluded) &&
+                          (target < 0 || targets[target].sampled);
+        if (canTrigger && backend.getSessionState(i) == SessionState::Active) {
+            flags |= SessionFrame::PeakValid;
+            activeCount++;
+        }
+
+        frame.keys[i] = backend.getSessionKey(i);
+        frame.names[i] = name;
+        frame.targets[i] = target;
+        frame.flags[i] = flags;
+    }
+
+    // session indices only move when the sessions change, so the shadows are
+    // only dropped then
+    if (sessionsChanged || shadowVolumes.size() != count) {
+        tickAllocates = true;
+        shadowVolumes.assign(count, -1.0f);
+        shadowChanges.assign(count, 0);
+    }
+
+    // the detector keeps a history per session, so its slots only need to be
+    // reassigned when the sessions change
+    // (or the power state changes the sample interval, which drops the
+    // history)
+    size_t windowLength = 1;
+    if (detectorSampleMS > 0.0)
+        windowLength = (size_t)std::lround(settings->detectorWindowMS /
+                                           detectorSampleMS);
+    if (sessionsChanged || detector.size() != count ||
+        detector.getWindowLength() != (std::max)(windowLength, (size_t)1)) {
+        tickAllocates = true;
+        detector.setSessions(frame.keys, windowLength);
+    }
+
+    if (activeCount == 0) {
+        detector.reset();
+        return;
+    }
+
+    float channelPeaks[LevelDetector::MAX_CHANNELS];
+    for (size_t i = 0; i < count; i++) {
+        if (!(frame.flags[i] & SessionFrame::PeakValid))
+            continue;
+
+        size_t channels = backend.getChannelPeakLevels(
+            i, channelPeaks, LevelDetector::MAX_CHANNELS);
+        float peak = 0.0f;
+        for (size_t channel = 0; channel < channels; channel++)
+            peak = (std::max)(peak, channelPeaks[channel]);
+
+        frame.peaks[i] = peak;
+        detector.setChannelPeaks(i, channelPeaks, channels);
+    }
+
+    detector.sample(clock.nowMS(), detectorSampleMS,
+                    settings->detectorAttackMS, settings->detectorReleaseMS);
+
+    for (size_t i = 0; i < count; i++)
+        frame.levels[i] = detector.getLevel(i);
+}
+
+void DuckController::sampleSidechain(size_t &activeCount) {
+    // the backend only reads the meter while something records, so an idle
+    // microphone costs a check per tick and keeps nothing awake
+    float peak = 0.0f;
+    if (!settings->sidechainEnabled || !backend.getCapturePeakLevel(peak)) {
+        voiceGate.reset();
+        return;
+    }
+
+    // the microphone has no notifications for its level, so it is sampled
+    // like a playing session for as long as anything records
+    voiceGate.sample(clock.nowMS(), peak);
+    activeCount++;
+}
+
+void DuckController::updateGainComputer() {
+    size_t windowLength = 1;
+    if (detectorSampleMS > 0.0)
+        windowLength = (size_t)std::lround(settings->duckLookbackMS /
+                                           detectorSampleMS);
+    windowLength = (std::max)(windowLength, (size_t)1);
+    if (!gainCurvesStale && gainComputer.getWindowLength() == windowLength)
+        return;
+
+    tickAllocates = true;
+    gainCurvesStale = false;
+
+    std::vector<GainCurve> curves;
+    for (auto &target : settings->targets)
+        curves.push_back(target.duckCurve);
+    gainComputer.setCurves(curves, windowLength);
+    triggerLevels.assign(targets.size(), 0.0f);
+}
+
+bool DuckController::updateTriggers() {
+    updateGainComputer();
+    for (auto &target : targets) {
+        target.lead = -1;
+        target.level = 0.0f;
+    }
+
+    // one pass over the sessions for the max level of each target and of
+    // everything else
+    float otherLevel = 0.0f;
+    for (size_t i = 0; i < frame.size(); i++) {
+        std::int32_t target = frame.targets[i];
+        float level = (frame.flags[i] & SessionFrame::PeakValid)
+                          ? frame.levels[i]
+                          : 0.0f;
+
+        if (target < 0) {
+            otherLevel = (std::max)(otherLevel, level);
+            continue;
+        }
+
+        if (targets[target].lead < 0)
+            targets[target].lead = (std::ptrdiff_t)i;
+        targets[target].level = (std::max)(targets[target].level, level);
+    }
+
+    // a target is triggered by anything else playing, or by a target with a
+    // higher priority playing. talking into the microphone triggers them all,
+    // and their curves take it for the loudest audio there is.
+    bool voice = voiceGate.isOpen();
+    for (size_t t = 0; t < targets.size(); t++) {
+        float level = otherLevel;
+        for (size_t u = 0; u < targets.size(); u++) {
+            if (settings->targets[u].priority > settings->targets[t].priority)
+                level = (std::max)(level, targets[u].level);
+        }
+        triggerLevels[t] = voice ? 1.0f : level;
+    }
+
+    gainComputer.sample(triggerLevels.data());
+
+    bool changed = false;
+    for (size_t t = 0; t < targets.size(); t++) {
+        TargetState &target = targets[t];
+        target.gainDB = gainComputer.getGainDB(t);
+
+        bool triggered =
+            voice || triggerLevels[t] > settings->volumeMinimumToTrigger;
+        if (settings->targets[t].duckCurve.rangeDB > 0.0f)
+            triggered = triggered && target.gainDB <= -DEPTH_STEP_DB;
+        target.triggered = triggered;
+
+        changed |= target.triggered != target.decidedTriggered;
+        changed |= target.triggered &&
+                   std::abs(target.gainDB - target.decidedGainDB) >=
+                       DEPTH_STEP_DB;
+    }
+    return changed;
+}
+
+float DuckController::getDuckedVolume(size_t index) const {
+    const DuckTarget &target = settings->targets[index];
+    if (target.duckCurve.rangeDB <= 0.0f)
+        return target.volumeMin;
+
+    float gain = std::pow(10.0f, targets[index].decidedGainDB / 20.0f);
+    return (std::max)(target.volumeMax * gain, target.volumeMin);
+}
+
+double DuckController::decideTarget(size_t index, bool bypassed, double now,
+                                    bool &settled) {
+    const DuckTarget &settingsTarget = settings->targets[index];
+    TargetState &target = targets[index];
+    target.decidedTriggered = target.triggered;
+    target.volumeChanged = false;
+    if (!target.triggered)
+        target.decidedGainDB = 0.0f;
+    else if (std::abs(target.gainDB - target.decidedGainDB) >= DEPTH_STEP_DB)
+        target.decidedGainDB = target.gainDB;
+
+    // not finding a target is not fatal, its sessions are brought to the right
+    // volume as soon as they appear
+    if (target.lead < 0)
+        return tickIdleMS;
+
+    float volumeTarget = target.triggered ? getDuckedVolume(index)
+                                          : settingsTarget.volumeMax;
+    if (bypassed)
+        volumeTarget = settingsTarget.volumeRestore;
+
+    double sleepNeeded = tickIdleMS;
+
+    float volumeCurrent = getVolume(target.lead);
+    target.volume = volumeCurrent;
+
+    // a fade towards the target always runs to its end, even once within the
+    // tolerance, so that it lands exactly on the target
+    bool shouldTransition =
+        std::abs(volumeCurrent - volumeTarget) > 0.001 ||
+        (target.fade.isActive() && target.fade.getTarget() == volumeTarget);
+    if (shouldTransition)
+        settled = false;
+
+    if (shouldTransition && bypassed) {
+        target.fade.stop();
+        target.volume = settingsTarget.volumeRestore;
+        target.volumeChanged = true;
+        // runs the unduck command if currently ducked
+        setState(target, DuckState::Bypassed);
+    }
+
+    if (shouldTransition && !bypassed) {
+        // increase consecutive minimums if at minimum
+        if (target.triggered) {
+            target.consecutiveMinimumsToTrigger =
+                (std::min)(target.consecutiveMinimumsToTrigger + 1,
+                           settings->consecutiveMinimumsToTrigger);
+        } else {
+            target.consecutiveMinimumsToEnd =
+                (std::min)(target.consecutiveMinimumsToEnd + 1,
+                           settings->consecutiveMinimumsToEnd);
+        }
+
+        // if either minimum is at the target value
+        if ((target.consecutiveMinimumsToTrigger ==
+             settings->consecutiveMinimumsToTrigger) ||
+            (target.consecutiveMinimumsToEnd ==
+             settings->consecutiveMinimumsToEnd)) {
+
+            // start fading towards the target, or turn the current fade
+            // around if the target has changed. starting back up runs the
+            // unduck command.
+            bool starting = !target.fade.isActive() ||
+                            target.fade.getTarget() != volumeTarget;
+            if (starting) {
+                startFade(index, volumeCurrent, volumeTarget, now);
+                setState(target, target.triggered ? DuckState::Attacking
+                                                  : DuckState::Releasing);
+            }
+
+            target.volume = target.fade.volumeAt(now);
+            target.volumeChanged = true;
+
+            // shorten the last wait so the fade ends on time
+            double remainingMS = target.fade.remainingMS(now);
+            // the fade ending down runs the duck command
+            if (remainingMS > 0.0) {
+                sleepNeeded = (std::min)(tickTransitionMS, remainingMS);
+            } else {
+                target.fade.stop();
+                setState(target, target.triggered ? DuckState::Ducked
+                                                  : DuckState::Idle);
+            }
+
+            // if transitioning, set both values to max to ensure smooth
+            // transitioning
+            target.consecutiveMinimumsToEnd =
+                settings->consecutiveMinimumsToEnd;
+            target.consecutiveMinimumsToTrigger =
+                settings->consecutiveMinimumsToTrigger;
+        }
+
+    } else {
+        target.consecutiveMinimumsToEnd = 0;
+        target.consecutiveMinimumsToTrigger = 0;
+        target.fade.stop();
+
+        // already at the target volume
+        if (!shouldTransition && bypassed)
+            setState(target, DuckState::Bypassed);
+        else if (!shouldTransition)
+            setState(target, target.triggered ? DuckState::Ducked
+                                              : DuckState::Idle);
+    }
+
+    return sleepNeeded;
+}
+
+double DuckController::decide(size_t activeCount, bool bypassed, double now) {
+    double sleepNeeded = tickIdleMS;
+    bool settled = true;
+
+    for (size_t t = 0; t < targets.size(); t++)
+        sleepNeeded =
+            (std::min)(sleepNeeded, decideTarget(t, bypassed, now, settled));
+
+    updateStatus();
+
+    // bring every session of every target to the decided volume. sessions
+    // other than the lead one (e.g. opened during a fade) are only written to
+    // when they are not there yet.
+    for (size_t i = 0; i < frame.size(); i++) {
+        std::int32_t index = frame.targets[i];
+        if (index < 0)
+            continue;
+
+        TargetState &target = targets[index];
+        if ((std::ptrdiff_t)i == target.lead) {
+            if (target.volumeChanged)
+                setVolume(i, target.volume);
+            continue;
+        }
+
+        float volume = getVolume(i);
+        if (target.volumeChanged || std::abs(volume - target.volume) > 0.001)
+            setVolume(i, target.volume);
+    }
+
+    // nothing can trigger the duck and there is nothing left to fade, so only
+    // wake up for new activity (or as a safety net if asked for)
+    decidedParked = activeCount == 0 && settled;
+    if (decidedParked && settings->tickInactiveMS > 0.0f)
+        sleepNeeded = settings->tickInactiveMS;
+    else if (decidedParked)
+        sleepNeeded = Clock::FOREVER_MS;
+
+    return sleepNeeded;
+}
+
+void DuckController::applyPowerState(PowerState power) {
+    double scale = 1.0;
+    if (power.onBattery)
+        scale = (std::max)(scale, (double)settings->batteryIntervalScale);
+    if (power.away)
+        scale = (std::max)(scale, (double)settings->awayIntervalScale);
+
+    tickIdleMS = settings->tickIdleMS * scale;
+    tickTransitionMS = settings->tickTransitionMS * scale;
+    detectorSampleMS = settings->detectorSampleMS * scale;
+}
+
+double DuckController::tick(bool bypassed, PowerState power) {
+#ifndef NDEBUG
+    size_t allocationsBefore = AllocationCounter::getThreadCount();
+#endif
+
+    settings = &settingsStore.acquire();
+    applyPowerState(power);
+
+    bool sessionsChanged = backend.updateSessions();
+    tickAllocates = sessionsChanged;
+
+    size_t activeCount;
+    sampleSessions(sessionsChanged, activeCount);
+    sampleSidechain(activeCount);
+
+    // nothing to look back on once everything has gone quiet
+    if (activeCount == 0)
+        gainComputer.reset();
+
+    bool triggersChanged = updateTriggers();
+    double now = clock.nowMS();
+
+    // between decisions only the meters are sampled. a decision is made once
+    // it is due, or straight away if anything it depends on has changed.
+    double waitNeeded;
+    if (sessionsChanged || now >= nextDecisionMS || isFading() ||
+        triggersChanged || bypassed != decidedBypassed) {
+        waitNeeded = decide(activeCount, bypassed, now);
+        nextDecisionMS = now + waitNeeded;
+        decidedBypassed = bypassed;
+    } else {
+        waitNeeded = nextDecisionMS - now;
+    }
+
+    // keep sampling while anything that can trigger the duck is playing
+    if (activeCount > 0)
+        waitNeeded = (std::min)(waitNeeded, detectorSampleMS);
+
+    if (decidedParked && activeCount == 0)
+        powerProfile = PowerProfile::Parked;
+    else if (power.away)
+        powerProfile = PowerProfile::Away;
+    else if (power.onBattery)
+        powerProfile = PowerProfile::Battery;
+    else
+        powerProfile = PowerProfile::Normal;
+
+#ifndef NDEBUG
+    assert(tickAllocates ||
+           AllocationCounter::getThreadCount() == allocationsBefore);
+#endif
+
+    return waitNeeded;
+}
+
+void DuckController::restore() {
+    settings = &settingsStore.acquire();
+    backend.updateSessions();
+    applySettings();
+
+    size_t count = backend.getSessionCount();
+    for (size_t i = 0; i < count; i++) {
+        std::int32_t target = getNameTarget(backend.getExecutableNameId(i));
+        if (target >= 0)
+            backend.setSessionVolume(i,
+                                     settings->targets[target].volumeRestore);
+    }
+}
+
+const DuckSettings &DuckController::getSettings() const { return *settings; }
+
+PowerProfile DuckController::getPowerProfile() const { return powerProfile; }
+
+bool DuckController::isFading() const {
+    for (auto &target : targets) {
+        if (target.fade.isActive())
+            return true;
+    }
+    return false;
+}
+
+std::wstring DuckController::getStatusString() const {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    return statusString;
+}
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Clock.h"
+#include "CommandExecutor.h"
+#include "Fade.h"
+#include "GainComputer.h"
+#include "LevelDetector.h"
+#include "NameMatcher.h"
+#include "SessionFrame.h"
+#include "SettingsStore.h"
+#include "VoiceGate.h"
+
+// a controlled executable and how its sessions are ducked
+struct DuckTarget {
+    std::wstring executable;
+
+    float volumeMax = 0.2f;
+    float volumeMin = 0.0f;
+    float volumeRestore = 1.0f;
+
+    // durations of the fade down (attack) and up (release) across the whole
+    // range between volumeMax and volumeMin
+    float attackMS = 1000.0f;
+    float releaseMS = 1000.0f;
+    FadeCurve attackCurve = FadeCurve::Linear;
+    FadeCurve releaseCurve = FadeCurve::Linear;
+
+    // while playing, a target also ducks every target with a lower priority
+    int priority = 0;
+
+    // with a range, the duck only goes as deep below volumeMax as the curve
+    // gives for the level of the audio that triggers it, and never below
+    // volumeMin. without one, every duck goes all the way to volumeMin.
+    GainCurve duckCurve;
+};
+
+// settings used by the duck controller, read from the ini by the engine and
+// published as a whole through a SettingsStore
+struct DuckSettings {
+    float tickIdleMS = 1000.0f;
+    float tickTransitionMS = 50.0f;
+
+    // 0 waits for session activity alone, see DuckController::tick()
+    float tickInactiveMS = 0.0f;
+
+    // the tick, sample and fade step intervals are this many times longer on
+    // battery, or while nobody is looking (see PowerState)
+    float batteryIntervalScale = 2.0f;
+    float awayIntervalScale = 4.0f;
+
+    // the level detector samples the meters at detectorSampleMS while anything
+    // that can trigger the duck is playing, see LevelDetector
+    float detectorSampleMS = 20.0f;
+    float detectorWindowMS = 100.0f;
+    float detectorAttackMS = 50.0f;
+    float detectorReleaseMS = 100.0f;
+    float volumeMinimumToTrigger = 0.0f;
+
+    // how long the duck depth of a gain curve is held, see GainComputer
+    float duckLookbackMS = 500.0f;
+    int consecutiveMinimumsToEnd = 3;
+    int consecutiveMinimumsToTrigger = 1;
+    std::vector<std::wstring> excludedExecutables;
+
+    // only the first target of each executable name is used
+    std::vector<DuckTarget> targets;
+
+    std::wstring commandOnDuck;
+    std::wstring commandOnUnduck;
+    float commandTimeoutMS = 10000.0f;
+
+    // while the sidechain is enabled and anything records the microphone, its
+    // level opens a VoiceGate that ducks every target, so talking on a call
+    // ducks as well as listening does
+    bool sidechainEnabled = false;
+    float sidechainOpenLevel = 0.1f;
+    float sidechainCloseLevel = 0.05f;
+    float sidechainHangoverMS = 400.0f;
+
+    // different for every snapshot that is (re)loaded
+    unsigned revision = 0;
+};
+
+// where a target is in ducking. the duck command runs on entering Ducked and
+// the unduck command on leaving it for anything but Attacking (which only
+// follows Ducked when the volume was changed from outside).
+enum class DuckState : std::uint8_t {
+    Idle,      // at volumeMax
+    Attacking, // fading down to volumeMin
+    Ducked,    // at volumeMin
+    Releasing, // fading back up to volumeMax
+    Bypassed,  // at volumeRestore while bypassed
+};
+
+// what the platform reports about the machine, which the tick rates are
+// scaled for
+struct PowerState {
+    bool onBattery = false;
+
+    // the display is off or the session is locked
+    bool away = false;
+};
+
+// the power profile a wait between ticks was made under. the tick, sample and
+// fade step intervals are longest in the first one that applies of:
+enum class PowerProfile : std::uint8_t {
+    Normal,  // on mains power with someone looking
+    Battery, // on battery, scaled by batteryIntervalScale
+    Away,    // display off or locked, scaled by awayIntervalScale
+    Parked,  // nothing that could trigger the duck is playing
+};
+
+static const size_t POWER_PROFILE_COUNT = 4;
+
+// lowercase name of the profile, e.g. "battery"
+const char *getPowerProfileName(PowerProfile profile);
+
+// starts the given duck/unduck command. must not wait for it to finish.
+using CommandRunner =
+    std::function<void(CommandKind kind, const std::wstring &command)>;
+
+// duckcontroller holds the platform-neutral ducking logic. each tick() samples
+// the backend once, moves the volume of every session of every target towards
+// its target volume and returns how long to wait until the next tick.
+// sessions are matched to targets by interned name in a single pass, so the
+// cost of a tick grows with the number of sessions but not with the number of
+// targets. each name is matched against the executable patterns only once.
+// the duck command runs when the first target is ducked, and the unduck
+// command when the last ducked target starts coming back up.
+// the volume of each session is read once and then shadowed: it is only read
+// again when the sessions change or the backend reports the volume was changed
+// from outside, so settled ticks make no volume reads.
+class DuckController {
+  private:
+    AudioBackend &backend;
+    Clock &clock;
+    SettingsStore<DuckSettings> &settingsStore;
+    CommandRunner runCommand;
+
+    // the snapshot in use, picked up from the store at the start of each tick
+    const DuckSettings *settings = nullptr;
+
+    // state of each target, indexed like settings->targets
+    struct TargetState {
+        std::wstring executable;
+
+        int consecutiveMinimumsToTrigger = 0;
+        int consecutiveMinimumsToEnd = 0;
+
+        // the fade of the target in progress, if any
+        Fade fade;
+
+        // whether the sessions of this target can trigger other targets, so
+        // need their meters sampled
+        bool sampled = false;
+
+        // sampled this tick: the first session of the target (whose volume is
+        // the one faded, -1 if none) and the max level of its sessions
+        std::ptrdiff_t lead = -1;
+        float level = 0.0f;
+
+        bool triggered = false;
+        bool decidedTriggered = false;
+
+        // the gain of the duck curve this tick, and the one the last decision
+        // ducked to, in dB
+        float gainDB = 0.0f;
+        float decidedGainDB = 0.0f;
+
+        // set by the last decision: the volume all sessions of the target
+        // should be at, and whether it was just changed
+        float volume = 0.0f;
+        bool volumeChanged = false;
+
+        DuckState state = DuckState::Idle;
+
+        // whether the duck command ran for this target and the unduck command
+        // has not yet
+        bool ducked = false;
+
+        // what its sessions are set back to once no longer controlled
+        float volumeRestore = 1.0f;
+    };
+    std::vector<TargetState> targets;
+    size_t duckedCount = 0;
+
+    // smooths the sampled channel peaks into the levels the duck is
+    // triggered on
+    LevelDetector detector;
+
+    // opened by the microphone level while the sidechain is enabled
+    VoiceGate voiceGate;
+
+    // the duck curve of each target and the level that triggers it, indexed
+    // like targets. the curves are set again when the settings or the look-back
+    // window length change.
+    GainComputer gainComputer;
+    std::vector<float> triggerLevels;
+    bool gainCurvesStale = true;
+
+    // when the next decision is due, and whether it was made while bypassed
+    double nextDecisionMS = -1.0;
+    bool decidedBypassed = false;
+    bool decidedParked = false;
+
+    // the intervals of the current tick: the settings scaled for the power
+    // state, and the profile of the wait returned by the last tick
+    double tickIdleMS = 0.0;
+    double tickTransitionMS = 0.0;
+    double detectorSampleMS = 0.0;
+    PowerProfile powerProfile = PowerProfile::Normal;
+
+    // values sampled from the sessions during the current tick
+    SessionFrame frame;
+
+    // the volume each session was last read at or set to (negative if not
+    // known), and the backend's volume change count when it was
+    std::vector<float> shadowVolumes;
+    std::vector<std::uint32_t> shadowChanges;
+
+    // the excluded executable and target executable patterns, compiled
+    NameMatcher excludedMatcher;
+    NameMatcher targetMatcher;
+
+    // excluded/controlled frame flags and target index of each name id,
+    // matched against the patterns the first time the name is seen and
+    // indexed by NameId. names not matched yet have a target of UNMATCHED.
+    static const std::int32_t UNMATCHED = -2;
+    std::vector<std::uint8_t> nameFlags;
+    std::vector<std::int32_t> nameTargets;
+    unsigned settingsRevision = 0;
+    bool settingsApplied = false;
+
+    // rebuild the name lookups and target states if the settings have changed
+    // since the last build. targets that are still present keep their state,
+    // the sessions of those that are gone are released like restore() does.
+    void applySettings();
+
+    // set the sessions of the previous targets that were dropped by the
+    // settings, and are not controlled by another target now, back to their
+    // restore volume. previousNameTargets are the targets of each name before
+    // the settings changed.
+    void releaseDroppedTargets(
+        const std::vector<TargetState> &previous,
+        const std::vector<bool> &kept,
+        const std::vector<std::int32_t> &previousNameTargets);
+
+    void matchName(NameId id);
+    std::uint8_t getNameFlags(NameId id);
+    std::int32_t getNameTarget(NameId id);
+
+    // which targets had a session when the status string was last built
+    std::vector<std::uint8_t> statusFound;
+    bool statusBuilt = false;
+    mutable std::mutex statusMutex; // guards statusString
+    std::wstring statusString = L"";
+
+    // set when the current tick is expected to allocate (sessions changed,
+    // status changed or a command ran). steady-state ticks must not allocate.
+    bool tickAllocates = false;
+
+    // only rebuilds the status string when the set of targets found changes
+    void updateStatus();
+
+    void fireCommand(CommandKind kind, const std::wstring &command);
+
+    // mark a target as ducked or not, running the commands when the first
+    // target is ducked or the last one is unducked
+    void setDucked(TargetState &target, bool ducked);
+
+    // move a target to the given state, running the commands it calls for
+    void setState(TargetState &target, DuckState state);
+
+    // the volume of a session, read from the backend only if the shadow is
+    // not known or was changed from outside
+    float getVolume(size_t index);
+    void setVolume(size_t index, float volume);
+
+    // start fading a target from one volume to another
+    void startFade(size_t index, float from, float to, double nowMS);
+
+    // fill the frame with the flags, targets, peaks and detector levels of
+    // every session. activeCount is set to the number of active sessions that
+    // can trigger a duck.
+    void sampleSessions(bool sessionsChanged, size_t &activeCount);
+
+    // feed the microphone level to the voice gate if the sidechain is enabled
+    // and anything records the microphone, which then counts into
+    // activeCount. closes the gate otherwise.
+    void sampleSidechain(size_t &activeCount);
+
+    // set the duck curves of the targets if they or the look-back window
+    // length have changed
+    void updateGainComputer();
+
+    // work out which targets are triggered, and how deep their curves duck
+    // them, from the levels sampled this tick. returns whether any differs
+    // from the last decision.
+    bool updateTriggers();
+
+    // the volume a triggered target ducks to
+    float getDuckedVolume(size_t index) const;
+
+    // move the volume of a target towards its target volume and return the
+    // time in ms until it needs deciding again. clears settled if it has not
+    // reached its target volume.
+    double decideTarget(size_t index, bool bypassed, double now,
+                        bool &settled);
+
+    // decide every target and bring all of their sessions to the decided
+    // volume. returns the time in ms until the next decision is due.
+    double decide(size_t activeCount, bool bypassed, double now);
+
+    // scale the intervals of this tick for the power state
+    void applyPowerState(PowerState power);
+
+  public:
+    DuckController(AudioBackend &backend, Clock &clock,
+                   SettingsStore<DuckSettings> &settingsStore,
+                   CommandRunner runCommand);
+
+    // run a single tick. returns the time in ms to wait before the next tick.
+    // every tick samples the meters, but the volumes are only decided on every
+    // tickIdleMS (or tickTransitionMS while fading), or as soon as the
+    // detector level crosses the trigger volume or the voice gate opens or
+    // closes. these and the detector sample interval are scaled for the power
+    // state.
+    // while nothing that could trigger the duck is playing (or recording, with
+    // the sidechain enabled) and the volume is settled, the controller is
+    // parked: this is the long tickInactiveMS, or Clock::FOREVER_MS if that is
+    // 0, relying on session activity to wake the engine.
+    // a tick over an unchanged set of sessions and power state makes no heap
+    // allocations.
+    double tick(bool bypassed, PowerState power = PowerState());
+
+    // the profile the wait returned by the last tick is made under
+    PowerProfile getPowerProfile() const;
+
+    // set every controlled session back to the restore volume of its target
+    void restore();
+
+    // the settings snapshot of the current tick. only valid on the thread
+    // that ticks, during or after a tick.
+    const DuckSettings &getSettings() const;
+
+    // whether a fade is in progress, i.e. the next wait should be precise
+    bool isFading() const;
+
+    // can be called from any thread
+    std::wstring getStatusString() const;
+};
@@ -1,135 +1,8 @@
 #include "Engine.h"
 
-AudioSession::AudioSession(CComPtr<IAudioSessionControl> session) {
-    this->session = session;
-}
-
-AudioSession::~AudioSession() {}
-
-IAudioSessionControl *AudioSession::getSession() { return session; }
-
-IAudioSessionControl2 *AudioSession::getSession2() {
-    if (!session2) {
-        HRESULT hr = getSession()->QueryInterface(
-            __uuidof(IAudioSessionControl2), (void **)&session2);
-        if (FAILED(hr))
-            throw std::runtime_error(
-                "Failed to get session control 2 interface");
-    }
-    return session2;
-}
-
-ISimpleAudioVolume *AudioSession::getSimpleAudioVolume() {
-    if (!simpleAudioVolume) {
-        HRESULT hr = getSession()->QueryInterface(__uuidof(ISimpleAudioVolume),
-                                                  (void **)&simpleAudioVolume);
-        if (FAILED(hr))
-            throw std::runtime_error(
-                "Failed to get simple audio volume interface");
-    }
-    return simpleAudioVolume;
-}
-
-std::wstring AudioSession::getExecutableName() {
-    if (!name) {
-        LPWSTR wName;
-        HRESULT hr = getSession2()->GetSessionIdentifier(&wName);
-        if (FAILED(hr))
-            throw std::runtime_error(
-                "Failed to get session identifier/executable name");
-        std::wstring wideString(wName);
-        LocalFree(wName);
-
-        // extract "abc.exe" from the returned string
-        name = std::make_unique<std::wstring>();
-        auto endOfPathBackslash = wideString.rfind(L"\\");
-        if (endOfPathBackslash != std::wstring::npos) {
-            std::wstring executableRegion =
-                wideString.substr(endOfPathBackslash + 1);
-            auto endOfPathPercentage = executableRegion.find(L"%");
-            if (endOfPathPercentage != std::wstring::npos) {
-                *name = executableRegion.substr(0, endOfPathPercentage);
-            }
-        }
-    }
-    return *name;
-}
-
-float AudioSession::getSessionVolume() {
-    if (!volume) {
-        volume = std::make_unique<float>();
-        HRESULT hr = getSimpleAudioVolume()->GetMasterVolume(volume.get());
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to get volume");
-    }
-    return *volume;
-}
-
-void AudioSession::setSessionVolume(float &newVolume) {
-    HRESULT hr = getSimpleAudioVolume()->SetMasterVolume(newVolume, NULL);
-    if (FAILED(hr))
-        throw std::runtime_error("Failed to set volume");
-    std::cout << "Volume set to: " << newVolume << std::endl;
-}
-
-IAudioMeterInformation *AudioSession::getAudioMeterInformation() {
-    if (!audioMeterInformation) {
-        HRESULT hr = getSession()->QueryInterface(
-            __uuidof(IAudioMeterInformation), (void **)&audioMeterInformation);
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to get audio meter interface");
-    }
-    return audioMeterInformation;
-}
-
-float AudioSession::getPeakAudioLevel() {
-    if (!volumePeak) {
-        volumePeak = std::make_unique<float>();
-        HRESULT hr = getAudioMeterInformation()->GetPeakValue(volumePeak.get());
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to get peak audio level");
-    }
-    return *volumePeak;
-}
-
-float Engine::getMaxPeakAudioLevel(
-    const std::vector<std::wstring> &excludedExecutables) {
-    float maxVolume = 0.0f;
-    for (auto &session : sessions) {
-        if (std::find(excludedExecutables.begin(), excludedExecutables.end(),
-                      session->getExecutableName()) !=
-            excludedExecutables.end()) {
-            continue;
-        }
-
-        float volume = session->getPeakAudioLevel();
-        if (volume > maxVolume)
-            maxVolume = volume;
-    }
-
-    return maxVolume;
-}
-
 bool Engine::init() {
     try {
-        HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to initialize COM");
-
-        hr = deviceEnumerator.CoCreateInstance(__uuidof(MMDeviceEnumerator),
-                                               nullptr, CLSCTX_ALL);
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to create device enumerator");
-
-        hr = deviceEnumerator->GetDefaultAudioEndpoint(
-            EDataFlow::eRender, ERole::eConsole, &device);
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to get default audio endpoint");
-
-        hr = device->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, NULL,
-                              (void **)&sessionManager2);
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to activate session manager");
+        backend.init();
     } catch (std::exception &exception) {
         handleError(exception);
         return false;
@@ -137,51 +10,13 @@ bool Engine::init() {
     return true;
 }
 
-std::vector<std::shared_ptr<AudioSession>> Engine::getAudioSessions() {
-    if (sessionManager2 == nullptr)
-        throw std::runtime_error(
-            "Failed to get audio session (engine uninitialised)");
-
-    HRESULT hr;
-
-    std::vector<std::shared_ptr<AudioSession>> sessions;
-    CComPtr<IAudioSessionEnumerator> sessionEnumerator;
-
-    hr = sessionManager2->GetSessionEnumerator(&sessionEnumerator);
-    if (FAILED(hr))
-        throw std::runtime_error("Failed to get session enumerator");
-
-    int count;
-    hr = sessionEnumerator->GetCount(&count);
-    if (FAILED(hr))
-        throw std::runtime_error("Failed to get session count");
-
-    for (int i = 0; i < count; i++) {
-        CComPtr<IAudioSessionControl> pSessionControl;
-        hr = sessionEnumerator->GetSession(i, &pSessionControl);
-        if (FAILED(hr))
-            throw std::runtime_error("Failed to get session " +
-                                     std::to_string(i));
-
-        auto session = std::make_shared<AudioSession>(pSessionControl);
-        sessions.push_back(session);
-    }
+void Engine::requestReloadSettings() { settingsWatcher.trigger(); }
 
-    return sessions;
+void Engine::requestQuit() {
+    quitRequested = true;
+    clock.wake();
 }
 
-std::shared_ptr<AudioSession>
-Engine::getAudioSessionByExecutableName(const std::wstring &executableName) {
-    for (auto &session : sessions) {
-        std::wstring processName = session->getExecutableName();
-        if (!processName.empty() && processName == executableName)
-            return session;
-    }
-    return nullptr;
-}
-
-void Engine::requestQuit() { quitRequested = true; }
-
 std::wstring Engine::getAbsoluteExecutablePath() {
     wchar_t buffer[MAX_PATH];
     GetModuleFileNameW(NULL, buffer, MAX_PATH);
@@ -198,6 +33,41 @@ std::wstring Engine::getSettingsINIPath() {
     return exeDirectory + SETTINGS_FILENAME;
 }
 
+std::wstring Engine::getMetricsPath() {
+    return getAbsoluteExecutablePath() + METRICS_FILENAME;
+}
+
+std::wstring Engine::getTracePathArgument() {
+    int argc = 0;
+    LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv)
+        return L"";
+
+    std::wstring path;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::wstring(argv[i]) == L"--record")
+            path = argv[i + 1];
+    }
+    LocalFree(argv);
+
+    // a drive letter, or a path from the root of the drive or a share with
+    // either kind of slash
+    bool absolute = (path.size() >= 2 && path[1] == L':') ||
+                    (!path.empty() && (path[0] == L'\\' || path[0] == L'/'));
+    if (!path.empty() && !absolute)
+        path = getAbsoluteExecutablePath() + path;
+    return path;
+}
+
+void Engine::exportMetrics() {
+    std::ofstream file(getMetricsPath());
+    if (!file.is_open()) {
+        LOG_WARNING("failed to write metrics file");
+        return;
+    }
+    metrics.writeJSON(file);
+}
+
 bool Engine::openSettingsINI() {
     try {
         ShellExecuteW(NULL, L"open", getSettingsINIPath().c_str(), NULL, NULL,
@@ -213,32 +83,51 @@ bool Engine::readSettingsINI() {
     try {
         tryCreateDefaultSettingsINI();
 
-        readINIValue(L"Performance", L"fTickIdleMS", paramTickIdleMS);
-        readINIValue(L"Performance", L"fTickTransitionsMS",
-                     paramTickTransitionMS);
-        readINIValue(L"General", L"fFadeSpeedMS", paramFadeSpeedMS);
-        readINIValue(L"General", L"fVolumeMinimumToTrigger",
-                     paramVolumeMinimumToTrigger);
-        readINIValue(L"General", L"fVolumeMax", paramVolumeMax);
-        readINIValue(L"General", L"fVolumeMin", paramVolumeMin);
-        readINIValue(L"General", L"iConsecutiveMinimumsToTrigger",
-                     paramConsecutiveMinimumsToTrigger);
-        readINIValue(L"General", L"iConsecutiveMinimumsToEnd",
-                     paramConsecutiveMinimumsToEnd);
-
-        readINIValue(L"General", L"sExcludedExecutables",
-                     paramExcludedExecutables);
-        readINIValue(L"General", L"sControlledExecutable",
-                     paramControlledExecutable);
-
-        paramExcludedExecutables.push_back(paramControlledExecutable);
-
-        readINIValue(L"General", L"fVolumeRestore", paramVolumeRestore);
-
-        readINIValue(L"General", L"sCommandOnDuck", paramCommandOnDuck);
-        readINIValue(L"General", L"sCommandOnUnduck", paramCommandOnUnduck);
+        SettingsFile file;
+        file.parse(readSettingsText());
+
+        // settings added since the ini was written are filled in with their
+        // defaults, so updating never needs the ini deleted
+        if (!file.getMissing().empty()) {
+            LOG_INFO("adding new settings to the ini file",
+                     {{"count", (double)file.getMissing().size()}});
+            writeSettingsText(file.migrate());
+        }
+
+        DuckSettings settings = file.getDuckSettings();
+        metricsExportMS = file.getFloat(Setting::MetricsExportMS);
+
+        // the sampler only reads what the controller will look at
+        std::vector<std::wstring> controlled;
+        for (auto &target : settings.targets)
+            controlled.push_back(target.executable);
+        pipeline.setSampleFilter(settings.excludedExecutables, controlled);
+        pipeline.setWriteFilter(file.getFloat(Setting::VolumeStepDB),
+                                file.getFloat(Setting::VolumeWriteIntervalMS));
+        // the microphone is not even watched unless the sidechain wants it
+        backend.setCaptureEnabled(settings.sidechainEnabled);
+
+        settings.revision = ++settingsRevision;
+        LOG_INFO("settings loaded",
+                 {{"revision", (double)settings.revision},
+                  {"targets", (double)settings.targets.size()}});
+        settingsStore.publish(std::move(settings));
+        clock.wake();
+
+        std::lock_guard<std::mutex> lock(errorMutex);
+        settingsErrorString.clear();
     } catch (std::exception &exception) {
+        // an ini saved halfway through an edit keeps the last settings
+        // running until the next save reads fine
+        if (settingsRevision > 0) {
+            handleSettingsError(exception);
+            return false;
+        }
+
         handleError(exception);
+
+        // the engine may be waiting, and needs to see the error
+        clock.wake();
         return false;
     }
     return true;
@@ -247,42 +136,40 @@ bool Engine::readSettingsINI() {
 void Engine::tryCreateDefaultSettingsINI() {
     auto settingsPath = getSettingsINIPath();
 
-    std::wifstream checkFile(settingsPath);
+    std::ifstream checkFile(settingsPath);
     if (!checkFile) {
-        std::wofstream file(settingsPath);
+        std::ofstream file(settingsPath, std::ios::binary);
         if (!file.is_open()) {
             throw std::runtime_error("Failed to create default INI file");
         }
-        file << SETTINGS_DEFAULT;
+        file << encodeSettingsText(generateDefaultSettingsINI());
         file.close();
     }
     checkFile.close();
 }
 
-std::wstring Engine::readINIValueStringW(const std::wstring &section,
-                                         const std::wstring &key) {
-    auto settingsPath = getSettingsINIPath();
-    wchar_t buffer[1024];
-    DWORD bytesRead = GetPrivateProfileStringW(
-        section.c_str(), key.c_str(), NULL, buffer, 1024, settingsPath.c_str());
-
-    if (bytesRead == 0) {
-        DWORD error = GetLastError();
-        if (error != ERROR_SUCCESS)
-            throw std::runtime_error(
-                "Failed to read value from INI file\n"
-                "If the program has just updated, "
-                "there may be new settings not present in your INI file.\n"
-                "Try deleting the INI file and opening the program again.\n"
-                "Key: " +
-                wStringToString(key));
-    }
+std::wstring Engine::readSettingsText() {
+    std::ifstream file(getSettingsINIPath(), std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open INI file");
+
+    std::string bytes((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+    return decodeSettingsText(bytes);
+}
 
-    std::wstring value(buffer);
-    return value;
+void Engine::writeSettingsText(const std::wstring &text) {
+    std::ofstream file(getSettingsINIPath(),
+                       std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to update INI file");
+    file << encodeSettingsText(text);
 }
 
-void Engine::runCommandSilent(std::wstring &command) {
+CommandResult Engine::runCommandSilent(const std::wstring &command,
+                                       double timeoutMS) {
+    CommandResult result;
+
     STARTUPINFO si;
     PROCESS_INFORMATION pi;
     ZeroMemory(&si, sizeof(si));
@@ -293,20 +180,190 @@ void Engine::runCommandSilent(std::wstring &command) {
 
     std::wstring formattedCommand = CMD_START + command;
 
+    // the job lets a timed out command be killed along with anything that
+    // cmd.exe started. closing it kills nothing, so programs the command
+    // launches (e.g. with start) keep running once cmd.exe is done.
+    HANDLE job = CreateJobObjectW(NULL, NULL);
+
+    auto start = std::chrono::steady_clock::now();
+
     if (!CreateProcessW(NULL, const_cast<LPWSTR>(formattedCommand.c_str()),
-                        NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si,
-                        &pi))
-        throw std::runtime_error("Failed to create process for command");
+                        NULL, NULL, FALSE, CREATE_NO_WINDOW | CREATE_SUSPENDED,
+                        NULL, NULL, &si, &pi)) {
+        if (job)
+            CloseHandle(job);
+        return result;
+    }
+    result.started = true;
+
+    if (job)
+        AssignProcessToJobObject(job, pi.hProcess);
+    ResumeThread(pi.hThread);
+
+    DWORD wait = WaitForSingleObject(
+        pi.hProcess, (timeoutMS > 0.0) ? (DWORD)timeoutMS : INFINITE);
+    if (wait == WAIT_TIMEOUT) {
+        result.timedOut = true;
+        if (job)
+            TerminateJobObject(job, 1);
+        else
+            TerminateProcess(pi.hProcess, 1);
+        WaitForSingleObject(pi.hProcess, INFINITE);
+    }
+
+    DWORD exitCode = 0;
+    GetExitCodeProcess(pi.hProcess, &exitCode);
+    result.exitCode = exitCode;
+    result.durationMS = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
 
-    WaitForSingleObject(pi.hProcess, INFINITE);
     CloseHandle(pi.hProcess);
     CloseHandle(pi.hThread);
+    if (job)
+        CloseHandle(job);
+
+    return result;
 }
 
-void Engine::setBypassed(bool newBypassed) { bypassed = newBypassed; }
+void Engine::setBypassed(bool newBypassed) {
+    bypassed = newBypassed;
+    clock.wake();
+}
 
 bool Engine::getBypassed() const { return bypassed; }
 
+void Engine::setOnBattery(bool newOnBattery) {
+    onBattery = newOnBattery;
+    clock.wake();
+}
+
+void Engine::setDisplayOff(bool newDisplayOff) {
+    displayOff = newDisplayOff;
+    clock.wake();
+}
+
+void Engine::setSessionLocked(bool newSessionLocked) {
+    sessionLocked = newSessionLocked;
+    clock.wake();
+}
+
+PowerState Engine::getPowerState() const {
+    PowerState state;
+    state.onBattery = onBattery;
+    state.away = displayOff || sessionLocked;
+    return state;
+}
+
+// user and kernel time of every thread of the process so far
+static std::uint64_t getProcessCPUUS() {
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel,
+                         &user))
+        return 0;
+
+    // filetimes are in 100ns units
+    auto toUS = [](const FILETIME &time) {
+        return (((std::uint64_t)time.dwHighDateTime << 32) |
+                time.dwLowDateTime) /
+               10;
+    };
+    return toUS(kernel) + toUS(user);
+}
+
+void Engine::recordPowerUsage() {
+    double now = clock.nowMS();
+    std::uint64_t cpuUS = getProcessCPUUS();
+
+    if (powerUsageStartMS >= 0.0) {
+        PowerUsage &usage = powerUsage[(size_t)powerProfile];
+        usage.wakeups->add();
+        usage.wallUS->add((std::uint64_t)((now - powerUsageStartMS) * 1000.0));
+        if (cpuUS >= powerUsageStartCPUUS)
+            usage.cpuUS->add(cpuUS - powerUsageStartCPUUS);
+    }
+    powerUsageStartMS = now;
+    powerUsageStartCPUUS = cpuUS;
+}
+
+double Engine::getWakeupsPerMinute() const { return wakeups.getPerMinute(); }
+
+size_t Engine::getEndpointCount() const { return backend.getEndpointCount(); }
+
+double Engine::getRebindLatencyMS() const {
+    return backend.getRebindLatencyMS();
+}
+
+std::wstring Engine::getMetricsSummary() const {
+    wchar_t buffer[256];
+    swprintf(buffer, 256,
+             L"Tick: %.0f us mean, %.0f us p99, %llu ducks, %.2f%% overhead. "
+             L"Commands: %llu exited (%llu non-zero), %llu timed out, %llu "
+             L"failed, %.0f ms mean",
+             tickLatency.getMeanNS() / 1000.0,
+             (double)tickLatency.getQuantileNS(0.99) / 1000.0,
+             (unsigned long long)duckCount.get(),
+             metrics.getOverheadFraction(tickLatency) * 100.0,
+             (unsigned long long)commandsCompleted.get(),
+             (unsigned long long)commandsExitedNonZero.get(),
+             (unsigned long long)commandsTimedOut.get(),
+             (unsigned long long)commandsFailed.get(),
+             commandDuration.getMeanNS() / 1000000.0);
+    return buffer;
+}
+
+std::wstring Engine::getPipelineSummary() const {
+    auto p99 = [](const LatencyHistogram &histogram) {
+        return (double)histogram.getQuantileNS(0.99) / 1000.0;
+    };
+
+    wchar_t buffer[128];
+    swprintf(buffer, 128,
+             L"Pipeline p99: %.0f us sample, %.0f us control, %.0f us apply",
+             p99(pipelineSampleLatency), p99(tickLatency),
+             p99(pipelineActuateLatency));
+    return buffer;
+}
+
+std::wstring Engine::getVolumeWriteSummary() const {
+    std::uint64_t fades = duckCount.get() + unduckCount.get();
+    double perFade =
+        (fades > 0) ? (double)volumeWrites.get() / (double)fades : 0.0;
+
+    wchar_t buffer[128];
+    swprintf(buffer, 128,
+             L"Volume writes: %.1f per fade, %llu held back, %llu "
+             L"notifications",
+             perFade,
+             (unsigned long long)(volumeWritesStep.get() +
+                                  volumeWritesRate.get()),
+             (unsigned long long)volumeNotifications.get());
+    return buffer;
+}
+
+std::wstring Engine::getPowerSummary() const {
+    std::wstring summary = L"Per hour:";
+    bool first = true;
+    for (size_t p = 0; p < POWER_PROFILE_COUNT; p++) {
+        const PowerUsage &usage = powerUsage[p];
+        double hours = (double)usage.wallUS->get() / 3600000000.0;
+        if (hours <= 0.0)
+            continue;
+
+        std::string name = getPowerProfileName((PowerProfile)p);
+        summary += first ? L" " : L", ";
+        summary += std::wstring(name.begin(), name.end());
+        first = false;
+
+        wchar_t buffer[64];
+        swprintf(buffer, 64, L" %.0f wakeups %.1f CPU-s",
+                 (double)usage.wakeups->get() / hours,
+                 (double)usage.cpuUS->get() / 1000000.0 / hours);
+        summary += buffer;
+    }
+    return summary;
+}
+
 std::unique_ptr<Engine> Engine::engine; // singleton
 Engine *Engine::get() {
     if (!engine)
@@ -315,114 +372,53 @@ Engine *Engine::get() {
 }
 
 bool Engine::running() {
+    Logger::get().start(getAbsoluteExecutablePath() + LOG_FILENAME);
+    LOG_INFO("starting");
+
     try {
         if (!readSettingsINI())
             return hasError();
 
         if (!init())
             return hasError();
+        pipeline.start();
+
+        settingsWatcher.start(getAbsoluteExecutablePath(), SETTINGS_FILENAME);
+
+        if (!tracePath.empty()) {
+            traceFile.open(tracePath, std::ios::binary | std::ios::trunc);
+            if (!traceFile.is_open())
+                throw std::runtime_error("Failed to create the trace file");
+            traceRecorder.start(traceFile);
+            LOG_INFO("recording a trace");
+        }
+
+        metrics.calibrate();
 
         while (!hasError()) {
+            wakeups.wakeup(clock.nowMS());
+            recordPowerUsage();
 
-            sessions = getAudioSessions();
-
-            float maxVolume = getMaxPeakAudioLevel(paramExcludedExecutables);
-
-            auto sessionControls =
-                getAudioSessionByExecutableName(paramControlledExecutable);
-
-            float volumeTarget = (maxVolume > paramVolumeMinimumToTrigger)
-                                     ? paramVolumeMin
-                                     : paramVolumeMax;
-
-            float sleepNeeded = paramTickIdleMS;
-
-            if (getBypassed())
-                volumeTarget = paramVolumeRestore;
-
-            // if found controlling program...
-            if (sessionControls) {
-                shortStatusString =
-                    L"Found and controlling " + paramControlledExecutable;
-
-                float volumeCurrent = sessionControls->getSessionVolume();
-                bool shouldTransition =
-                    std::abs(volumeCurrent - volumeTarget) > 0.001;
-
-                if (shouldTransition && getBypassed()) {
-                    sessionControls->setSessionVolume(paramVolumeRestore);
-                    // run unduck command if bypassing and currently ducked...
-                    if (volumeCurrent == paramVolumeMin)
-                        runCommandSilent(paramCommandOnUnduck);
-                }
-
-                if (shouldTransition && !getBypassed()) {
-                    // increase consecutive minimums if at minimum
-                    if (volumeTarget == paramVolumeMin) {
-                        currentConsecutiveMinimumsToTrigger =
-                            min(currentConsecutiveMinimumsToTrigger + 1,
-                                paramConsecutiveMinimumsToTrigger);
-                    } else {
-                        currentConsecutiveMinimumsToEnd =
-                            min(currentConsecutiveMinimumsToEnd + 1,
-                                paramConsecutiveMinimumsToEnd);
-                    }
-
-                    // if either minimum is at the target value
-                    if ((currentConsecutiveMinimumsToTrigger ==
-                         paramConsecutiveMinimumsToTrigger) ||
-                        (currentConsecutiveMinimumsToEnd ==
-                         paramConsecutiveMinimumsToEnd)) {
-
-                        float directionMult =
-                            ((volumeCurrent - volumeTarget) > 0) ? -1.0f : 1.0f;
-
-                        float step =
-                            (paramVolumeMax - paramVolumeMin) *
-                            (paramTickTransitionMS / paramFadeSpeedMS) *
-                            directionMult;
-
-                        float newVolume =
-                            min(max(volumeCurrent + step, paramVolumeMin),
-                                paramVolumeMax);
-
-                        sessionControls->setSessionVolume(newVolume);
-
-                        sleepNeeded = paramTickTransitionMS;
-
-                        // if transitioning, set both values to max to ensure
-                        // smooth transitioning
-                        currentConsecutiveMinimumsToEnd =
-                            paramConsecutiveMinimumsToEnd;
-                        currentConsecutiveMinimumsToTrigger =
-                            paramConsecutiveMinimumsToTrigger;
-
-                        // try duck command
-                        if (newVolume == paramVolumeMin && directionMult < 0.0)
-                            runCommandSilent(paramCommandOnDuck);
-
-                        // try unduck command
-                        if (volumeCurrent == paramVolumeMin &&
-                            directionMult > 0.0)
-                            runCommandSilent(paramCommandOnUnduck);
-                    }
-
-                } else {
-                    currentConsecutiveMinimumsToEnd = 0;
-                    currentConsecutiveMinimumsToTrigger = 0;
-                }
-            } else {
-                // failure to file controlled executable is not fatal.
-                std::cout
-                    << "Cannot find controlled executable, will keep looking."
-                    << std::endl;
-                shortStatusString = L"Controlled executable not found";
+            double waitNeeded;
+            {
+                ScopedTimer timer(tickLatency);
+                waitNeeded = controller.tick(getBypassed(), getPowerState());
             }
+            powerProfile = controller.getPowerProfile();
 
-            // cleanup
-            sessions.clear();
+            if (metricsExportMS > 0.0f &&
+                clock.nowMS() >= nextMetricsExportMS) {
+                exportMetrics();
+                nextMetricsExportMS = clock.nowMS() + metricsExportMS;
+            }
 
-            Sleep((DWORD)sleepNeeded);
+            // the volumes of this tick go to the actuator, and the sampler
+            // wakes the engine with the next snapshot when it is needed.
+            // session activity, settings reloads, bypassing and quit requests
+            // all cut the wait short too.
+            pipeline.flush();
+            pipeline.requestSample(waitNeeded, controller.isFading());
+            clock.waitMS(waitNeeded + PipelineBackend::SAMPLE_GRACE_MS);
 
             if (quitRequested)
                 break;
@@ -431,32 +427,68 @@ bool Engine::running() {
         handleError(error);
     }
 
+    settingsWatcher.stop();
+
     // try resetting volume to restore value
     try {
-        sessions = getAudioSessions();
-        auto s = getAudioSessionByExecutableName(paramControlledExecutable);
-        if (s)
-            s->setSessionVolume(paramVolumeRestore);
-
-        sessions.clear();
+        controller.restore();
+        pipeline.flush();
     } catch (std::runtime_error &error) {
         handleError(error);
     }
+    pipeline.stop();
+
+    traceRecorder.stop();
+    if (traceFile.is_open())
+        traceFile.close();
+
+    if (metricsExportMS > 0.0f)
+        exportMetrics();
 
     return hasError();
 }
 
-bool Engine::hasError() const { return !errorString.empty(); }
+bool Engine::hasError() const { return errored; }
 
-std::wstring &Engine::getErrorString() { return errorString; }
+std::wstring Engine::getErrorString() {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    return errorString;
+}
 
-std::wstring &Engine::getShortStatusString() { return shortStatusString; }
+std::wstring Engine::getShortStatusString() {
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (hasError())
+            return shortStatusString;
+        if (!settingsErrorString.empty())
+            return L"Settings not reloaded: " + settingsErrorString;
+    }
+    return controller.getStatusString();
+}
 
 void Engine::handleError(const std::exception &exception) {
-    errorString = stringToWString(exception.what());
-    if (errorString.empty())
-        errorString = L"Unknown error";
+    std::wstring message = stringToWString(exception.what());
+    if (message.empty())
+        message = L"Unknown error";
+
+    LOG_ERROR("error", {}, exception.what());
+
+    std::lock_guard<std::mutex> lock(errorMutex);
+    errorString = message;
     shortStatusString = L"An error has occurred";
+    errored = true;
+}
+
+void Engine::handleSettingsError(const std::exception &exception) {
+    std::wstring message = stringToWString(exception.what());
+    if (message.empty())
+        message = L"Unknown error";
+
+    LOG_WARNING("settings not reloaded, keeping the last ones", {},
+                exception.what());
+
+    std::lock_guard<std::mutex> lock(errorMutex);
+    settingsErrorString = message;
 }
 
 std::string Engine::wStringToString(const std::wstring &wstr) {
@@ -469,13 +501,70 @@ std::wstring Engine::stringToWString(const std::string &str) {
     return converter.from_bytes(str);
 }
 
-Engine::Engine() {}
+Engine::Engine()
+    : tickLatency(metrics.histogram("engine.tick")),
+      duckCount(metrics.counter("engine.ducks")),
+      unduckCount(metrics.counter("engine.unducks")), backend(metrics),
+      pipeline(
+          backend, samplerClock, metrics,
+          [] { CoInitializeEx(NULL, COINIT_MULTITHREADED); },
+          [] { CoUninitialize(); }),
+      pipelineSampleLatency(metrics.histogram("pipeline.sample")),
+      pipelineActuateLatency(metrics.histogram("pipeline.actuate")),
+      volumeWrites(metrics.counter("pipeline.volumeWrites")),
+      volumeWritesStep(metrics.counter("pipeline.volumeWritesHeldStep")),
+      volumeWritesRate(metrics.counter("pipeline.volumeWritesHeldRate")),
+      volumeNotifications(metrics.counter("session.volumeNotifications")),
+      tracePath(getTracePathArgument()), traceRecorder(pipeline, clock),
+      controller(tracePath.empty() ? (AudioBackend &)pipeline
+                                   : (AudioBackend &)traceRecorder,
+                 clock, settingsStore,
+                 [this](CommandKind kind, const std::wstring &command) {
+                     (kind == CommandKind::Duck ? duckCount : unduckCount)
+                         .add();
+                     traceRecorder.recordCommand(kind);
+                     commands.submit(kind, command,
+                                     controller.getSettings().commandTimeoutMS);
+                 }),
+      settingsWatcher([this] { readSettingsINI(); }),
+      commandsCompleted(metrics.counter("command.completed")),
+      commandsExitedNonZero(metrics.counter("command.exitedNonZero")),
+      commandsTimedOut(metrics.counter("command.timedOut")),
+      commandsFailed(metrics.counter("command.failed")),
+      commandDuration(metrics.histogram("command.duration")),
+      commands(
+          [this](const std::wstring &command, double timeoutMS) {
+              return runCommandSilent(command, timeoutMS);
+          },
+          metrics) {
+    // new audio wakes the engine straight away instead of waiting for a tick,
+    // as does every snapshot the sampler takes
+    pipeline.setActivityCallback([this] { clock.wake(); });
+
+    // the overhead of timing is reported for each thread on its own: the
+    // engine thread only times the tick, the backend calls are timed on the
+    // sampler and actuator threads of the pipeline
+    metrics.addOverheadScope(tickLatency, {&tickLatency});
+    metrics.addOverheadScope(
+        pipelineSampleLatency,
+        {&pipelineSampleLatency, &metrics.histogram("backend.updateSessions"),
+         &metrics.histogram("session.getChannelPeakLevels"),
+         &metrics.histogram("session.getVolume"),
+         &metrics.histogram("capture.getPeakLevel")});
+    metrics.addOverheadScope(pipelineActuateLatency,
+                             {&pipelineActuateLatency,
+                              &metrics.histogram("session.setVolume")});
+
+    for (size_t p = 0; p < POWER_PROFILE_COUNT; p++) {
+        std::string prefix =
+            std::string("power.") + getPowerProfileName((PowerProfile)p);
+        powerUsage[p].wakeups = &metrics.counter(prefix + ".wakeups");
+        powerUsage[p].wallUS = &metrics.counter(prefix + ".wallUS");
+        powerUsage[p].cpuUS = &metrics.counter(prefix + ".cpuUS");
+    }
+}
 
 Engine::~Engine() {
-    sessions.clear();
-    // explicitly free CComPtrs before CoUninitialize()
-    deviceEnumerator = nullptr;
-    device = nullptr;
-    sessionManager2 = nullptr;
-    CoUninitialize();
+    // anything logged by the members torn down after this stays unwritten
+    Logger::get().stop();
 }
@@ -6,135 +6,140 @@
 #include <mmdeviceapi.h>
 #include <windows.h>
 
+#include <atomic>
 #include <codecvt>
 #include <fstream>
-#include <iostream>
+#include <iterator>
 #include <locale>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "CommandExecutor.h"
+#include "DuckController.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "PipelineBackend.h"
+#include "SettingsFile.h"
+#include "SettingsStore.h"
+#include "TraceRecorder.h"
+#include "WASAPIBackend.h"
+#include "WakeupCounter.h"
+#include "Win32Clock.h"
+#include "Win32FileWatcher.h"
+
 static const LPCWSTR PROG_BRAND_NAME = L"Auto-Duck BGM";
 static const std::wstring SETTINGS_FILENAME = L"settings.ini";
+static const std::wstring METRICS_FILENAME = L"metrics.json";
+static const std::wstring LOG_FILENAME = L"auto-duck-bgm.log";
 static const std::wstring CMD_START = L"cmd.exe /C ";
 
-static const std::wstring SETTINGS_DEFAULT = LR"([Performance]
-; Controls how frequently the program queries volume information when idle.
-fTickIdleMS=1000.0
-
-; Controls how frequently the program queries volume information when transitioning. Higher values mean a smoother transition.
-fTickTransitionsMS=50.0
-
-
-
-[General]
-; Control the fade speed of the audio.
-fFadeSpeedMS=1000.0
-
-; Number of consecutive samples that the volume needs to be above the fVolumeMinimumToTrigger to trigger the duck. 1 will trigger the duck immediately.
-iConsecutiveMinimumsToTrigger=1
-
-; Number of consecutive samples that the volume needs to be below the fVolumeMinimumToTrigger to end the duck.
-iConsecutiveMinimumsToEnd=3
-
-; Minimum volume of programs not excluded or controlled to trigger the duck.
-fVolumeMinimumToTrigger=0.0
-
-; The minimum volume the controlled program will be lowered to. 0.0 is muted.
-fVolumeMin=0.0
-
-; The maximum volume the controlled program will be raised to. For background music, set to a lower value.
-fVolumeMax=0.2
-
-; The volume to restore the controlled program to when this program is closed or bypassed.
-fVolumeRestore=1.0
-
-; Excluded executable names that are ignored when calculating whether to trigger. Separated by a "/" character.
-sExcludedExecutables=nvcontainer.exe/amdow.exe/amddvr.exe
-
-; The program that is targeted.
-sControlledExecutable=foobar2000.exe
-
-; Run a Windows command when ducked or unducked. Leave empty for no commands.
-sCommandOnDuck=
-sCommandOnUnduck=
-)";
-
-// audiosession store info about a single IAudioSessionControl within a single
-// tick. interfaces other than IAudioSessionControl are not requested/created
-// until they are accessed.
-// the result of all function calls are cached in the appropriate private
-// variables.
-class AudioSession {
-  private:
-    CComPtr<IAudioSessionControl> session = nullptr;
-    CComPtr<IAudioSessionControl2> session2 = nullptr;
-    CComPtr<ISimpleAudioVolume> simpleAudioVolume = nullptr;
-    CComPtr<IAudioMeterInformation> audioMeterInformation = nullptr;
-    std::unique_ptr<std::wstring> name = nullptr;
-    std::unique_ptr<float> volume = nullptr;
-    std::unique_ptr<float> volumePeak = nullptr;
-
-  public:
-    AudioSession(CComPtr<IAudioSessionControl> session);
-    ~AudioSession();
-
-    IAudioSessionControl *getSession();
-    IAudioSessionControl2 *getSession2();
-    ISimpleAudioVolume *getSimpleAudioVolume();
-    IAudioMeterInformation *getAudioMeterInformation();
-
-    // attempts to extract the executable name from the session identifier in
-    // the form of "ABC.exe"
-    std::wstring getExecutableName();
-
-    // session volume is volume level set on the mixer (Sndvol)
-    float getSessionVolume();
-    void setSessionVolume(float &newVolume);
-
-    // peak audio level is the max of any channel of the current audio session.
-    // this has NO averaging of peak levels (RMS loudness)
-    float getPeakAudioLevel();
-};
-
 // singleton engine class accessible via Engine::get().
 // the running() function blocks until the engine is requested to quit via
 // requestQuit() or an error occurs. if the engine encountered an error, use
 // hasError() to check and getErrorString() to fetch the error string.
+// the public functions can be called from the ui thread while running() is
+// blocked on the engine thread. requests are handed over through atomics and
+// wake the engine, so they take effect immediately.
 class Engine {
   private:
     static std::unique_ptr<Engine> engine; // singleton
 
-    std::vector<std::shared_ptr<AudioSession>> sessions;
-
+    std::mutex errorMutex; // guards the error strings
+    std::atomic<bool> errored{false};
     std::wstring errorString;
     std::wstring shortStatusString = L"";
     void handleError(const std::exception &exception);
 
-    CComPtr<IMMDeviceEnumerator> deviceEnumerator = nullptr;
-    CComPtr<IMMDevice> device = nullptr;
-    CComPtr<IAudioSessionManager2> sessionManager2 = nullptr;
-
-    // params set by ini
-    float paramFadeSpeedMS;
-    float paramTickIdleMS;
-    float paramTickTransitionMS;
-    float paramVolumeMinimumToTrigger;
-    float paramVolumeMax;
-    float paramVolumeMin;
-    float paramVolumeRestore;
-    int paramConsecutiveMinimumsToEnd;
-    int paramConsecutiveMinimumsToTrigger;
-    std::vector<std::wstring> paramExcludedExecutables;
-    std::wstring paramControlledExecutable;
-    std::wstring paramCommandOnDuck;
-    std::wstring paramCommandOnUnduck;
-
-    int currentConsecutiveMinimumsToTrigger = 0;
-    int currentConsecutiveMinimumsToEnd = 0;
-
-    bool quitRequested = false;
-    bool bypassed = false;
+    // why the settings ini failed to reload, empty if it did not. unlike
+    // other errors this does not stop the engine, the last settings stay.
+    std::wstring settingsErrorString;
+    void handleSettingsError(const std::exception &exception);
+
+    // params set by ini. the duck settings are published as a whole, so the
+    // engine thread can pick them up mid-reload without a lock.
+    SettingsStore<DuckSettings> settingsStore{DuckSettings()};
+    std::atomic<float> metricsExportMS{60000.0f};
+
+    // revision of the last snapshot loaded, only touched while loading
+    unsigned settingsRevision = 0;
+
+    // declared before everything that registers metrics in it
+    MetricsRegistry metrics;
+    LatencyHistogram &tickLatency;
+    Counter &duckCount;
+    Counter &unduckCount;
+
+    // metrics are written at the first wakeup after this, so writing them
+    // never wakes the engine by itself
+    double nextMetricsExportMS = 0.0;
+
+    // the duck logic itself is platform-neutral, the engine provides the
+    // windows backend, clock, commands and settings.
+    // the clocks are declared first so they outlive backend notifications
+    Win32Clock clock;
+    Win32Clock samplerClock; // only waited on by the pipeline sampler
+    WASAPIBackend backend;
+
+    // the core audio calls are made on the sampler and actuator threads of
+    // the pipeline, the engine thread only runs the controller
+    PipelineBackend pipeline;
+    LatencyHistogram &pipelineSampleLatency;
+    LatencyHistogram &pipelineActuateLatency;
+    Counter &volumeWrites;
+    Counter &volumeWritesStep;
+    Counter &volumeWritesRate;
+    Counter &volumeNotifications;
+
+    // with --record <file> on the command line, the controller works through
+    // the recorder, which writes a trace of every tick for tools/TraceReplay
+    std::wstring tracePath;
+    std::ofstream traceFile;
+    TraceRecorder traceRecorder;
+
+    DuckController controller;
+
+    // reloads the settings when the ini changes, or when asked to. declared
+    // after everything a reload touches, so it is stopped first.
+    Win32FileWatcher settingsWatcher;
+
+    // what the command executor recorded, for the tray menu
+    Counter &commandsCompleted;
+    Counter &commandsExitedNonZero;
+    Counter &commandsTimedOut;
+    Counter &commandsFailed;
+    LatencyHistogram &commandDuration;
+
+    // declared last so it is stopped first, letting queued commands finish
+    CommandExecutor commands;
+
+    std::atomic<bool> quitRequested{false};
+    std::atomic<bool> bypassed{false};
+
+    // reported by the ui thread, which gets the power notifications
+    std::atomic<bool> onBattery{false};
+    std::atomic<bool> displayOff{false};
+    std::atomic<bool> sessionLocked{false};
+
+    // how often the engine thread wakes up
+    WakeupCounter wakeups;
+
+    // wakeups, time and cpu time of the whole process spent in each power
+    // profile. the time up to a wakeup counts towards the profile the wait
+    // was made under.
+    struct PowerUsage {
+        Counter *wakeups;
+        Counter *wallUS;
+        Counter *cpuUS;
+    };
+    PowerUsage powerUsage[POWER_PROFILE_COUNT];
+    PowerProfile powerProfile = PowerProfile::Normal;
+    double powerUsageStartMS = -1.0;
+    std::uint64_t powerUsageStartCPUUS = 0;
+
+    // add the time since the last wakeup to the profile waited under
+    void recordPowerUsage();
 
     // string conversion functions
     std::string wStringToString(const std::wstring &wstr);
@@ -143,78 +148,37 @@ class Engine {
     // create a default ini settings file if one is not found
     void tryCreateDefaultSettingsINI();
 
+    // the text of the settings ini, and writing it back
+    std::wstring readSettingsText();
+    void writeSettingsText(const std::wstring &text);
+
     std::wstring getAbsoluteExecutablePath();
     std::wstring getSettingsINIPath();
+    std::wstring getMetricsPath();
 
-    // get the max peak audio level while ignoring any executables with names in
-    // the excludedExecutables vector
-    float
-    getMaxPeakAudioLevel(const std::vector<std::wstring> &excludedExecutables);
+    // the path given with --record on the command line, relative to the
+    // executable unless absolute, or empty if not recording
+    std::wstring getTracePathArgument();
+
+    // write the metrics as json next to the executable. failing to write them
+    // is not fatal.
+    void exportMetrics();
 
     // initialise COM objects, etc...
     bool init();
 
-    // returns all audio sessions at the current point as reported by the
-    // session manager
-    std::vector<std::shared_ptr<AudioSession>> getAudioSessions();
-
-    // find an audio session instance with the given executable name in the
-    // format of "abc.exe"
-    std::shared_ptr<AudioSession>
-    getAudioSessionByExecutableName(const std::wstring &executableName);
-
-    // run a windows command (i.e., "cmd.exe /c ...") silently in the
-    // background.
-    void runCommandSilent(std::wstring &command);
-
-    // ### INI TEMPLATE FUNCTIONS ###
-    // a series of template functions to read a value from the ini and convert
-    // it to the appropriate type and store it in the given variable
-
-    // read a value from the ini as a string
-    std::wstring readINIValueStringW(const std::wstring &section,
-                                     const std::wstring &key);
-
-    // generic
-    template <typename T>
-    inline void readINIValue(const std::wstring &section,
-                             const std::wstring &key, T &value) {
-        value = readINIValueStringW(section, key);
-    }
-
-    // int
-    template <>
-    inline void readINIValue(const std::wstring &section,
-                             const std::wstring &key, int &value) {
-        value = std::stoi(readINIValueStringW(section, key));
-    }
-
-    // float
-    template <>
-    inline void readINIValue(const std::wstring &section,
-                             const std::wstring &key, float &value) {
-        value = std::stof(readINIValueStringW(section, key));
-    }
-
-    // list of values separated by '/'s
-    template <>
-    inline void readINIValue(const std::wstring &section,
-                             const std::wstring &key,
-                             std::vector<std::wstring> &value) {
-        value.clear();
-        auto str = readINIValueStringW(section, key);
-
-        size_t start = 0;
-        size_t end = str.find(L"/");
-
-        while (end != std::wstring::npos) {
-            value.push_back(str.substr(start, end - start));
-            start = end + 1;
-            end = str.find(L"/", start);
-        }
-
-        value.push_back(str.substr(start));
-    }
+    // read the settings ini and publish a new snapshot of the param
+    // variables, adding any settings missing from it. returns if read all
+    // successfully. called from the engine thread before it starts ticking,
+    // then only from the settings watcher thread. only failing the first read
+    // is an error, a failed reload keeps the last snapshot.
+    bool readSettingsINI();
+
+    // run a windows command (i.e., "cmd.exe /c ...") silently and wait for it
+    // to exit, killing it and anything it started after timeoutMS. only called
+    // from the command executor's worker thread.
+    CommandResult runCommandSilent(const std::wstring &command,
+                                   double timeoutMS);
 
   public:
     Engine();
@@ -228,21 +192,49 @@ class Engine {
     bool running();
 
     bool hasError() const;
-    std::wstring &getErrorString();
-    std::wstring &getShortStatusString();
+    std::wstring getErrorString();
+    std::wstring getShortStatusString();
 
     // open the settings ini with the default windows application for opening
     // .ini files (usually notepad). returns if successfully opened
     bool openSettingsINI();
 
-    // read the settings ini and updates param variables. returns if read all
-    // successfully. this function can also be used to reload the ini during
-    // execution.
-    bool readSettingsINI();
+    // tell the engine to reload the settings ini. edits to the ini are also
+    // picked up by themselves.
+    void requestReloadSettings();
 
     // tell the engine to quit on the next tick. (running() will return)
     void requestQuit();
 
     void setBypassed(bool newBypassed);
     bool getBypassed() const;
+
+    // the power state the tick rates are scaled for, see PowerState
+    void setOnBattery(bool newOnBattery);
+    void setDisplayOff(bool newDisplayOff);
+    void setSessionLocked(bool newSessionLocked);
+    PowerState getPowerState() const;
+
+    // how many times the engine thread woke up per minute, measured over the
+    // last minute or so
+    double getWakeupsPerMinute() const;
+
+    // number of render endpoints being watched, and how long the last device
+    // change took to be handled in ms (-1 if no device has changed yet)
+    size_t getEndpointCount() const;
+    double getRebindLatencyMS() const;
+
+    // short summary of the tick timings and ducks for the tray menu
+    std::wstring getMetricsSummary() const;
+
+    // p99 latency of each pipeline stage for the tray menu
+    std::wstring getPipelineSummary() const;
+
+    // volumes set per duck or unduck, how many were held back and how many
+    // volume notifications went out, for the tray menu
+    std::wstring getVolumeWriteSummary() const;
+
+    // wakeups and cpu seconds per hour in each power profile used so far,
+    // for the tray menu
+    std::wstring getPowerSummary() const;
 };
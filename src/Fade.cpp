@@ -0,0 +1,92 @@
+#include "Fade.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cwctype>
+#include <stdexcept>
+
+static const float HALF_PI = 1.57079632679f;
+
+FadeCurve parseFadeCurve(const std::wstring &name) {
+    std::wstring lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(),
+                   [](wchar_t c) { return (wchar_t)std::towlower(c); });
+
+    if (lower == L"linear")
+        return FadeCurve::Linear;
+    if (lower == L"decibel")
+        return FadeCurve::Decibel;
+    if (lower == L"scurve")
+        return FadeCurve::SCurve;
+    if (lower == L"equalpower")
+        return FadeCurve::EqualPower;
+    throw std::runtime_error("Unknown fade curve");
+}
+
+static float toDecibels(float volume) {
+    if (volume <= 0.0f)
+        return FADE_DECIBEL_FLOOR;
+    return (std::max)(20.0f * std::log10(volume), FADE_DECIBEL_FLOOR);
+}
+
+static float fromDecibels(float decibels) {
+    if (decibels <= FADE_DECIBEL_FLOOR)
+        return 0.0f;
+    return std::pow(10.0f, decibels / 20.0f);
+}
+
+void Fade::start(float from, float to, double nowMS, double durationMS,
+                 FadeCurve curve) {
+    this->from = from;
+    this->to = to;
+    this->startMS = nowMS;
+    this->durationMS = durationMS;
+    this->curve = curve;
+    active = true;
+}
+
+void Fade::stop() { active = false; }
+
+float Fade::volumeAt(double nowMS) const {
+    double elapsedMS = nowMS - startMS;
+    if (!active || elapsedMS >= durationMS)
+        return to;
+    if (elapsedMS <= 0.0)
+        return from;
+
+    float progress = (float)(elapsedMS / durationMS);
+
+    switch (curve) {
+    case FadeCurve::Decibel: {
+        float decibels = toDecibels(from) +
+                         (toDecibels(to) - toDecibels(from)) * progress;
+        return fromDecibels(decibels);
+    }
+
+    case FadeCurve::SCurve:
+        progress = progress * progress * (3.0f - 2.0f * progress);
+        break;
+
+    case FadeCurve::EqualPower:
+        // rising fades follow a sine quarter and falling ones a cosine
+        // quarter, the gain curves of an equal-power crossfade
+        progress = (to > from) ? std::sin(progress * HALF_PI)
+                               : 1.0f - std::cos(progress * HALF_PI);
+        break;
+
+    case FadeCurve::Linear:
+        break;
+    }
+
+    return from + (to - from) * progress;
+}
+
+double Fade::remainingMS(double nowMS) const {
+    if (!active)
+        return 0.0;
+    return (std::max)(startMS + durationMS - nowMS, 0.0);
+}
+
+bool Fade::isActive() const { return active; }
+
+float Fade::getTarget() const { return to; }
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+// shape of a fade between two volumes
+enum class FadeCurve {
+    Linear,     // constant change in volume
+    Decibel,    // constant change in loudness, sounds even to the ear
+    SCurve,     // eases in and out of the fade (smoothstep)
+    EqualPower, // quarter sine/cosine, as used for crossfades
+};
+
+// parse a fade curve from its ini name ("linear", "decibel", "scurve" or
+// "equalpower", case-insensitive). throws std::runtime_error if unknown.
+FadeCurve parseFadeCurve(const std::wstring &name);
+
+// volumes at or below this level are treated as silence by decibel fades
+static const float FADE_DECIBEL_FLOOR = -60.0f;
+
+// fade interpolates a volume from one level to another over a fixed duration.
+// the volume is computed from the time actually elapsed since the fade
+// started, so late or irregular ticks do not change how long the fade takes.
+class Fade {
+  private:
+    float from = 0.0f;
+    float to = 0.0f;
+    double startMS = 0.0;
+    double durationMS = 0.0;
+    FadeCurve curve = FadeCurve::Linear;
+    bool active = false;
+
+  public:
+    void start(float from, float to, double nowMS, double durationMS,
+               FadeCurve curve);
+    void stop();
+
+    // volume at the given time. exactly the start volume at the start and
+    // exactly the target volume once the duration has elapsed.
+    float volumeAt(double nowMS) const;
+
+    // time left until the target volume is reached, 0 once it has been
+    double remainingMS(double nowMS) const;
+
+    bool isActive() const;
+    float getTarget() const;
+};
@@ -0,0 +1,75 @@
+#include "GainComputer.h"
+
+#include <algorithm>
+#include <cmath>
+
+constexpr float GainComputer::LEVEL_FLOOR;
+
+// knees narrower than this are hard, and keep the knee term finite
+static const float HARD_KNEE_DB = 0.001f;
+
+void GainComputer::setCurves(const std::vector<GainCurve> &curves,
+                             size_t newWindowLength) {
+    slots = curves.size();
+    windowLength = (std::max)(newWindowLength, (size_t)1);
+    ringPosition = 0;
+
+    thresholds.resize(slots);
+    halfKnees.resize(slots);
+    knees.resize(slots);
+    inverseDoubleKnees.resize(slots);
+    slopes.resize(slots);
+    floors.resize(slots);
+    for (size_t slot = 0; slot < slots; slot++) {
+        const GainCurve &curve = curves[slot];
+        float knee = (std::max)(curve.kneeDB, HARD_KNEE_DB);
+        thresholds[slot] = curve.thresholdDB;
+        halfKnees[slot] = knee * 0.5f;
+        knees[slot] = knee;
+        inverseDoubleKnees[slot] = 0.5f / knee;
+        slopes[slot] = 1.0f / (std::max)(curve.ratio, 1.0f) - 1.0f;
+        floors[slot] = -(std::max)(curve.rangeDB, 0.0f);
+    }
+
+    ring.assign(windowLength * slots, 0.0f);
+    held.assign(slots, 0.0f);
+}
+
+size_t GainComputer::size() const { return slots; }
+
+size_t GainComputer::getWindowLength() const { return windowLength; }
+
+void GainComputer::computeGainDB(const float *levels, float *gainsDB) const {
+    // with over the level above the bottom of the knee, the reduction is
+    // over^2 / 2knee inside the knee and over - knee/2 above it. both are the
+    // knee term of over clamped to the knee, plus whatever is beyond the knee.
+    for (size_t slot = 0; slot < slots; slot++) {
+        float levelDB =
+            20.0f * std::log10((std::max)(levels[slot], LEVEL_FLOOR));
+        float over =
+            (std::max)(levelDB - thresholds[slot] + halfKnees[slot], 0.0f);
+        float inKnee = (std::min)(over, knees[slot]);
+        float reduction =
+            inKnee * inKnee * inverseDoubleKnees[slot] + (over - inKnee);
+        gainsDB[slot] = (std::max)(slopes[slot] * reduction, floors[slot]);
+    }
+}
+
+void GainComputer::sample(const float *levels) {
+    computeGainDB(levels, ring.data() + ringPosition * slots);
+    ringPosition = (ringPosition + 1) % windowLength;
+
+    std::fill(held.begin(), held.end(), 0.0f);
+    for (size_t row = 0; row < windowLength; row++) {
+        const float *gains = ring.data() + row * slots;
+        for (size_t slot = 0; slot < slots; slot++)
+            held[slot] = (std::min)(held[slot], gains[slot]);
+    }
+}
+
+void GainComputer::reset() {
+    std::fill(ring.begin(), ring.end(), 0.0f);
+    std::fill(held.begin(), held.end(), 0.0f);
+}
+
+float GainComputer::getGainDB(size_t slot) const { return held[slot]; }
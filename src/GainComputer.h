@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// the static curve of a compressor, from the level of the audio that triggers
+// a duck to how deep the duck is
+struct GainCurve {
+    // levels up to the threshold (less half the knee) are not ducked at all
+    float thresholdDB = -30.0f;
+
+    // above the threshold, every ratio dB of level only lets 1 dB through, so
+    // the duck deepens by 1 - 1/ratio dB for every dB louder
+    float ratio = 4.0f;
+
+    // width of the soft knee around the threshold, over which the ratio eases
+    // in. 0 is a hard knee.
+    float kneeDB = 6.0f;
+
+    // the deepest the duck goes. 0 turns the curve off.
+    float rangeDB = 0.0f;
+};
+
+// gaincomputer works out how deep to duck each of a number of slots (one per
+// target) from the level of the audio that triggers them, like the gain
+// computer of a compressor: a quiet sound ducks a little, a loud one up to the
+// full range.
+// the gains are held over a look-back window: each slot reports the deepest
+// gain of its last windowLength samples, so the duck deepens straight away but
+// only comes back up once the louder audio has been gone for the whole
+// window, and does not flutter with the level.
+// curves are stored per slot in flat arrays and computed with a branch-free
+// loop over every slot, as is the look-back.
+class GainComputer {
+  public:
+    // levels below this (-120dB) are taken as this
+    static constexpr float LEVEL_FLOOR = 0.000001f;
+
+  private:
+    size_t slots = 0;
+    size_t windowLength = 1;
+    size_t ringPosition = 0;
+
+    // the curve of each slot, prepared for computeGainDB()
+    std::vector<float> thresholds;
+    std::vector<float> halfKnees;
+    std::vector<float> knees;
+    std::vector<float> inverseDoubleKnees;
+    std::vector<float> slopes;
+    std::vector<float> floors;
+
+    // windowLength rows of one gain per slot, oldest overwritten first
+    std::vector<float> ring;
+    std::vector<float> held;
+
+  public:
+    // one slot per curve, with no history. allocates, so only call when the
+    // curves or the window length have changed.
+    void setCurves(const std::vector<GainCurve> &curves,
+                   size_t newWindowLength);
+
+    size_t size() const;
+    size_t getWindowLength() const;
+
+    // the kernel: write the gain of each slot in dB (0 or below) for the
+    // given linear levels, one per slot. does not touch the look-back.
+    void computeGainDB(const float *levels, float *gainsDB) const;
+
+    // compute the gains for the given levels, one per slot, into the window,
+    // and update the deepest gain of each slot over the window
+    void sample(const float *levels);
+
+    // forget the window, e.g. when nothing is playing
+    void reset();
+
+    // the deepest gain of the slot over the window, in dB (0 or below)
+    float getGainDB(size_t slot) const;
+};
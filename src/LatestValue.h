@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// latestvalue hands values from a single writer thread to a single reader
+// thread with latest-value-wins semantics: a bounded queue of one, where a
+// value published before the reader took the previous one replaces it. it is
+// a triple buffer, so neither side ever waits for the other, takes a lock or
+// allocates. the writer fills back() in place and publishes it, the reader
+// takes the newest value with consume() and reads it through front().
+// slots are reused, so the writer must overwrite everything it publishes, but
+// can keep the capacity of containers in them across values.
+template <typename T> class LatestValue {
+  private:
+    static const std::uint8_t INDEX_MASK = 3;
+    static const std::uint8_t FRESH = 4; // middle holds an unread value
+
+    T slots[3];
+
+    // the slot between the two sides, and whether it is fresh
+    std::atomic<std::uint8_t> middle{1};
+
+    std::uint8_t backIndex = 0;  // only touched by the writer
+    std::uint8_t frontIndex = 2; // only touched by the reader
+
+  public:
+    // the writer's slot, to fill before publish()
+    T &back() { return slots[backIndex]; }
+
+    // hand back() to the reader, replacing any value it has not taken yet
+    void publish() {
+        backIndex = middle.exchange(backIndex | FRESH,
+                                    std::memory_order_acq_rel) &
+                    INDEX_MASK;
+    }
+
+    // take the newest published value into front(). returns false, keeping
+    // front() as it was, if nothing was published since the last call.
+    bool consume() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        frontIndex =
+            middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // the value last taken by consume(), or a default constructed one
+    const T &front() const { return slots[frontIndex]; }
+};
+
+template <typename T> const std::uint8_t LatestValue<T>::INDEX_MASK;
+template <typename T> const std::uint8_t LatestValue<T>::FRESH;
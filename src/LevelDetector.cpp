@@ -0,0 +1,119 @@
+#include "LevelDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+const size_t LevelDetector::MAX_CHANNELS;
+constexpr float LevelDetector::SILENCE;
+
+// one-pole smoothing coefficient for a time constant and a time step
+static float smoothingCoefficient(double stepMS, float timeMS) {
+    if (timeMS <= 0.0f)
+        return 1.0f;
+    return 1.0f - (float)std::exp(-stepMS / timeMS);
+}
+
+void LevelDetector::setSessions(const std::vector<SessionKey> &newKeys,
+                                size_t newWindowLength) {
+    newWindowLength = (std::max)(newWindowLength, (size_t)1);
+
+    // history can only be kept if the window length is the same
+    previousSlots.clear();
+    if (newWindowLength == windowLength) {
+        for (size_t slot = 0; slot < slots; slot++)
+            previousSlots[keys[slot]] = slot;
+    }
+    previousRing.swap(ring);
+    previousEnvelopes.swap(envelopes);
+    size_t previousCount = slots;
+
+    slots = newKeys.size();
+    windowLength = newWindowLength;
+    keys = newKeys;
+
+    channelPeaks.assign(slots * MAX_CHANNELS, 0.0f);
+    channelCounts.assign(slots, 1.0f);
+    ring.assign(windowLength * slots, 0.0f);
+    windowSums.assign(slots, 0.0f);
+    envelopes.assign(slots, 0.0f);
+
+    for (size_t slot = 0; slot < slots; slot++) {
+        auto it = previousSlots.find(keys[slot]);
+        if (it == previousSlots.end())
+            continue;
+
+        size_t previous = it->second;
+        for (size_t row = 0; row < windowLength; row++)
+            ring[row * slots + slot] =
+                previousRing[row * previousCount + previous];
+        envelopes[slot] = previousEnvelopes[previous];
+    }
+}
+
+size_t LevelDetector::size() const { return slots; }
+
+size_t LevelDetector::getWindowLength() const { return windowLength; }
+
+void LevelDetector::setChannelPeaks(size_t slot, const float *peaks,
+                                    size_t count) {
+    count = (std::min)(count, MAX_CHANNELS);
+    std::copy(peaks, peaks + count, channelPeaks.begin() + slot * MAX_CHANNELS);
+    channelCounts[slot] = (float)(std::max)(count, (size_t)1);
+}
+
+void LevelDetector::sample(double nowMS, double intervalMS, float attackMS,
+                           float releaseMS) {
+    double stepMS = (lastSampleMS < 0.0) ? intervalMS : nowMS - lastSampleMS;
+    lastSampleMS = nowMS;
+    silent = false;
+
+    float attack = smoothingCoefficient(stepMS, attackMS);
+    float release = smoothingCoefficient(stepMS, releaseMS);
+
+    // mean square of the channel peaks into the oldest row of the ring.
+    // unused channels are zero, so every slot sums all MAX_CHANNELS.
+    float *row = ring.data() + ringPosition * slots;
+    const float *peaks = channelPeaks.data();
+    for (size_t slot = 0; slot < slots; slot++) {
+        float sum = 0.0f;
+        for (size_t channel = 0; channel < MAX_CHANNELS; channel++) {
+            float peak = peaks[slot * MAX_CHANNELS + channel];
+            sum += peak * peak;
+        }
+        row[slot] = sum / channelCounts[slot];
+    }
+    ringPosition = (ringPosition + 1) % windowLength;
+
+    // sum the whole window rather than keeping a running sum, which would
+    // drift and never return to exactly zero
+    std::fill(windowSums.begin(), windowSums.end(), 0.0f);
+    for (size_t r = 0; r < windowLength; r++) {
+        const float *window = ring.data() + r * slots;
+        for (size_t slot = 0; slot < slots; slot++)
+            windowSums[slot] += window[slot];
+    }
+
+    float inverseLength = 1.0f / (float)windowLength;
+    for (size_t slot = 0; slot < slots; slot++) {
+        float rms = std::sqrt(windowSums[slot] * inverseLength);
+        float envelope = envelopes[slot];
+        float coefficient = (rms > envelope) ? attack : release;
+        envelope += coefficient * (rms - envelope);
+        envelopes[slot] = (envelope < SILENCE) ? 0.0f : envelope;
+    }
+
+    std::fill(channelPeaks.begin(), channelPeaks.end(), 0.0f);
+}
+
+void LevelDetector::reset() {
+    if (silent)
+        return;
+
+    silent = true;
+    lastSampleMS = -1.0;
+    std::fill(ring.begin(), ring.end(), 0.0f);
+    std::fill(envelopes.begin(), envelopes.end(), 0.0f);
+    std::fill(channelPeaks.begin(), channelPeaks.end(), 0.0f);
+}
+
+float LevelDetector::getLevel(size_t slot) const { return envelopes[slot]; }
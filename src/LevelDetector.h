@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "SessionRegistry.h"
+
+// leveldetector turns the channel peak levels sampled from each session into a
+// smoothed level that the duck is triggered on. each sample is the mean square
+// of the channel peaks, the level is the rms over a sliding window of samples
+// followed by an envelope follower with separate attack and release times.
+// a short click only moves the level a little, while steady speech reaches
+// its full level within the attack time.
+// sessions are kept in slots matching the frame indices. all per-slot state is
+// stored in flat arrays and updated with branch-free loops over every slot, so
+// sampling many sessions stays cheap and vectorises well.
+class LevelDetector {
+  public:
+    // channels beyond this are ignored (7.1 is the most windows reports)
+    static const size_t MAX_CHANNELS = 8;
+
+    // levels below this (-60dB) are treated as silence
+    static constexpr float SILENCE = 0.001f;
+
+  private:
+    size_t slots = 0;
+    size_t windowLength = 0;
+    size_t ringPosition = 0;
+    double lastSampleMS = -1.0;
+    bool silent = true;
+
+    std::vector<SessionKey> keys;
+
+    // channel peaks written for the next sample, MAX_CHANNELS per slot
+    std::vector<float> channelPeaks;
+    std::vector<float> channelCounts;
+
+    // windowLength rows of one mean square per slot, oldest overwritten first
+    std::vector<float> ring;
+    std::vector<float> windowSums;
+    std::vector<float> envelopes;
+
+    // reused when slots are reassigned
+    std::unordered_map<SessionKey, size_t> previousSlots;
+    std::vector<float> previousRing;
+    std::vector<float> previousEnvelopes;
+
+  public:
+    // assign slots to the given sessions, in order, keeping the state of any
+    // session that already had a slot. allocates, so only call when the
+    // sessions or the window length have changed.
+    void setSessions(const std::vector<SessionKey> &newKeys,
+                     size_t newWindowLength);
+
+    size_t size() const;
+    size_t getWindowLength() const;
+
+    // write up to MAX_CHANNELS channel peaks of a slot for the next sample.
+    // slots that are not written to before sample() are sampled as silent.
+    void setChannelPeaks(size_t slot, const float *peaks, size_t count);
+
+    // take one sample of every slot and update their levels. intervalMS is
+    // the time the first sample after a reset stands for.
+    void sample(double nowMS, double intervalMS, float attackMS,
+                float releaseMS);
+
+    // drop all levels back to silence, e.g. when nothing is playing
+    void reset();
+
+    float getLevel(size_t slot) const;
+};
@@ -0,0 +1,268 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+#ifdef _WIN32
+#include <share.h>
+#endif
+
+const size_t Logger::CAPACITY;
+const size_t Logger::MAX_FIELDS;
+const size_t Logger::TEXT_LENGTH;
+
+static const char *const LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+#ifdef _WIN32
+// shared, so the log can be read while the program is running
+static std::FILE *openFile(const std::wstring &path, bool append) {
+    return _wfsopen(path.c_str(), append ? L"ab" : L"wb", _SH_DENYNO);
+}
+
+static void replaceFile(const std::wstring &from, const std::wstring &to) {
+    _wremove(to.c_str());
+    _wrename(from.c_str(), to.c_str());
+}
+#else
+// paths are only ascii off windows, where the logger is only used by tools
+static std::string toNarrowPath(const std::wstring &path) {
+    return std::string(path.begin(), path.end());
+}
+
+static std::FILE *openFile(const std::wstring &path, bool append) {
+    return std::fopen(toNarrowPath(path).c_str(), append ? "ab" : "wb");
+}
+
+static void replaceFile(const std::wstring &from, const std::wstring &to) {
+    std::rename(toNarrowPath(from).c_str(), toNarrowPath(to).c_str());
+}
+#endif
+
+// a small number for the calling thread, easier to read than native ids
+static unsigned getThreadNumber() {
+    static std::atomic<unsigned> next{1};
+    thread_local unsigned number = next.fetch_add(1);
+    return number;
+}
+
+Logger::Logger() {
+    for (size_t i = 0; i < CAPACITY; i++)
+        records[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+Logger::~Logger() { stop(); }
+
+Logger &Logger::get() {
+    static Logger *logger = new Logger();
+    return *logger;
+}
+
+void Logger::log(LogLevel level, const char *message,
+                 std::initializer_list<LogField> fields, const char *text) {
+    std::uint64_t position = writePosition.load(std::memory_order_relaxed);
+    Record *record;
+    while (true) {
+        record = &records[position % CAPACITY];
+        std::uint64_t sequence =
+            record->sequence.load(std::memory_order_acquire);
+        auto difference = (std::int64_t)(sequence - position);
+
+        if (difference == 0) {
+            // the slot is free, claim it
+            if (writePosition.compare_exchange_weak(
+                    position, position + 1, std::memory_order_relaxed))
+                break;
+        } else if (difference < 0) {
+            // the slot still holds a record a lap behind, the ring is full
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = writePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    record->timeUS = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::system_clock::now().time_since_epoch())
+                         .count();
+    record->level = level;
+    record->thread = getThreadNumber();
+    record->message = message;
+    record->fieldCount = (std::min)(fields.size(), MAX_FIELDS);
+    std::copy(fields.begin(), fields.begin() + record->fieldCount,
+              record->fields);
+    size_t textLength = 0;
+    for (; text && text[textLength] && textLength < TEXT_LENGTH - 1;
+         textLength++)
+        record->text[textLength] = text[textLength];
+    record->text[textLength] = '\0';
+
+    record->sequence.store(position + 1, std::memory_order_release);
+
+    // pairs with the fence in run(): either the drainer sees this record
+    // before it sleeps, or this sees it sleeping and wakes it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (drainerSleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+}
+
+std::uint64_t Logger::getDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::start(const std::wstring &path, size_t maxFileBytes,
+                   unsigned backups, bool echo) {
+    if (drainer.joinable())
+        return;
+
+    this->path = path;
+    this->maxFileBytes = maxFileBytes;
+    this->backups = backups;
+    this->echo = echo;
+
+    file = openFile(path, true);
+    fileBytes = 0;
+    if (file && std::fseek(file, 0, SEEK_END) == 0) {
+        long size = std::ftell(file);
+        fileBytes = (size > 0) ? (size_t)size : 0;
+    }
+
+    stopping = false;
+    drainer = std::thread(&Logger::run, this);
+}
+
+void Logger::stop() {
+    if (!drainer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    drainer.join();
+
+    if (file) {
+        std::fclose(file);
+        file = nullptr;
+    }
+}
+
+bool Logger::hasPending() const {
+    auto &record = records[readPosition % CAPACITY];
+    return record.sequence.load(std::memory_order_acquire) == readPosition + 1;
+}
+
+void Logger::run() {
+    while (true) {
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        drainerSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wake.wait(lock, [this] { return stopping || hasPending(); });
+        drainerSleeping.store(false, std::memory_order_relaxed);
+
+        if (stopping) {
+            lock.unlock();
+            drain();
+            return;
+        }
+    }
+}
+
+bool Logger::drain() {
+    bool any = false;
+    while (hasPending()) {
+        auto &record = records[readPosition % CAPACITY];
+        write(record);
+        record.sequence.store(readPosition + CAPACITY,
+                              std::memory_order_release);
+        readPosition++;
+        any = true;
+    }
+
+    std::uint64_t droppedNow = getDropped();
+    if (droppedNow != droppedReported) {
+        char line[64];
+        int length = std::snprintf(line, sizeof(line),
+                                   "%llu log records dropped\n",
+                                   (unsigned long long)(droppedNow -
+                                                        droppedReported));
+        writeLine(line, (size_t)length);
+        droppedReported = droppedNow;
+        any = true;
+    }
+
+    if (any) {
+        if (file)
+            std::fflush(file);
+        if (echo)
+            std::fflush(stdout);
+    }
+    return any;
+}
+
+void Logger::write(const Record &record) {
+    std::time_t seconds = (std::time_t)(record.timeUS / 1000000);
+    std::tm local;
+#ifdef _WIN32
+    localtime_s(&local, &seconds);
+#else
+    localtime_r(&seconds, &local);
+#endif
+
+    char line[512];
+    size_t length = std::strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S",
+                                  &local);
+
+    // snprintf returns the length it wanted, so keep within the buffer
+    auto append = [&](int written) {
+        if (written > 0)
+            length = (std::min)(length + (size_t)written, sizeof(line) - 1);
+    };
+    append(std::snprintf(line + length, sizeof(line) - length,
+                         ".%03d %-5s [%u] %s",
+                         (int)(record.timeUS / 1000 % 1000),
+                         LEVEL_NAMES[(int)record.level], record.thread,
+                         record.message));
+    for (size_t i = 0; i < record.fieldCount; i++) {
+        append(std::snprintf(line + length, sizeof(line) - length, " %s=%g",
+                             record.fields[i].key, record.fields[i].value));
+    }
+    if (record.text[0] != '\0') {
+        append(std::snprintf(line + length, sizeof(line) - length, ": %s",
+                             record.text));
+    }
+    append(std::snprintf(line + length, sizeof(line) - length, "\n"));
+
+    writeLine(line, length);
+}
+
+void Logger::writeLine(const char *line, size_t length) {
+    if (echo)
+        std::fwrite(line, 1, length, stdout);
+    if (!file)
+        return;
+
+    if (maxFileBytes > 0 && fileBytes + length > maxFileBytes)
+        rotate();
+    if (file) {
+        std::fwrite(line, 1, length, file);
+        fileBytes += length;
+    }
+}
+
+void Logger::rotate() {
+    std::fclose(file);
+
+    for (unsigned i = backups; i > 0; i--) {
+        auto from = (i == 1) ? path : path + L"." + std::to_wstring(i - 1);
+        replaceFile(from, path + L"." + std::to_wstring(i));
+    }
+
+    file = openFile(path, false);
+    fileBytes = 0;
+}
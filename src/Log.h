@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+enum class LogLevel { Debug, Info, Warning, Error };
+
+// levels below LOG_MIN_LEVEL (0 debug, 1 info, 2 warning, 3 error) are
+// compiled out, arguments and all. debug is only kept in debug builds.
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL 1
+#else
+#define LOG_MIN_LEVEL 0
+#endif
+#endif
+
+// a named number attached to a log record. keys must be string literals.
+struct LogField {
+    const char *key;
+    double value;
+};
+
+// logger writes structured log records (a message, a few numeric fields and
+// an optional short text) to a size-rotated log file. logging only copies the
+// record into a fixed lock-free ring buffer, which any number of threads can
+// write to at once. formatting and writing happen on a background drainer
+// thread, so logging never blocks, allocates or touches the file.
+// if the ring is full, records are dropped and counted rather than waited on.
+// records logged before start() are kept until the drainer starts.
+class Logger {
+  public:
+    static const size_t CAPACITY = 1024; // records, a power of two
+    static const size_t MAX_FIELDS = 4;
+    static const size_t TEXT_LENGTH = 128; // longer texts are truncated
+
+  private:
+    struct Record {
+        // ring position this slot is ready to be written at, or + 1 once the
+        // record at that position has been written
+        std::atomic<std::uint64_t> sequence;
+
+        std::int64_t timeUS; // since the unix epoch
+        LogLevel level;
+        unsigned thread;
+        const char *message;
+        size_t fieldCount;
+        LogField fields[MAX_FIELDS];
+        char text[TEXT_LENGTH];
+    };
+
+    Record records[CAPACITY];
+    std::atomic<std::uint64_t> writePosition{0};
+    std::uint64_t readPosition = 0; // only touched by the drainer
+    std::atomic<std::uint64_t> dropped{0};
+    std::uint64_t droppedReported = 0;
+
+    // the drainer sleeps until a record arrives while the ring is empty
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> drainerSleeping{false};
+    bool stopping = false;
+    std::thread drainer;
+
+    std::wstring path;
+    std::FILE *file = nullptr;
+    size_t fileBytes = 0;
+    size_t maxFileBytes = 0;
+    unsigned backups = 0;
+    bool echo = false;
+
+    bool hasPending() const;
+
+    // write every pending record, returns whether there were any
+    bool drain();
+    void write(const Record &record);
+    void writeLine(const char *line, size_t length);
+
+    // move the file to path.1, path.1 to path.2 and so on, then start a new
+    // one
+    void rotate();
+
+    void run();
+
+  public:
+    Logger();
+    ~Logger();
+
+    // the logger of the program. it is never destroyed, so it can be used
+    // from destructors of other statics.
+    static Logger &get();
+
+    // start draining records into the file at path (appending to it), keeping
+    // it under maxFileBytes by rotating it into path.1 to path.<backups>.
+    // records are also echoed to stdout if echo is set.
+    void start(const std::wstring &path, size_t maxFileBytes = 1 << 20,
+               unsigned backups = 2, bool echo = true);
+
+    // write everything logged so far and close the file. later records stay
+    // in the ring until the next start().
+    void stop();
+
+    // can be called from any thread. message must be a string literal, text
+    // is copied. fields past MAX_FIELDS are ignored.
+    void log(LogLevel level, const char *message,
+             std::initializer_list<LogField> fields = {},
+             const char *text = nullptr);
+
+    std::uint64_t getDropped() const;
+};
+
+#define LOG_AT(level, ...) Logger::get().log(level, __VA_ARGS__)
+
+#if LOG_MIN_LEVEL <= 0
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= 1
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= 2
+#define LOG_WARNING(...) LOG_AT(LogLevel::Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
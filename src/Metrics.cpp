@@ -0,0 +1,196 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+const size_t LatencyHistogram::BUCKETS;
+
+// index of the highest set bit, value must not be 0
+static size_t highestBit(std::uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+Counter::Counter(const std::string &name) : name(name) {}
+
+std::uint64_t Counter::get() const {
+    return value.load(std::memory_order_relaxed);
+}
+
+const std::string &Counter::getName() const { return name; }
+
+LatencyHistogram::LatencyHistogram(const std::string &name,
+                                   unsigned sampleEvery)
+    : name(name), sampleEvery(sampleEvery) {}
+
+void LatencyHistogram::record(std::uint64_t durationNS) {
+    size_t bucket = (std::min)(highestBit(durationNS | 1), BUCKETS - 1);
+
+    // the count is the sum of the buckets, so it is not kept separately
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    totalNS.fetch_add(durationNS, std::memory_order_relaxed);
+
+    std::uint64_t previousMax = maxNS.load(std::memory_order_relaxed);
+    while (durationNS > previousMax &&
+           !maxNS.compare_exchange_weak(previousMax, durationNS,
+                                        std::memory_order_relaxed)) {
+    }
+}
+
+unsigned LatencyHistogram::getSampleEvery() const { return sampleEvery; }
+
+std::uint64_t LatencyHistogram::getCount() const {
+    std::uint64_t count = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++)
+        count += getBucketCount(bucket);
+    return count;
+}
+
+std::uint64_t LatencyHistogram::getTotalNS() const {
+    return totalNS.load(std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::getMaxNS() const {
+    return maxNS.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::getMeanNS() const {
+    std::uint64_t n = getCount();
+    return (n > 0) ? (double)getTotalNS() / (double)n : 0.0;
+}
+
+std::uint64_t LatencyHistogram::getQuantileNS(double quantile) const {
+    // the bucket counts may still be changing, so they are read once and the
+    // total is taken from the copies
+    std::uint64_t counts[BUCKETS];
+    std::uint64_t total = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        counts[bucket] = getBucketCount(bucket);
+        total += counts[bucket];
+    }
+    if (total == 0)
+        return 0;
+
+    std::uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+        seen += counts[bucket];
+        if (seen > 0 && (double)seen >= quantile * (double)total)
+            return (std::uint64_t)1 << (bucket + 1);
+    }
+    return (std::uint64_t)1 << BUCKETS;
+}
+
+std::uint64_t LatencyHistogram::getBucketCount(size_t bucket) const {
+    return buckets[bucket].load(std::memory_order_relaxed);
+}
+
+const std::string &LatencyHistogram::getName() const { return name; }
+
+Counter &MetricsRegistry::counter(const std::string &name) {
+    for (auto &existing : counters) {
+        if (existing.getName() == name)
+            return existing;
+    }
+    counters.emplace_back(name);
+    return counters.back();
+}
+
+LatencyHistogram &MetricsRegistry::histogram(const std::string &name,
+                                             unsigned sampleEvery) {
+    for (auto &existing : histograms) {
+        if (existing.getName() == name)
+            return existing;
+    }
+    histograms.emplace_back(name, sampleEvery);
+    return histograms.back();
+}
+
+void MetricsRegistry::calibrate() {
+    const int SECTIONS = 10000;
+
+    LatencyHistogram scratch("calibration");
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < SECTIONS; i++)
+        ScopedTimer timer(scratch);
+    auto duration = std::chrono::steady_clock::now() - start;
+
+    double durationNS =
+        (double)std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+            .count();
+    timerOverheadNS.store(durationNS / SECTIONS, std::memory_order_relaxed);
+}
+
+double MetricsRegistry::getTimerOverheadNS() const {
+    return timerOverheadNS.load(std::memory_order_relaxed);
+}
+
+void MetricsRegistry::addOverheadScope(
+    const LatencyHistogram &outer,
+    std::vector<const LatencyHistogram *> sections) {
+    overheadScopes.push_back({&outer, std::move(sections)});
+}
+
+double
+MetricsRegistry::getOverheadFraction(const LatencyHistogram &outer) const {
+    std::uint64_t outerNS = outer.getTotalNS();
+    if (outerNS == 0)
+        return 0.0;
+
+    std::uint64_t sections = 0;
+    for (auto &scope : overheadScopes) {
+        if (scope.outer != &outer)
+            continue;
+        for (auto section : scope.sections)
+            sections += section->getCount();
+    }
+
+    return (double)sections * getTimerOverheadNS() / (double)outerNS;
+}
+
+void MetricsRegistry::writeJSON(std::ostream &out) const {
+    out << "{\n  \"timerOverheadNS\": " << getTimerOverheadNS() << ",\n";
+
+    out << "  \"overheadFraction\": {";
+    const char *separator = "";
+    for (auto &scope : overheadScopes) {
+        out << separator << "\"" << scope.outer->getName()
+            << "\": " << getOverheadFraction(*scope.outer);
+        separator = ", ";
+    }
+    out << "},\n";
+
+    out << "  \"counters\": {";
+    separator = "\n";
+    for (auto &counter : counters) {
+        out << separator << "    \"" << counter.getName()
+            << "\": " << counter.get();
+        separator = ",\n";
+    }
+    out << "\n  },\n";
+
+    out << "  \"histograms\": {";
+    separator = "\n";
+    for (auto &histogram : histograms) {
+        out << separator << "    \"" << histogram.getName() << "\": {"
+            << "\"sampleEvery\": " << histogram.getSampleEvery()
+            << ", \"count\": " << histogram.getCount()
+            << ", \"meanNS\": " << histogram.getMeanNS()
+            << ", \"p50NS\": " << histogram.getQuantileNS(0.5)
+            << ", \"p99NS\": " << histogram.getQuantileNS(0.99)
+            << ", \"maxNS\": " << histogram.getMaxNS() << ", \"buckets\": [";
+        for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; bucket++)
+            out << (bucket ? ", " : "") << histogram.getBucketCount(bucket);
+        out << "]}";
+        separator = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// counter is a count of events that can be added to from any thread without a
+// lock
+class Counter {
+  private:
+    std::string name;
+    std::atomic<std::uint64_t> value{0};
+
+  public:
+    explicit Counter(const std::string &name);
+
+    void add(std::uint64_t amount = 1) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const;
+    const std::string &getName() const;
+};
+
+// latencyhistogram counts durations into fixed power-of-two buckets, bucket i
+// holding durations from 2^i up to 2^(i+1) ns. recording is lock-free and
+// never allocates, so it can be used on the hot path of any thread. quantiles
+// are only as precise as the buckets, i.e. within a factor of two.
+// sections that run many times per tick can be timed only every sampleEvery
+// times, which keeps the cost of timing them down while the distribution
+// stays the same.
+class LatencyHistogram {
+  public:
+    // the last bucket also holds everything longer, about 2s and up
+    static const size_t BUCKETS = 32;
+
+  private:
+    std::string name;
+    unsigned sampleEvery;
+    std::atomic<unsigned> sampleCounter{0};
+
+    std::atomic<std::uint64_t> buckets[BUCKETS] = {};
+    std::atomic<std::uint64_t> totalNS{0};
+    std::atomic<std::uint64_t> maxNS{0};
+
+  public:
+    explicit LatencyHistogram(const std::string &name,
+                              unsigned sampleEvery = 1);
+
+    // whether the next section should be timed
+    bool shouldSample() {
+        return sampleEvery <= 1 ||
+               sampleCounter.fetch_add(1, std::memory_order_relaxed) %
+                       sampleEvery ==
+                   0;
+    }
+
+    void record(std::uint64_t durationNS);
+
+    unsigned getSampleEvery() const;
+
+    std::uint64_t getCount() const;
+    std::uint64_t getTotalNS() const;
+    std::uint64_t getMaxNS() const;
+    double getMeanNS() const;
+
+    // upper bound of the bucket that holds the given quantile (0.0 to 1.0)
+    std::uint64_t getQuantileNS(double quantile) const;
+
+    std::uint64_t getBucketCount(size_t bucket) const;
+    const std::string &getName() const;
+};
+
+// scopedtimer records the time from its construction to its destruction into a
+// histogram, if the histogram samples this section
+class ScopedTimer {
+  private:
+    LatencyHistogram &histogram;
+    bool sampled;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    explicit ScopedTimer(LatencyHistogram &histogram)
+        : histogram(histogram), sampled(histogram.shouldSample()) {
+        if (sampled)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedTimer() {
+        if (!sampled)
+            return;
+        auto duration = std::chrono::steady_clock::now() - start;
+        histogram.record(
+            (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                duration)
+                .count());
+    }
+};
+
+// metricsregistry owns the named counters and histograms of the program.
+// metrics are registered up front, by whoever records them, and are then
+// updated from any thread without locks. registering is not thread-safe and
+// must be done before any other thread reads the registry.
+// names are plain identifiers like "engine.tick", they are written to json
+// without escaping.
+class MetricsRegistry {
+  private:
+    // deques so references to metrics stay valid as more are registered
+    std::deque<Counter> counters;
+    std::deque<LatencyHistogram> histograms;
+
+    // a histogram and the sections timed inside of it
+    struct OverheadScope {
+        const LatencyHistogram *outer;
+        std::vector<const LatencyHistogram *> sections;
+    };
+    std::vector<OverheadScope> overheadScopes;
+
+    std::atomic<double> timerOverheadNS{0.0};
+
+  public:
+    // find the metric with the given name, or register a new one. the
+    // reference stays valid for the lifetime of the registry.
+    Counter &counter(const std::string &name);
+    LatencyHistogram &histogram(const std::string &name,
+                                unsigned sampleEvery = 1);
+
+    // measure the cost of timing a single section with a ScopedTimer, used to
+    // estimate the overhead of the instrumentation
+    void calibrate();
+    double getTimerOverheadNS() const;
+
+    // report the overhead of timing the given sections against outer, as
+    // they all run inside of it on the same thread. outer is one of the
+    // sections if it is timed itself. registered like a metric, so not
+    // thread-safe either.
+    void addOverheadScope(const LatencyHistogram &outer,
+                          std::vector<const LatencyHistogram *> sections);
+
+    // estimated share of the time recorded in outer that was spent on timing
+    // the sections of its scope, 0 if it has none. sections that were not
+    // sampled are not counted, their cost is a single atomic increment.
+    double getOverheadFraction(const LatencyHistogram &outer) const;
+
+    // write every metric as a single json object, along with the overhead
+    // fraction of every scope
+    void writeJSON(std::ostream &out) const;
+};
@@ -0,0 +1,154 @@
+#include "NameMatcher.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <map>
+#include <stdexcept>
+
+const std::int32_t NameMatcher::NoMatch;
+const size_t NameMatcher::MAX_STATES;
+
+static wchar_t foldCase(wchar_t c) { return (wchar_t)std::towlower(c); }
+
+NameMatcher::NameMatcher() { compile({}); }
+
+std::uint32_t NameMatcher::getClass(wchar_t c) const {
+    c = foldCase(c);
+    if ((unsigned)c < 128)
+        return asciiClasses[c];
+
+    auto found = std::lower_bound(
+        otherClasses.begin(), otherClasses.end(), c,
+        [](const std::pair<wchar_t, std::uint16_t> &entry, wchar_t key) {
+            return entry.first < key;
+        });
+    if (found != otherClasses.end() && found->first == c)
+        return found->second;
+    return 0;
+}
+
+void NameMatcher::compile(const std::vector<std::wstring> &patterns) {
+    // every position in every pattern is a state of a nondeterministic
+    // automaton: the pattern character at it (0 past the end) and the pattern
+    // it belongs to
+    std::vector<wchar_t> positionChars;
+    std::vector<std::int32_t> positionPatterns;
+    std::vector<std::uint32_t> starts;
+
+    std::fill(std::begin(asciiClasses), std::end(asciiClasses), 0);
+    otherClasses.clear();
+    classCount = 1;
+    std::vector<wchar_t> classChars(1, 0); // 0 stands for any other character
+
+    for (size_t p = 0; p < patterns.size(); p++) {
+        if (patterns[p].empty())
+            continue;
+        starts.push_back((std::uint32_t)positionChars.size());
+        for (wchar_t c : patterns[p]) {
+            c = foldCase(c);
+            positionChars.push_back(c);
+            positionPatterns.push_back((std::int32_t)p);
+            if (c == L'*' || c == L'?' || getClass(c) != 0)
+                continue;
+
+            if ((unsigned)c < 128) {
+                asciiClasses[c] = (std::uint16_t)classCount;
+            } else {
+                auto entry = std::make_pair(c, (std::uint16_t)classCount);
+                otherClasses.insert(std::upper_bound(otherClasses.begin(),
+                                                     otherClasses.end(), entry),
+                                    entry);
+            }
+            classChars.push_back(c);
+            classCount++;
+        }
+        positionChars.push_back(0);
+        positionPatterns.push_back((std::int32_t)p);
+    }
+
+    // a * can match nothing, so being at one means also being past it
+    auto close = [&](std::vector<std::uint32_t> &set) {
+        for (size_t i = 0; i < set.size(); i++) {
+            if (positionChars[set[i]] == L'*')
+                set.push_back(set[i] + 1);
+        }
+        std::sort(set.begin(), set.end());
+        set.erase(std::unique(set.begin(), set.end()), set.end());
+    };
+
+    // subset construction: each deterministic state is a set of positions
+    std::map<std::vector<std::uint32_t>, std::uint32_t> stateIds;
+    std::vector<std::vector<std::uint32_t>> states;
+    auto addState = [&](std::vector<std::uint32_t> set) {
+        auto found = stateIds.find(set);
+        if (found != stateIds.end())
+            return found->second;
+        if (states.size() >= MAX_STATES)
+            throw std::runtime_error(
+                "Too many wildcards in the executable name patterns");
+
+        std::uint32_t id = (std::uint32_t)states.size();
+        stateIds.emplace(set, id);
+        states.push_back(std::move(set));
+        return id;
+    };
+
+    addState({}); // dead
+    close(starts);
+    startState = addState(starts);
+
+    transitions.clear();
+    accepts.clear();
+    for (std::uint32_t s = 0; s < states.size(); s++) {
+        std::int32_t accept = NoMatch;
+        for (std::uint32_t position : states[s]) {
+            if (positionChars[position] == 0 &&
+                (accept == NoMatch || positionPatterns[position] < accept))
+                accept = positionPatterns[position];
+        }
+        accepts.push_back(accept);
+
+        for (std::uint32_t c = 0; c < classCount; c++) {
+            std::vector<std::uint32_t> next;
+            for (std::uint32_t position : states[s]) {
+                wchar_t patternChar = positionChars[position];
+                if (patternChar == L'*')
+                    next.push_back(position);
+                else if (patternChar == L'?' ||
+                         (c != 0 && patternChar == classChars[c]))
+                    next.push_back(position + 1);
+            }
+            close(next);
+            // states may grow while this loops, so no reference is held
+            std::uint32_t nextState = addState(std::move(next));
+            transitions.push_back(nextState);
+        }
+    }
+}
+
+std::int32_t NameMatcher::matchExecutable(const wchar_t *begin,
+                                          const wchar_t *end) const {
+    if (begin == end)
+        return NoMatch;
+
+    std::uint32_t state = startState;
+    for (; begin != end; begin++) {
+        state = transitions[state * classCount + getClass(*begin)];
+        if (state == 0)
+            return NoMatch;
+    }
+    return accepts[state];
+}
+
+std::int32_t NameMatcher::match(const std::wstring &name) const {
+    const wchar_t lineageSeparator = NameTable::LINEAGE_SEPARATOR;
+    const wchar_t *begin = name.data();
+    const wchar_t *end = begin + name.size();
+    while (true) {
+        const wchar_t *separator = std::find(begin, end, lineageSeparator);
+        std::int32_t pattern = matchExecutable(begin, separator);
+        if (pattern != NoMatch || separator == end)
+            return pattern;
+        begin = separator + 1;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "NameTable.h"
+
+// namematcher matches executable names against a list of glob patterns, where
+// * stands for any run of characters and ? for any single one, ignoring case.
+// the patterns are compiled together into a single deterministic automaton,
+// so a name is matched in one pass over its characters however many patterns
+// there are. the result is the index of the first pattern the whole name
+// matches.
+// compiling can allocate, matching never does. a compiled matcher can be
+// matched against from several threads at once.
+class NameMatcher {
+  private:
+    // characters that appear in the patterns are each a class of their own,
+    // every other character is class 0
+    std::uint16_t asciiClasses[128] = {};
+    std::vector<std::pair<wchar_t, std::uint16_t>> otherClasses; // sorted
+    std::uint32_t classCount = 1;
+
+    // transitions[state * classCount + class] is the next state. state 0 is
+    // dead: no pattern can match any more.
+    std::vector<std::uint32_t> transitions;
+    std::vector<std::int32_t> accepts; // pattern matched in each state
+    std::uint32_t startState = 0;
+
+    std::uint32_t getClass(wchar_t c) const;
+    std::int32_t matchExecutable(const wchar_t *begin,
+                                 const wchar_t *end) const;
+
+  public:
+    static const std::int32_t NoMatch = -1;
+
+    // the most states the patterns may compile to, which only a great many
+    // wildcards in a great many patterns come near
+    static const size_t MAX_STATES = 4096;
+
+    NameMatcher();
+
+    // replace the patterns. empty patterns never match. throws
+    // std::runtime_error if they compile to more than MAX_STATES.
+    void compile(const std::vector<std::wstring> &patterns);
+
+    // the index of the first pattern that matches all of name, or NoMatch.
+    // the empty (unknown) name never matches. a process lineage (see
+    // NameTable) matches the patterns of its nearest executable that matches
+    // any, so a program also matches the patterns of the programs that
+    // started it.
+    std::int32_t match(const std::wstring &name) const;
+};
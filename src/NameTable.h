@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// small integer standing in for an interned executable name
+using NameId = std::uint32_t;
+
+// nametable interns executable names to small integer ids, so names can be
+// compared and looked up per tick without touching the strings. ids are dense
+// and start at 0, which is always the empty (unknown) name.
+// a name can also be the lineage of a process: its executable name followed by
+// those of its ancestors, nearest first, each after a LINEAGE_SEPARATOR (see
+// ProcessTable).
+// not thread safe, only use from the engine thread.
+class NameTable {
+  private:
+    // deque so references returned by getName() stay valid as names are added
+    std::deque<std::wstring> names;
+    std::unordered_map<std::wstring, NameId> ids;
+
+  public:
+    static const NameId Unknown = 0;
+
+    // cannot be part of an executable name
+    static const wchar_t LINEAGE_SEPARATOR = L'\\';
+
+    NameTable() { intern(L""); }
+
+    // return the id of the name, adding it if not seen before
+    NameId intern(const std::wstring &name) {
+        auto it = ids.find(name);
+        if (it != ids.end())
+            return it->second;
+
+        NameId id = (NameId)names.size();
+        names.push_back(name);
+        ids.emplace(name, id);
+        return id;
+    }
+
+    const std::wstring &getName(NameId id) const { return names[id]; }
+
+    // number of names interned so far, all ids are below this
+    size_t size() const { return names.size(); }
+};
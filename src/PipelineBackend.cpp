@@ -0,0 +1,445 @@
+#include "PipelineBackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+constexpr double PipelineBackend::SAMPLE_GRACE_MS;
+
+// how long the sampler waits between checks while nothing was asked for
+static const double SAMPLER_IDLE_MS = 1000.0;
+
+static std::uint64_t msToNS(double ms) {
+    return (ms > 0.0) ? (std::uint64_t)(ms * 1000000.0) : 0;
+}
+
+PipelineBackend::PipelineBackend(AudioBackend &inner, Clock &samplerClock,
+                                 MetricsRegistry &metrics,
+                                 std::function<void()> threadStart,
+                                 std::function<void()> threadEnd)
+    : inner(inner), samplerClock(samplerClock),
+      threadStart(std::move(threadStart)), threadEnd(std::move(threadEnd)),
+      sampleLatency(metrics.histogram("pipeline.sample")),
+      actuateLatency(metrics.histogram("pipeline.actuate")),
+      sampleAge(metrics.histogram("pipeline.sampleAge")),
+      actuateDelay(metrics.histogram("pipeline.actuateDelay")),
+      volumeWrites(metrics.counter("pipeline.volumeWrites")),
+      volumeWritesStep(metrics.counter("pipeline.volumeWritesHeldStep")),
+      volumeWritesRate(metrics.counter("pipeline.volumeWritesHeldRate")),
+      activityPending(std::make_shared<std::atomic<bool>>(false)) {
+    pending.reserve(16);
+    dueWrites.reserve(16);
+
+    // new audio is sampled straight away
+    auto activity = activityPending;
+    inner.setActivityCallback([activity, &samplerClock] {
+        *activity = true;
+        samplerClock.wake();
+    });
+}
+
+PipelineBackend::~PipelineBackend() { stop(); }
+
+void PipelineBackend::start() {
+    if (sampler.joinable())
+        return;
+    stopping = false;
+    sampler = std::thread(&PipelineBackend::runSampler, this);
+    actuator = std::thread(&PipelineBackend::runActuator, this);
+}
+
+void PipelineBackend::stop() {
+    if (!sampler.joinable())
+        return;
+
+    stopping = true;
+    samplerClock.wake();
+    sampler.join();
+
+    // the actuator applies the last batch before it stops
+    {
+        std::lock_guard<std::mutex> lock(actuatorMutex);
+    }
+    actuatorWake.notify_one();
+    actuator.join();
+}
+
+void PipelineBackend::requestSample(double delayMS, bool precise) {
+    {
+        std::lock_guard<std::mutex> lock(requestMutex);
+        requestPending = true;
+        requestDelayMS = delayMS;
+        requestPrecise = precise;
+    }
+    samplerClock.wake();
+}
+
+void PipelineBackend::setSampleFilter(
+    const std::vector<std::wstring> &excluded,
+    const std::vector<std::wstring> &controlled) {
+    NameMatcher excludedMatcher;
+    NameMatcher controlledMatcher;
+    excludedMatcher.compile(excluded);
+    controlledMatcher.compile(controlled);
+
+    std::lock_guard<std::mutex> lock(filterMutex);
+    excludedNames = std::move(excludedMatcher);
+    controlledNames = std::move(controlledMatcher);
+    filterRevision++;
+}
+
+void PipelineBackend::setWriteFilter(float stepDB, double intervalMS) {
+    writeStepDB = stepDB;
+    writeIntervalMS = intervalMS;
+}
+
+void PipelineBackend::setActivityCallback(std::function<void()> callback) {
+    activityCallback = std::move(callback);
+}
+
+void PipelineBackend::setError(const std::exception &exception) {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!errored)
+        error = exception.what();
+    errored = true;
+}
+
+void PipelineBackend::rethrowError() {
+    if (!errored)
+        return;
+
+    std::lock_guard<std::mutex> lock(errorMutex);
+    errored = false;
+    throw std::runtime_error(error);
+}
+
+std::uint8_t PipelineBackend::getNameFilter(NameId id) {
+    unsigned revision = filterRevision;
+    if (revision != filterRevisionBuilt) {
+        nameFilters.clear();
+        filterRevisionBuilt = revision;
+    }
+
+    // names are checked once each, when first seen
+    if (id >= nameFilters.size()) {
+        auto &names = inner.getNameTable();
+        std::lock_guard<std::mutex> lock(filterMutex);
+        for (NameId next = (NameId)nameFilters.size(); next <= id; next++) {
+            auto &name = names.getName(next);
+            std::uint8_t filter = 0;
+            if (excludedNames.match(name) != NameMatcher::NoMatch)
+                filter |= Excluded;
+            if (controlledNames.match(name) != NameMatcher::NoMatch)
+                filter |= Controlled;
+            nameFilters.push_back(filter);
+        }
+    }
+    return nameFilters[id];
+}
+
+void PipelineBackend::sample() {
+    ScopedTimer timer(sampleLatency);
+    Snapshot &snapshot = samples.back();
+
+    // read before the volumes, so every batch up to this one is in them
+    std::uint64_t applied = appliedSequence;
+    snapshot.appliedSequence = applied;
+
+    bool sessionsChanged = inner.updateSessions();
+    if (sessionsChanged)
+        sessionsVersion++;
+
+    size_t count = inner.getSessionCount();
+    if (sessionsChanged || readVolumes.size() != count ||
+        applied != readVolumesSequence) {
+        readVolumes.assign(count, -1.0f);
+        readVolumeChanges.resize(count);
+        readVolumesSequence = applied;
+    }
+
+    bool listChanged = snapshot.sessionsVersion != sessionsVersion;
+    snapshot.sessionsVersion = sessionsVersion;
+    snapshot.keys.resize(count);
+    snapshot.names.resize(count);
+    snapshot.states.resize(count);
+    snapshot.channels.resize(count);
+    snapshot.peaks.resize(count * LevelDetector::MAX_CHANNELS);
+    snapshot.volumes.resize(count);
+    snapshot.volumeChanges.resize(count);
+
+    auto &names = inner.getNameTable();
+    for (size_t i = 0; i < count; i++) {
+        NameId name = inner.getExecutableNameId(i);
+        if (listChanged) {
+            snapshot.keys[i] = inner.getSessionKey(i);
+            snapshot.names[i] = names.getName(name);
+        }
+
+        SessionState state = inner.getSessionState(i);
+        std::uint8_t filter = getNameFilter(name);
+        snapshot.states[i] = state;
+
+        snapshot.channels[i] = 0;
+        if (state == SessionState::Active && !(filter & Excluded)) {
+            snapshot.channels[i] = (std::uint8_t)inner.getChannelPeakLevels(
+                i, &snapshot.peaks[i * LevelDetector::MAX_CHANNELS],
+                LevelDetector::MAX_CHANNELS);
+        }
+
+        std::uint32_t changes = inner.getVolumeChangeCount(i);
+        if (!(filter & Controlled)) {
+            readVolumes[i] = -1.0f;
+        } else if (readVolumes[i] < 0.0f || readVolumeChanges[i] != changes) {
+            readVolumes[i] = inner.getSessionVolume(i);
+            readVolumeChanges[i] = changes;
+        }
+        snapshot.volumes[i] = readVolumes[i];
+        snapshot.volumeChanges[i] = changes;
+    }
+
+    snapshot.capturePeak = 0.0f;
+    snapshot.capturing = inner.getCapturePeakLevel(snapshot.capturePeak);
+
+    snapshot.sampledMS = samplerClock.nowMS();
+    samples.publish();
+}
+
+void PipelineBackend::runSampler() {
+    if (threadStart)
+        threadStart();
+
+    double dueMS = samplerClock.nowMS();
+    bool precise = false;
+    while (!stopping) {
+        {
+            std::lock_guard<std::mutex> lock(requestMutex);
+            if (requestPending) {
+                dueMS = samplerClock.nowMS() + requestDelayMS;
+                precise = requestPrecise;
+                requestPending = false;
+            }
+        }
+
+        double now = samplerClock.nowMS();
+        bool activity = activityPending->exchange(false);
+        if (!activity && (dueMS < 0.0 || now < dueMS)) {
+            double waitMS = (dueMS < 0.0) ? SAMPLER_IDLE_MS : dueMS - now;
+            if (precise)
+                samplerClock.waitPreciseMS(waitMS);
+            else
+                samplerClock.waitMS(waitMS);
+            continue;
+        }
+
+        dueMS = -1.0;
+        try {
+            sample();
+        } catch (std::exception &exception) {
+            setError(exception);
+        }
+        if (activityCallback)
+            activityCallback();
+    }
+
+    if (threadEnd)
+        threadEnd();
+}
+
+void PipelineBackend::applyWrites() {
+    for (auto &write : dueWrites) {
+        try {
+            inner.setSessionVolumeByKey(write.key, write.volume);
+        } catch (std::exception &exception) {
+            setError(exception);
+        }
+        volumeWrites.add();
+    }
+    dueWrites.clear();
+}
+
+void PipelineBackend::applyBatch() {
+    if (!batches.consume())
+        return;
+
+    const VolumeBatch &batch = batches.front();
+    std::uint64_t applied = appliedSequence;
+    double now = samplerClock.nowMS();
+    {
+        ScopedTimer timer(actuateLatency);
+        for (auto &entry : batch.volumes) {
+            // volumes sent again until confirmed were applied already
+            if (entry.sequence <= applied)
+                continue;
+
+            switch (writeFilter.offer(entry.key, entry.volume, entry.changes,
+                                      now)) {
+            case VolumeWriteDecision::Write:
+                dueWrites.push_back({entry.key, entry.volume});
+                break;
+            case VolumeWriteDecision::HeldStep:
+                volumeWritesStep.add();
+                break;
+            case VolumeWriteDecision::HeldRate:
+                volumeWritesRate.add();
+                break;
+            case VolumeWriteDecision::Unchanged:
+                break;
+            }
+        }
+        applyWrites();
+    }
+    actuateDelay.record(msToNS(samplerClock.nowMS() - batch.flushedMS));
+    appliedSequence = batch.sequence;
+}
+
+void PipelineBackend::runActuator() {
+    if (threadStart)
+        threadStart();
+
+    double nextDueMS = -1.0;
+    while (true) {
+        bool batch;
+        {
+            std::unique_lock<std::mutex> lock(actuatorMutex);
+            auto ready = [this] { return batchReady || stopping; };
+            if (nextDueMS < 0.0) {
+                actuatorWake.wait(lock, ready);
+            } else {
+                double waitMS = nextDueMS - samplerClock.nowMS();
+                actuatorWake.wait_for(
+                    lock, std::chrono::duration<double, std::milli>(
+                              (std::max)(waitMS, 0.0)),
+                    ready);
+            }
+            if (!batchReady && stopping)
+                break;
+            batch = batchReady;
+            batchReady = false;
+        }
+
+        writeFilter.configure(writeStepDB, writeIntervalMS);
+        if (batch)
+            applyBatch();
+
+        // volumes held back by the filter are applied once due
+        nextDueMS = writeFilter.takeDue(samplerClock.nowMS(), dueWrites);
+        applyWrites();
+    }
+
+    // nothing is left held back when stopping
+    writeFilter.takeAll(dueWrites);
+    applyWrites();
+
+    if (threadEnd)
+        threadEnd();
+}
+
+void PipelineBackend::flush() {
+    if (!pendingChanged)
+        return;
+    pendingChanged = false;
+
+    VolumeBatch &batch = batches.back();
+    batch.sequence = nextSequence++;
+    batch.flushedMS = samplerClock.nowMS();
+    batch.volumes.assign(pending.begin(), pending.end());
+    batches.publish();
+
+    {
+        std::lock_guard<std::mutex> lock(actuatorMutex);
+        batchReady = true;
+    }
+    actuatorWake.notify_one();
+}
+
+bool PipelineBackend::updateSessions() {
+    rethrowError();
+    if (!samples.consume())
+        return false;
+
+    const Snapshot &snapshot = samples.front();
+    sampleAge.record(msToNS(samplerClock.nowMS() - snapshot.sampledMS));
+
+    // volumes the actuator has applied are read back from the snapshot
+    std::uint64_t applied = snapshot.appliedSequence;
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [applied](const PendingVolume &entry) {
+                                     return entry.sequence <= applied;
+                                 }),
+                  pending.end());
+
+    if (snapshot.sessionsVersion == adoptedVersion)
+        return false;
+
+    adoptedVersion = snapshot.sessionsVersion;
+    nameIds.resize(snapshot.names.size());
+    for (size_t i = 0; i < snapshot.names.size(); i++)
+        nameIds[i] = names.intern(snapshot.names[i]);
+    return true;
+}
+
+PipelineBackend::PendingVolume *PipelineBackend::findPending(SessionKey key) {
+    for (auto &entry : pending) {
+        if (entry.key == key)
+            return &entry;
+    }
+    return nullptr;
+}
+
+size_t PipelineBackend::getSessionCount() { return nameIds.size(); }
+
+SessionKey PipelineBackend::getSessionKey(size_t index) {
+    return samples.front().keys[index];
+}
+
+SessionState PipelineBackend::getSessionState(size_t index) {
+    return samples.front().states[index];
+}
+
+NameId PipelineBackend::getExecutableNameId(size_t index) {
+    return nameIds[index];
+}
+
+size_t PipelineBackend::getChannelPeakLevels(size_t index, float *levels,
+                                             size_t maxChannels) {
+    const Snapshot &snapshot = samples.front();
+    size_t count = (std::min)((size_t)snapshot.channels[index], maxChannels);
+    auto peaks = snapshot.peaks.begin() + index * LevelDetector::MAX_CHANNELS;
+    std::copy(peaks, peaks + count, levels);
+    return count;
+}
+
+float PipelineBackend::getSessionVolume(size_t index) {
+    const Snapshot &snapshot = samples.front();
+    if (auto entry = findPending(snapshot.keys[index]))
+        return entry->volume;
+
+    // only the volumes of controlled executables are read
+    float volume = snapshot.volumes[index];
+    return (volume >= 0.0f) ? volume : 1.0f;
+}
+
+std::uint32_t PipelineBackend::getVolumeChangeCount(size_t index) {
+    return samples.front().volumeChanges[index];
+}
+
+bool PipelineBackend::getCapturePeakLevel(float &peak) {
+    const Snapshot &snapshot = samples.front();
+    peak = snapshot.capturePeak;
+    return snapshot.capturing;
+}
+
+void PipelineBackend::setSessionVolume(size_t index, float volume) {
+    const Snapshot &snapshot = samples.front();
+    SessionKey key = snapshot.keys[index];
+    std::uint32_t changes = snapshot.volumeChanges[index];
+    if (auto entry = findPending(key)) {
+        entry->volume = volume;
+        entry->changes = changes;
+        entry->sequence = nextSequence;
+    } else {
+        pending.push_back({key, volume, changes, nextSequence});
+    }
+    pendingChanged = true;
+}
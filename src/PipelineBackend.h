@@ -0,0 +1,242 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Clock.h"
+#include "LatestValue.h"
+#include "LevelDetector.h"
+#include "Metrics.h"
+#include "NameMatcher.h"
+#include "VolumeWriteFilter.h"
+
+// pipelinebackend splits the work of a tick over three stages, so a slow call
+// into the audio system in one stage no longer holds up the others:
+// - a sampler thread brings the sessions of another backend up to date and
+//   reads their meters and volumes into a snapshot,
+// - the controller (whoever ticks the duck controller against this backend)
+//   decides on the latest snapshot and writes volume targets,
+// - an actuator thread applies the volume targets to the other backend.
+// the stages are connected by LatestValue mailboxes, so a stage that falls
+// behind only ever sees the newest snapshot or volume targets, and never
+// blocks the stage before it.
+// the sampler samples when the controller asks for it with requestSample(), or
+// straight away on session activity, and calls the activity callback after
+// every snapshot so the controller can tick on it.
+// volumes written by the controller read back as written until a snapshot
+// taken after the actuator applied them comes in. the actuator passes them
+// through a VolumeWriteFilter, so it may apply them a little later or not at
+// all when the next volume replaces them.
+// the time each stage takes, how old a snapshot is when the controller takes
+// it and how long volume targets wait for the actuator are recorded into the
+// metrics registry.
+// every call other than the constructor, setSampleFilter() and
+// setActivityCallback() must come from the controller thread. errors on the
+// stage threads are rethrown from the next updateSessions().
+class PipelineBackend : public AudioBackend {
+  private:
+    // sessions of the other backend as read by the sampler
+    struct Snapshot {
+        // changes whenever the session list or a session state changes
+        std::uint64_t sessionsVersion = 0;
+
+        // time on the sampler clock the snapshot was finished
+        double sampledMS = 0.0;
+
+        // the last volume batch applied before the volumes were read
+        std::uint64_t appliedSequence = 0;
+
+        std::vector<SessionKey> keys;
+        std::vector<std::wstring> names;
+        std::vector<SessionState> states;
+        std::vector<std::uint8_t> channels;
+        std::vector<float> peaks; // LevelDetector::MAX_CHANNELS per session
+        std::vector<float> volumes; // negative if not read
+        std::vector<std::uint32_t> volumeChanges;
+
+        // whether anything recorded from the microphone, and its level
+        bool capturing = false;
+        float capturePeak = 0.0f;
+    };
+
+    // a volume written by the controller, the volume change count of the
+    // session it was written on, and the batch that first sent it
+    struct PendingVolume {
+        SessionKey key;
+        float volume;
+        std::uint32_t changes;
+        std::uint64_t sequence;
+    };
+
+    // every volume not yet confirmed by a snapshot, so that skipping a batch
+    // loses nothing
+    struct VolumeBatch {
+        std::uint64_t sequence = 0;
+        double flushedMS = 0.0;
+        std::vector<PendingVolume> volumes;
+    };
+
+    enum NameFilter : std::uint8_t {
+        Excluded = 1 << 0,   // meters are not read
+        Controlled = 1 << 1, // volumes are read
+    };
+
+    AudioBackend &inner;
+    Clock &samplerClock;
+    std::function<void()> threadStart;
+    std::function<void()> threadEnd;
+
+    LatencyHistogram &sampleLatency;
+    LatencyHistogram &actuateLatency;
+    LatencyHistogram &sampleAge;
+    LatencyHistogram &actuateDelay;
+    Counter &volumeWrites;
+    Counter &volumeWritesStep;
+    Counter &volumeWritesRate;
+
+    LatestValue<Snapshot> samples;
+    LatestValue<VolumeBatch> batches;
+
+    std::thread sampler;
+    std::thread actuator;
+    std::atomic<bool> stopping{false};
+    std::function<void()> activityCallback;
+
+    // the next sample asked for by the controller
+    std::mutex requestMutex;
+    bool requestPending = true;
+    double requestDelayMS = 0.0;
+    bool requestPrecise = false;
+
+    // shared with the activity callback of the other backend, which may run
+    // after this is gone
+    std::shared_ptr<std::atomic<bool>> activityPending;
+
+    // patterns of the names whose meters are skipped or whose volumes are
+    // read, given by setSampleFilter() from any thread
+    std::mutex filterMutex;
+    NameMatcher excludedNames;
+    NameMatcher controlledNames;
+    std::atomic<unsigned> filterRevision{0};
+
+    // only touched by the sampler: the filter of each name id of the other
+    // backend, and the revision it was built from
+    std::vector<std::uint8_t> nameFilters;
+    unsigned filterRevisionBuilt = ~0u;
+    std::uint64_t sessionsVersion = 1;
+
+    // also only touched by the sampler: the volume last read from each
+    // session (negative if none) and its change count then, and the last
+    // volume batch applied when they were read. volumes are only read again
+    // once a batch was applied or they were changed from outside.
+    std::vector<float> readVolumes;
+    std::vector<std::uint32_t> readVolumeChanges;
+    std::uint64_t readVolumesSequence = 0;
+
+    // only touched by the actuator
+    std::mutex actuatorMutex;
+    std::condition_variable actuatorWake;
+    bool batchReady = false;
+    std::atomic<std::uint64_t> appliedSequence{0};
+    VolumeWriteFilter writeFilter;
+    std::vector<VolumeWriteFilter::Write> dueWrites;
+
+    // given by setWriteFilter() from any thread, picked up by the actuator
+    std::atomic<float> writeStepDB{0.0f};
+    std::atomic<double> writeIntervalMS{0.0};
+
+    std::mutex errorMutex;
+    std::atomic<bool> errored{false};
+    std::string error;
+
+    // only touched by the controller: the snapshot version the names were
+    // interned for, the name id of each session, and the volumes written
+    std::uint64_t adoptedVersion = 0;
+    std::vector<NameId> nameIds;
+    std::vector<PendingVolume> pending;
+    std::uint64_t nextSequence = 1;
+    bool pendingChanged = false;
+
+    std::uint8_t getNameFilter(NameId id);
+    void sample();
+    void runSampler();
+    void runActuator();
+    void applyBatch();
+    void applyWrites();
+
+    void setError(const std::exception &exception);
+    void rethrowError();
+
+    PendingVolume *findPending(SessionKey key);
+
+  public:
+    // how long after a requested sample is due the controller should tick on
+    // the last one anyway, e.g. when a call into the audio system hangs
+    static constexpr double SAMPLE_GRACE_MS = 50.0;
+
+    // the sampler waits on samplerClock, which must not be used for anything
+    // else that waits, and must outlive the notifications of the other
+    // backend. threadStart and threadEnd run at the start and end of
+    // each stage thread, e.g. to initialise com. registers its metrics in the
+    // given registry.
+    PipelineBackend(AudioBackend &inner, Clock &samplerClock,
+                    MetricsRegistry &metrics,
+                    std::function<void()> threadStart = nullptr,
+                    std::function<void()> threadEnd = nullptr);
+    ~PipelineBackend();
+
+    PipelineBackend(const PipelineBackend &) = delete;
+    PipelineBackend &operator=(const PipelineBackend &) = delete;
+
+    // start the sampler and actuator threads. the first sample is taken
+    // straight away.
+    void start();
+
+    // apply the volumes written so far and stop both threads
+    void stop();
+
+    // sample again in delayMS, replacing any earlier request. precise
+    // requests wait with Clock::waitPreciseMS().
+    void requestSample(double delayMS, bool precise);
+
+    // hand the volumes written since the last flush to the actuator. called
+    // at the end of every tick.
+    void flush();
+
+    // skip the meters of the excluded executables, and read the volumes of
+    // the controlled ones, both given as NameMatcher patterns. throws
+    // std::runtime_error if the patterns do not compile. can be called from
+    // any thread.
+    void setSampleFilter(const std::vector<std::wstring> &excluded,
+                         const std::vector<std::wstring> &controlled);
+
+    // quantise the volumes applied to steps of stepDB and apply at most one
+    // every intervalMS per session, see VolumeWriteFilter. off until set, and
+    // picked up by the next batch. can be called from any thread.
+    void setWriteFilter(float stepDB, double intervalMS);
+
+    bool updateSessions() override;
+
+    // called on the sampler thread after every snapshot
+    void setActivityCallback(std::function<void()> callback) override;
+
+    size_t getSessionCount() override;
+    SessionKey getSessionKey(size_t index) override;
+    SessionState getSessionState(size_t index) override;
+    NameId getExecutableNameId(size_t index) override;
+    size_t getChannelPeakLevels(size_t index, float *levels,
+                                size_t maxChannels) override;
+    float getSessionVolume(size_t index) override;
+    void setSessionVolume(size_t index, float volume) override;
+    std::uint32_t getVolumeChangeCount(size_t index) override;
+    bool getCapturePeakLevel(float &peak) override;
+};
@@ -0,0 +1,54 @@
+#include "ProcessTable.h"
+
+#include <utility>
+
+const size_t ProcessTable::MAX_DEPTH;
+
+ProcessTable::ProcessTable(Query query) : query(std::move(query)) {}
+
+ProcessTable::Process *ProcessTable::find(ProcessId id) {
+    auto found = processes.find(id);
+    if (found != processes.end())
+        return &found->second;
+
+    Process process;
+    if (!query(id, process.info))
+        return nullptr;
+    // references to elements survive later insertions
+    return &processes.emplace(id, std::move(process)).first->second;
+}
+
+NameId ProcessTable::getLineageId(ProcessId id, NameTable &names) {
+    Process *process = find(id);
+    if (!process)
+        return NameTable::Unknown;
+    if (process->lineageBuilt)
+        return process->lineageId;
+
+    std::wstring lineage = process->info.name;
+    ProcessId childId = id;
+    const ProcessInfo *child = &process->info;
+    for (size_t depth = 1; depth < MAX_DEPTH; depth++) {
+        ProcessId parentId = child->parentId;
+        if (parentId == 0 || parentId == childId)
+            break;
+        Process *parent = find(parentId);
+
+        // a parent that started later is a new process with a reused id
+        if (!parent || parent->info.startTime > child->startTime)
+            break;
+
+        lineage += NameTable::LINEAGE_SEPARATOR;
+        lineage += parent->info.name;
+        childId = parentId;
+        child = &parent->info;
+    }
+
+    process->lineageId = names.intern(lineage);
+    process->lineageBuilt = true;
+    return process->lineageId;
+}
+
+void ProcessTable::removeProcess(ProcessId id) { processes.erase(id); }
+
+size_t ProcessTable::size() const { return processes.size(); }
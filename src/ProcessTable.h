@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "NameTable.h"
+
+using ProcessId = std::uint32_t;
+
+// what the platform reports about a running process
+struct ProcessInfo {
+    ProcessId parentId = 0;
+
+    // any clock, only compared between processes, so a parent whose id was
+    // reused by a later process is not taken for the parent
+    std::uint64_t startTime = 0;
+
+    // executable name, e.g. "abc.exe"
+    std::wstring name;
+};
+
+// processtable caches the processes that play audio and their ancestors, so a
+// session can be matched by the programs that started it (a browser plays
+// audio from child processes with generic names, for one).
+// the table is updated incrementally: a process is queried from the platform
+// the first time it or a descendant is looked up, and removed when the
+// platform reports it exited. its lineage (see NameTable) is built and
+// interned on the first lookup and kept for as long as it runs, so later
+// lookups are a single hash lookup.
+// the query is the only platform-specific part, so the table can run against
+// a synthetic process tree. not thread safe.
+class ProcessTable {
+  public:
+    // fill in info for the running process, or return false if it cannot be
+    // queried (exited, or not accessible)
+    using Query = std::function<bool(ProcessId id, ProcessInfo &info)>;
+
+    // lineages are cut after this many executables, which also ends any
+    // cycle of reused process ids
+    static const size_t MAX_DEPTH = 8;
+
+  private:
+    struct Process {
+        ProcessInfo info;
+        bool lineageBuilt = false;
+        NameId lineageId = NameTable::Unknown;
+    };
+
+    Query query;
+    std::unordered_map<ProcessId, Process> processes;
+
+    // the cached process, queried if not yet known. nullptr if it cannot be.
+    Process *find(ProcessId id);
+
+  public:
+    explicit ProcessTable(Query query);
+
+    // the interned lineage of the process, or NameTable::Unknown if it
+    // cannot be queried
+    NameId getLineageId(ProcessId id, NameTable &names);
+
+    // forget a process that exited. its id may be reused by the next one.
+    void removeProcess(ProcessId id);
+
+    // number of processes cached
+    size_t size() const;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "NameTable.h"
+#include "SessionRegistry.h"
+
+// sessionframe holds the values sampled from every session during one tick as
+// flat arrays indexed by session index. the frame is resized rather than
+// rebuilt, so its capacity is kept across ticks and sampling an unchanged set
+// of sessions does not allocate.
+struct SessionFrame {
+    enum Flags : std::uint8_t {
+        PeakValid = 1 << 0,   // peaks[i] and levels[i] were read this tick
+        VolumeValid = 1 << 1, // volumes[i] was read this tick
+        Excluded = 1 << 2,    // ignored when deciding whether to duck
+        Controlled = 1 << 3,  // belongs to one of the targets being ducked
+    };
+
+    std::vector<SessionKey> keys;
+    std::vector<NameId> names;
+    std::vector<std::int32_t> targets; // index of the target, -1 if none
+    std::vector<float> peaks;  // max channel peak
+    std::vector<float> levels; // smoothed by the level detector
+    std::vector<float> volumes;
+    std::vector<std::uint8_t> flags;
+
+    void resize(size_t count) {
+        keys.resize(count);
+        names.resize(count);
+        targets.resize(count);
+        peaks.resize(count);
+        levels.resize(count);
+        volumes.resize(count);
+        flags.resize(count);
+    }
+
+    size_t size() const { return keys.size(); }
+};
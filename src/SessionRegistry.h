@@ -0,0 +1,189 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// identifies a single audio session for its whole lifetime. the windows engine
+// derives this from the session instance identifier.
+using SessionKey = std::uint64_t;
+
+enum class SessionState { Inactive, Active, Expired };
+
+// sessioneventsink receives session lifecycle events from an event source
+// (windows session notifications, or a fake source driven by hand). events may
+// be posted from any thread.
+template <typename Session> class SessionEventSink {
+  public:
+    virtual ~SessionEventSink() {}
+
+    virtual void sessionAdded(SessionKey key, SessionState state,
+                              Session session) = 0;
+    virtual void sessionStateChanged(SessionKey key, SessionState state) = 0;
+    virtual void sessionRemoved(SessionKey key) = 0;
+};
+
+// sessionregistry keeps a persistent list of audio sessions that is populated
+// once and then kept current by session events, instead of being re-enumerated
+// every tick.
+// events are queued as they arrive and only applied when the owning thread
+// calls applyPendingEvents(), so entries never change in the middle of a tick.
+// if no events are pending, applying them does not take a lock.
+// posting an event that means new audio may be playing (a session was added or
+// became active) also calls the activity callback, so the owner can wake up
+// instead of polling for it.
+template <typename Session>
+class SessionRegistry : public SessionEventSink<Session> {
+  public:
+    struct Entry {
+        SessionKey key;
+        SessionState state;
+        Session session;
+    };
+
+  private:
+    enum class EventType { Added, StateChanged, Removed };
+
+    struct Event {
+        EventType type;
+        SessionKey key;
+        SessionState state;
+        Session session;
+    };
+
+    // entries are kept contiguous, removal swaps the last entry into the gap
+    std::vector<Entry> entries;
+    std::unordered_map<SessionKey, size_t> indices;
+
+    std::mutex pendingMutex;
+    std::vector<Event> pending;
+    std::vector<Event> applying;
+    std::atomic<bool> hasPending{false};
+
+    std::function<void()> activityCallback;
+
+    void post(Event &&event) {
+        bool activity = event.type != EventType::Removed &&
+                        event.state == SessionState::Active;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.push_back(std::move(event));
+            hasPending.store(true, std::memory_order_release);
+        }
+        if (activity && activityCallback)
+            activityCallback();
+    }
+
+    // returns whether the key was present
+    bool remove(SessionKey key) {
+        auto it = indices.find(key);
+        if (it == indices.end())
+            return false;
+
+        size_t index = it->second;
+        indices.erase(it);
+
+        if (index != entries.size() - 1) {
+            entries[index] = std::move(entries.back());
+            indices[entries[index].key] = index;
+        }
+        entries.pop_back();
+        return true;
+    }
+
+  public:
+    // must be set before any events are posted, as it is called from the
+    // posting thread
+    void setActivityCallback(std::function<void()> callback) {
+        activityCallback = std::move(callback);
+    }
+
+    void sessionAdded(SessionKey key, SessionState state,
+                      Session session) override {
+        post({EventType::Added, key, state, std::move(session)});
+    }
+
+    void sessionStateChanged(SessionKey key, SessionState state) override {
+        post({EventType::StateChanged, key, state, Session()});
+    }
+
+    void sessionRemoved(SessionKey key) override {
+        post({EventType::Removed, key, SessionState::Expired, Session()});
+    }
+
+    // apply all queued events to the entries. returns whether any entry was
+    // added, removed or changed state. must only be called from the thread
+    // that reads the entries.
+    bool applyPendingEvents() {
+        if (!hasPending.load(std::memory_order_acquire))
+            return false;
+
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            applying.swap(pending);
+            hasPending.store(false, std::memory_order_relaxed);
+        }
+
+        bool changed = false;
+        for (auto &event : applying) {
+            switch (event.type) {
+            case EventType::Added:
+                // the same session can be reported by both the initial
+                // enumeration and a creation notification
+                if (indices.count(event.key) ||
+                    event.state == SessionState::Expired)
+                    break;
+                indices[event.key] = entries.size();
+                entries.push_back(
+                    {event.key, event.state, std::move(event.session)});
+                changed = true;
+                break;
+
+            case EventType::StateChanged: {
+                if (event.state == SessionState::Expired) {
+                    changed |= remove(event.key);
+                    break;
+                }
+                auto it = indices.find(event.key);
+                if (it != indices.end() &&
+                    entries[it->second].state != event.state) {
+                    entries[it->second].state = event.state;
+                    changed = true;
+                }
+                break;
+            }
+
+            case EventType::Removed:
+                changed |= remove(event.key);
+                break;
+            }
+        }
+
+        // release any sessions held by the events on this thread
+        applying.clear();
+        return changed;
+    }
+
+    // drop all entries and pending events
+    void clear() {
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            pending.clear();
+            hasPending.store(false, std::memory_order_relaxed);
+        }
+        entries.clear();
+        indices.clear();
+    }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+
+    Entry &operator[](size_t index) { return entries[index]; }
+
+    typename std::vector<Entry>::iterator begin() { return entries.begin(); }
+    typename std::vector<Entry>::iterator end() { return entries.end(); }
+};
@@ -0,0 +1,490 @@
+#include "SettingsFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cwchar>
+#include <cwctype>
+#include <stdexcept>
+
+static const std::wstring TARGET_SECTION_PREFIX = L"target:";
+
+static std::wstring trim(const std::wstring &text) {
+    size_t start = 0;
+    size_t end = text.size();
+    while (start < end && std::iswspace(text[start]))
+        start++;
+    while (end > start && std::iswspace(text[end - 1]))
+        end--;
+    return text.substr(start, end - start);
+}
+
+static std::wstring toLower(std::wstring text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](wchar_t c) { return (wchar_t)std::towlower(c); });
+    return text;
+}
+
+// keys are plain ascii, anything else is replaced for error messages
+static std::string toASCII(const std::wstring &text) {
+    std::string ascii;
+    for (wchar_t c : text)
+        ascii += (c >= 0x20 && c < 0x7f) ? (char)c : '?';
+    return ascii;
+}
+
+static std::string formatNumber(double number) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.10g", number);
+    return buffer;
+}
+
+// the section name a spec belongs in, as stored in sectionEnds
+static std::wstring getSectionKey(const SettingSpec &spec) {
+    return toLower(spec.section);
+}
+
+// whether the setting can be given in the section
+static bool belongsIn(const SettingSpec &spec, const std::wstring &section,
+                      bool targetSection) {
+    return targetSection ? spec.perTarget
+                         : !isTargetOnlySetting(spec) &&
+                               getSectionKey(spec) == section;
+}
+
+static const SettingSpec *findSpec(const std::wstring &key,
+                                   const std::wstring &section,
+                                   bool targetSection) {
+    auto lowerKey = toLower(key);
+    for (auto &spec : SETTINGS_SCHEMA) {
+        if (toLower(spec.key) == lowerKey &&
+            belongsIn(spec, section, targetSection))
+            return &spec;
+    }
+    return nullptr;
+}
+
+static std::runtime_error invalidValue(const SettingSpec &spec, size_t line,
+                                       const std::string &reason) {
+    std::string where = (line > 0) ? " on line " + std::to_string(line) +
+                                         " of the INI file"
+                                   : " in the defaults";
+    return std::runtime_error("Invalid value for " + toASCII(spec.key) +
+                              where + ": " + reason);
+}
+
+SettingsFile::Value SettingsFile::readValue(const SettingSpec &spec,
+                                            const std::wstring &text,
+                                            size_t line) const {
+    Value value;
+    value.present = true;
+    value.text = text;
+
+    switch (spec.type) {
+    case SettingType::Float:
+    case SettingType::Int: {
+        const wchar_t *begin = text.c_str();
+        wchar_t *end = nullptr;
+        bool isInt = spec.type == SettingType::Int;
+        value.number = isInt ? (double)std::wcstol(begin, &end, 10)
+                             : std::wcstod(begin, &end);
+
+        if (text.empty() || *end != L'\0')
+            throw invalidValue(spec, line,
+                               isInt ? "not a whole number" : "not a number");
+        // written so that nan is out of range too
+        if (!(value.number >= spec.minimum && value.number <= spec.maximum))
+            throw invalidValue(spec, line,
+                               "must be between " +
+                                   formatNumber(spec.minimum) + " and " +
+                                   formatNumber(spec.maximum));
+        break;
+    }
+    case SettingType::FadeCurve:
+        try {
+            parseFadeCurve(text);
+        } catch (std::runtime_error &) {
+            throw invalidValue(
+                spec, line,
+                "must be one of linear, decibel, scurve or equalpower");
+        }
+        break;
+    case SettingType::String:
+    case SettingType::List:
+        break;
+    }
+    return value;
+}
+
+void SettingsFile::parse(const std::wstring &text) {
+    lines.clear();
+    values.assign(SETTING_COUNT, Value());
+    targets.clear();
+    missing.clear();
+    sectionEnds.clear();
+    crlf = text.find(L"\r\n") != std::wstring::npos;
+
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(L'\n', start);
+        if (end == std::wstring::npos)
+            end = text.size();
+        size_t length = end - start;
+        if (length > 0 && text[end - 1] == L'\r')
+            length--;
+        lines.push_back(text.substr(start, length));
+        start = end + 1;
+    }
+
+    // lowercase name of the current section, and where its values go
+    std::wstring section;
+    bool targetSection = false;
+    std::vector<Value> *sectionValues = nullptr;
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        auto line = trim(lines[i]);
+        if (line.empty() || line[0] == L';' || line[0] == L'#')
+            continue;
+
+        if (line[0] == L'[') {
+            if (line.back() != L']') {
+                throw std::runtime_error("Missing \"]\" after the section "
+                                         "name on line " +
+                                         std::to_string(i + 1) +
+                                         " of the INI file");
+            }
+            auto name = trim(line.substr(1, line.size() - 2));
+            section = toLower(name);
+            targetSection =
+                section.compare(0, TARGET_SECTION_PREFIX.size(),
+                                TARGET_SECTION_PREFIX) == 0;
+
+            if (targetSection) {
+                auto executable =
+                    trim(section.substr(TARGET_SECTION_PREFIX.size()));
+                sectionValues = &targets[executable];
+                sectionValues->resize(SETTING_COUNT);
+            } else {
+                sectionValues = &values;
+            }
+            sectionEnds[section] = i + 1;
+            continue;
+        }
+
+        size_t equals = line.find(L'=');
+        if (equals == std::wstring::npos) {
+            throw std::runtime_error("Expected key=value on line " +
+                                     std::to_string(i + 1) +
+                                     " of the INI file");
+        }
+        auto key = trim(line.substr(0, equals));
+        auto value = trim(line.substr(equals + 1));
+        if (value.size() >= 2 && (value[0] == L'"' || value[0] == L'\'') &&
+            value.back() == value[0])
+            value = value.substr(1, value.size() - 2);
+
+        if (sectionValues == nullptr)
+            continue;
+
+        auto spec = findSpec(key, section, targetSection);
+        if (spec != nullptr) {
+            auto &slot = (*sectionValues)[(size_t)spec->id];
+            if (!slot.present || slot.renamed)
+                slot = readValue(*spec, value, i + 1);
+            sectionEnds[section] = i + 1;
+            continue;
+        }
+
+        // a key from an older version fills in the settings it became
+        auto lowerKey = toLower(key);
+        for (auto &rename : SETTING_RENAMES) {
+            auto &renamedSpec = getSettingSpec(rename.id);
+            if (toLower(rename.previousKey) != lowerKey ||
+                !belongsIn(renamedSpec, section, targetSection))
+                continue;
+
+            auto &slot = (*sectionValues)[(size_t)rename.id];
+            if (!slot.present) {
+                slot = readValue(renamedSpec, value, i + 1);
+                slot.renamed = true;
+            }
+            sectionEnds[section] = i + 1;
+        }
+    }
+
+    for (auto &spec : SETTINGS_SCHEMA) {
+        auto &slot = values[(size_t)spec.id];
+        if (slot.present && !slot.renamed)
+            continue;
+        if (!slot.present)
+            slot = readValue(spec, spec.defaultValue, 0);
+        if (!isTargetOnlySetting(spec))
+            missing.push_back(spec.id);
+    }
+}
+
+const std::vector<Setting> &SettingsFile::getMissing() const {
+    return missing;
+}
+
+std::wstring SettingsFile::migrate() const {
+    // text to insert before each line, and sections that are missing entirely
+    std::unordered_map<size_t, std::wstring> inserts;
+    std::wstring appended;
+    std::wstring appendedSection;
+
+    for (size_t i = 0; i < missing.size(); i++) {
+        auto id = missing[i];
+        auto &spec = getSettingSpec(id);
+        auto section = getSectionKey(spec);
+
+        // settings sharing a comment keep together, under a single copy of it
+        bool sharesDoc = spec.doc == nullptr && i > 0 &&
+                         (size_t)missing[i - 1] == (size_t)id - 1;
+        auto &value = values[(size_t)id];
+        auto entry = formatSettingINI(
+            id, !sharesDoc, value.renamed ? value.text.c_str() : nullptr);
+
+        auto end = sectionEnds.find(section);
+        if (end != sectionEnds.end()) {
+            inserts[end->second] += (sharesDoc ? L"" : L"\n") + entry;
+        } else if (appendedSection != section) {
+            appendedSection = section;
+            appended +=
+                L"\n\n\n[" + std::wstring(spec.section) + L"]\n" + entry;
+        } else {
+            appended += (sharesDoc ? L"" : L"\n") + entry;
+        }
+    }
+
+    std::wstring text;
+    for (size_t i = 0; i <= lines.size(); i++) {
+        auto insert = inserts.find(i);
+        if (insert != inserts.end())
+            text += insert->second;
+        if (i < lines.size())
+            text += lines[i] + L"\n";
+    }
+    text += appended;
+
+    if (crlf) {
+        std::wstring converted;
+        for (wchar_t c : text) {
+            if (c == L'\n')
+                converted += L'\r';
+            converted += c;
+        }
+        text = converted;
+    }
+    return text;
+}
+
+const SettingsFile::Value &
+SettingsFile::getValue(Setting id, const std::wstring *target) const {
+    if (target != nullptr) {
+        auto found = targets.find(toLower(trim(*target)));
+        if (found != targets.end() && found->second[(size_t)id].present)
+            return found->second[(size_t)id];
+    }
+    return values[(size_t)id];
+}
+
+float SettingsFile::getFloat(Setting id) const {
+    return (float)getValue(id, nullptr).number;
+}
+
+int SettingsFile::getInt(Setting id) const {
+    return (int)getValue(id, nullptr).number;
+}
+
+std::wstring SettingsFile::getString(Setting id) const {
+    return getValue(id, nullptr).text;
+}
+
+std::vector<std::wstring> SettingsFile::getList(Setting id) const {
+    std::vector<std::wstring> list;
+    auto &text = getValue(id, nullptr).text;
+
+    size_t start = 0;
+    size_t end = text.find(L'/');
+    while (end != std::wstring::npos) {
+        list.push_back(text.substr(start, end - start));
+        start = end + 1;
+        end = text.find(L'/', start);
+    }
+    list.push_back(text.substr(start));
+    return list;
+}
+
+FadeCurve SettingsFile::getFadeCurve(Setting id) const {
+    return parseFadeCurve(getValue(id, nullptr).text);
+}
+
+float SettingsFile::getFloat(Setting id, const std::wstring &target) const {
+    return (float)getValue(id, &target).number;
+}
+
+int SettingsFile::getInt(Setting id, const std::wstring &target) const {
+    return (int)getValue(id, &target).number;
+}
+
+FadeCurve SettingsFile::getFadeCurve(Setting id,
+                                     const std::wstring &target) const {
+    return parseFadeCurve(getValue(id, &target).text);
+}
+
+DuckSettings SettingsFile::getDuckSettings() const {
+    DuckSettings settings;
+    settings.tickIdleMS = getFloat(Setting::TickIdleMS);
+    settings.tickTransitionMS = getFloat(Setting::TickTransitionMS);
+    settings.tickInactiveMS = getFloat(Setting::TickInactiveMS);
+    settings.detectorSampleMS = getFloat(Setting::DetectorSampleMS);
+    settings.batteryIntervalScale = getFloat(Setting::BatteryIntervalScale);
+    settings.awayIntervalScale = getFloat(Setting::AwayIntervalScale);
+    settings.volumeMinimumToTrigger =
+        getFloat(Setting::VolumeMinimumToTrigger);
+    settings.detectorWindowMS = getFloat(Setting::DetectorWindowMS);
+    settings.detectorAttackMS = getFloat(Setting::DetectorAttackMS);
+    settings.detectorReleaseMS = getFloat(Setting::DetectorReleaseMS);
+    settings.duckLookbackMS = getFloat(Setting::DuckLookbackMS);
+    settings.consecutiveMinimumsToTrigger =
+        getInt(Setting::ConsecutiveMinimumsToTrigger);
+    settings.consecutiveMinimumsToEnd =
+        getInt(Setting::ConsecutiveMinimumsToEnd);
+    settings.excludedExecutables = getList(Setting::ExcludedExecutables);
+
+    // the volume and fade settings in [General] apply to every target
+    // unless overridden in its own section
+    for (auto &executable : getList(Setting::ControlledExecutable)) {
+        if (executable.empty())
+            continue;
+
+        DuckTarget target;
+        target.executable = executable;
+        target.volumeMax = getFloat(Setting::VolumeMax, executable);
+        target.volumeMin = getFloat(Setting::VolumeMin, executable);
+        target.volumeRestore = getFloat(Setting::VolumeRestore, executable);
+        target.attackMS = getFloat(Setting::AttackMS, executable);
+        target.releaseMS = getFloat(Setting::ReleaseMS, executable);
+        target.attackCurve = getFadeCurve(Setting::AttackCurve, executable);
+        target.releaseCurve = getFadeCurve(Setting::ReleaseCurve, executable);
+        target.duckCurve.thresholdDB =
+            getFloat(Setting::DuckThresholdDB, executable);
+        target.duckCurve.ratio = getFloat(Setting::DuckRatio, executable);
+        target.duckCurve.kneeDB = getFloat(Setting::DuckKneeDB, executable);
+        target.duckCurve.rangeDB = getFloat(Setting::DuckRangeDB, executable);
+        target.priority = getInt(Setting::Priority, executable);
+
+        settings.targets.push_back(target);
+    }
+
+    settings.commandOnDuck = getString(Setting::CommandOnDuck);
+    settings.commandOnUnduck = getString(Setting::CommandOnUnduck);
+    settings.commandTimeoutMS = getFloat(Setting::CommandTimeoutMS);
+    settings.sidechainEnabled = getInt(Setting::SidechainEnabled) != 0;
+    settings.sidechainOpenLevel = getFloat(Setting::SidechainOpenLevel);
+    settings.sidechainCloseLevel = getFloat(Setting::SidechainCloseLevel);
+    settings.sidechainHangoverMS = getFloat(Setting::SidechainHangoverMS);
+    return settings;
+}
+
+// append a code point, as a surrogate pair where wchar_t is 16 bits
+static void appendCodePoint(std::wstring &text, std::uint32_t codePoint) {
+    if (sizeof(wchar_t) == 2 && codePoint > 0xffff) {
+        codePoint -= 0x10000;
+        text += (wchar_t)(0xd800 + (codePoint >> 10));
+        text += (wchar_t)(0xdc00 + (codePoint & 0x3ff));
+    } else {
+        text += (wchar_t)codePoint;
+    }
+}
+
+std::wstring decodeSettingsText(const std::string &bytes) {
+    auto byte = [&](size_t i) {
+        return (std::uint32_t)(unsigned char)bytes[i];
+    };
+    std::wstring text;
+
+    if (bytes.size() >= 2 && byte(0) == 0xff && byte(1) == 0xfe) {
+        for (size_t i = 2; i + 1 < bytes.size(); i += 2) {
+            std::uint32_t unit = byte(i) | byte(i + 1) << 8;
+            if (unit >= 0xd800 && unit < 0xdc00 && i + 3 < bytes.size()) {
+                std::uint32_t low = byte(i + 2) | byte(i + 3) << 8;
+                if (low >= 0xdc00 && low < 0xe000) {
+                    appendCodePoint(text, 0x10000 + ((unit - 0xd800) << 10) +
+                                              (low - 0xdc00));
+                    i += 2;
+                    continue;
+                }
+            }
+            appendCodePoint(text, unit);
+        }
+        return text;
+    }
+
+    size_t i = 0;
+    if (bytes.size() >= 3 && byte(0) == 0xef && byte(1) == 0xbb &&
+        byte(2) == 0xbf)
+        i = 3;
+
+    while (i < bytes.size()) {
+        std::uint32_t lead = byte(i);
+        size_t length = (lead < 0x80)           ? 1
+                        : (lead & 0xe0) == 0xc0 ? 2
+                        : (lead & 0xf0) == 0xe0 ? 3
+                        : (lead & 0xf8) == 0xf0 ? 4
+                                                : 0;
+        std::uint32_t codePoint = (length == 1)   ? lead
+                                  : (length == 2) ? lead & 0x1f
+                                  : (length == 3) ? lead & 0x0f
+                                                  : lead & 0x07;
+
+        bool valid = length > 0 && i + length <= bytes.size();
+        for (size_t j = 1; valid && j < length; j++) {
+            valid = (byte(i + j) & 0xc0) == 0x80;
+            codePoint = codePoint << 6 | (byte(i + j) & 0x3f);
+        }
+
+        if (valid) {
+            appendCodePoint(text, codePoint);
+            i += length;
+        } else {
+            appendCodePoint(text, lead);
+            i++;
+        }
+    }
+    return text;
+}
+
+std::string encodeSettingsText(const std::wstring &text) {
+    std::string bytes;
+    for (size_t i = 0; i < text.size(); i++) {
+        std::uint32_t codePoint = (std::uint32_t)text[i];
+        if (sizeof(wchar_t) == 2 && codePoint >= 0xd800 && codePoint < 0xdc00 &&
+            i + 1 < text.size()) {
+            std::uint32_t low = (std::uint32_t)text[i + 1];
+            if (low >= 0xdc00 && low < 0xe000) {
+                codePoint = 0x10000 + ((codePoint - 0xd800) << 10) +
+                            (low - 0xdc00);
+                i++;
+            }
+        }
+
+        if (codePoint < 0x80) {
+            bytes += (char)codePoint;
+        } else if (codePoint < 0x800) {
+            bytes += (char)(0xc0 | codePoint >> 6);
+            bytes += (char)(0x80 | (codePoint & 0x3f));
+        } else if (codePoint < 0x10000) {
+            bytes += (char)(0xe0 | codePoint >> 12);
+            bytes += (char)(0x80 | (codePoint >> 6 & 0x3f));
+            bytes += (char)(0x80 | (codePoint & 0x3f));
+        } else {
+            bytes += (char)(0xf0 | codePoint >> 18);
+            bytes += (char)(0x80 | (codePoint >> 12 & 0x3f));
+            bytes += (char)(0x80 | (codePoint >> 6 & 0x3f));
+            bytes += (char)(0x80 | (codePoint & 0x3f));
+        }
+    }
+    return bytes;
+}
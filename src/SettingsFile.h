@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DuckController.h"
+#include "Fade.h"
+#include "SettingsSchema.h"
+
+// settingsfile reads the settings ini in a single pass over its text, without
+// any windows ini functions. every key is checked against SETTINGS_SCHEMA as
+// it is read, and an invalid value throws std::runtime_error naming its line.
+// settings missing from the text take their defaults, or the value of a key
+// they were renamed from (see SETTING_RENAMES), and migrate() adds them to the
+// text so old inis keep working after an update.
+// as with windows inis, section and key names are case-insensitive, the first
+// of duplicate keys wins and values may be wrapped in quotes. unknown keys are
+// ignored.
+class SettingsFile {
+  private:
+    struct Value {
+        bool present = false;
+        std::wstring text;
+        double number = 0.0;
+
+        // read from a previous key of the setting, so its own key wins
+        bool renamed = false;
+    };
+
+    std::vector<std::wstring> lines;
+    bool crlf = false;
+
+    // values of [Performance], [General], etc., indexed by Setting
+    std::vector<Value> values;
+
+    // values of each [Target:<executable>] section, by lowercase executable
+    std::unordered_map<std::wstring, std::vector<Value>> targets;
+
+    std::vector<Setting> missing;
+
+    // index of the line after the last key of each section, by lowercase name
+    std::unordered_map<std::wstring, size_t> sectionEnds;
+
+    // check a value against its spec. line is 0 for defaults.
+    Value readValue(const SettingSpec &spec, const std::wstring &text,
+                    size_t line) const;
+
+    // the value of a target section if it has one, else the shared value
+    const Value &getValue(Setting id, const std::wstring *target) const;
+
+  public:
+    // parse the text of an ini, replacing anything parsed before
+    void parse(const std::wstring &text);
+
+    // settings that were missing from the text and took their defaults, or
+    // the value of a previous key
+    const std::vector<Setting> &getMissing() const;
+
+    // the parsed text with every missing setting added at the end of its
+    // section, with its comment and default (or the value of its previous
+    // key). everything else is unchanged.
+    std::wstring migrate() const;
+
+    float getFloat(Setting id) const;
+    int getInt(Setting id) const;
+    std::wstring getString(Setting id) const;
+    std::vector<std::wstring> getList(Setting id) const;
+    FadeCurve getFadeCurve(Setting id) const;
+
+    // the value for a target, from its [Target:<executable>] section if given
+    // there, else from its own section (or the default, for target only
+    // settings)
+    float getFloat(Setting id, const std::wstring &target) const;
+    int getInt(Setting id, const std::wstring &target) const;
+    FadeCurve getFadeCurve(Setting id, const std::wstring &target) const;
+
+    // the duck controller's settings, with a target for each controlled
+    // executable
+    DuckSettings getDuckSettings() const;
+};
+
+// decode the bytes of an ini file. utf-16 (with a byte order mark) and utf-8
+// are supported, bytes that are not valid utf-8 are read as latin-1.
+std::wstring decodeSettingsText(const std::string &bytes);
+
+// encode text as utf-8 to write it to an ini file
+std::string encodeSettingsText(const std::wstring &text);
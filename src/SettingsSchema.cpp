@@ -0,0 +1,71 @@
+#include "SettingsSchema.h"
+
+const wchar_t *getSettingDoc(Setting id) {
+    size_t index = (size_t)id;
+    while (index > 0 && SETTINGS_SCHEMA[index].doc == nullptr)
+        index--;
+    return SETTINGS_SCHEMA[index].doc;
+}
+
+// each line of the text prefixed with "; "
+static std::wstring formatComment(const std::wstring &text) {
+    std::wstring comment;
+    size_t start = 0;
+    while (true) {
+        size_t end = text.find(L'\n', start);
+        comment += L"; " + text.substr(start, end - start) + L"\n";
+        if (end == std::wstring::npos)
+            return comment;
+        start = end + 1;
+    }
+}
+
+std::wstring formatSettingINI(Setting id, bool withDoc,
+                              const wchar_t *value) {
+    auto &spec = getSettingSpec(id);
+    std::wstring text;
+    if (withDoc)
+        text += formatComment(getSettingDoc(id));
+    text += std::wstring(spec.key) + L"=" +
+            (value != nullptr ? value : spec.defaultValue) + L"\n";
+    return text;
+}
+
+std::wstring generateDefaultSettingsINI() {
+    std::wstring text;
+    const wchar_t *section = nullptr;
+
+    for (auto &spec : SETTINGS_SCHEMA) {
+        if (isTargetOnlySetting(spec))
+            continue;
+
+        if (section == nullptr || std::wcscmp(section, spec.section) != 0) {
+            if (section != nullptr)
+                text += L"\n\n\n";
+            section = spec.section;
+            text += L"[" + std::wstring(section) + L"]\n";
+        } else if (spec.doc != nullptr) {
+            text += L"\n";
+        }
+        text += formatSettingINI(spec.id, spec.doc != nullptr);
+    }
+
+    // target sections are optional, so only an example is written
+    std::wstring example =
+        L"Optional settings for a single targeted program, overriding those "
+        L"in [General].\n";
+    for (auto &spec : SETTINGS_SCHEMA) {
+        if (isTargetOnlySetting(spec)) {
+            example += std::wstring(spec.key) + L": " + spec.doc +
+                       L" Defaults to " + spec.defaultValue + L".\n";
+        }
+    }
+    example += L"[Target:foobar2000.exe]";
+    for (auto &spec : SETTINGS_SCHEMA) {
+        if (spec.perTarget)
+            example +=
+                L"\n" + std::wstring(spec.key) + L"=" + spec.defaultValue;
+    }
+    text += L"\n\n\n" + formatComment(example);
+    return text;
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstddef>
+#include <cwchar>
+#include <string>
+
+// how the text of a setting is read
+enum class SettingType {
+    Float,
+    Int,
+    String,
+    List,      // values separated by '/'s
+    FadeCurve, // by name, see parseFadeCurve()
+};
+
+// every setting in the ini, in the order of SETTINGS_SCHEMA
+enum class Setting {
+    TickIdleMS,
+    TickTransitionMS,
+    TickInactiveMS,
+    DetectorSampleMS,
+    BatteryIntervalScale,
+    AwayIntervalScale,
+    MetricsExportMS,
+    VolumeStepDB,
+    VolumeWriteIntervalMS,
+
+    AttackMS,
+    ReleaseMS,
+    AttackCurve,
+    ReleaseCurve,
+    ConsecutiveMinimumsToTrigger,
+    ConsecutiveMinimumsToEnd,
+    VolumeMinimumToTrigger,
+    DetectorWindowMS,
+    DetectorAttackMS,
+    DetectorReleaseMS,
+    VolumeMin,
+    VolumeMax,
+    VolumeRestore,
+    DuckThresholdDB,
+    DuckRatio,
+    DuckKneeDB,
+    DuckRangeDB,
+    DuckLookbackMS,
+    ExcludedExecutables,
+    ControlledExecutable,
+    CommandOnDuck,
+    CommandOnUnduck,
+    CommandTimeoutMS,
+
+    SidechainEnabled,
+    SidechainOpenLevel,
+    SidechainCloseLevel,
+    SidechainHangoverMS,
+
+    Priority,
+
+    Count,
+};
+
+static const size_t SETTING_COUNT = (size_t)Setting::Count;
+
+// settings in this section can only be given in [Target:<executable>]
+// sections, all others also belong in their own section
+static const wchar_t *const TARGET_SECTION = L"Target";
+
+// settingspec describes a single setting: where it lives in the ini, its type,
+// the default written to a new ini and the range numbers must be within
+struct SettingSpec {
+    Setting id;
+    const wchar_t *section;
+    const wchar_t *key;
+    SettingType type;
+    const wchar_t *defaultValue;
+    double minimum;
+    double maximum;
+
+    // whether it can be given per target in a [Target:<executable>] section
+    bool perTarget;
+
+    // comment written above the key, lines separated by '\n'. nullptr shares
+    // the comment of the setting before it.
+    const wchar_t *doc;
+};
+
+// the one place every setting is defined. the default ini, the parser and the
+// migration of old inis are all generated from it.
+constexpr SettingSpec SETTINGS_SCHEMA[] = {
+    {Setting::TickIdleMS, L"Performance", L"fTickIdleMS", SettingType::Float,
+     L"1000.0", 1.0, 3600000.0, false,
+     L"Controls how frequently the program queries volume information when "
+     L"idle."},
+    {Setting::TickTransitionMS, L"Performance", L"fTickTransitionsMS",
+     SettingType::Float, L"50.0", 1.0, 60000.0, false,
+     L"Controls how frequently the program queries volume information when "
+     L"transitioning. Higher values mean a smoother transition."},
+    {Setting::TickInactiveMS, L"Performance", L"fTickInactiveMS",
+     SettingType::Float, L"0.0", 0.0, 3600000.0, false,
+     L"Controls how long the program waits between checks when nothing that "
+     L"could trigger the duck is playing. New audio wakes the program "
+     L"immediately, so this is only a safety net. 0 waits for new audio "
+     L"alone, so the program does not wake up at all while it is quiet."},
+    {Setting::DetectorSampleMS, L"Performance", L"fDetectorSampleMS",
+     SettingType::Float, L"20.0", 1.0, 60000.0, false,
+     L"Controls how frequently the program samples the audio level of "
+     L"programs that are playing. Lower values detect audio faster."},
+    {Setting::BatteryIntervalScale, L"Performance", L"fBatteryIntervalScale",
+     SettingType::Float, L"2.0", 1.0, 20.0, false,
+     L"How many times longer the intervals above are while running on "
+     L"battery. Higher values use less power, but detect audio later and "
+     L"fade in coarser steps."},
+    {Setting::AwayIntervalScale, L"Performance", L"fAwayIntervalScale",
+     SettingType::Float, L"4.0", 1.0, 20.0, false,
+     L"How many times longer the intervals above are while the display is "
+     L"off or the session is locked. The longer of the two applies."},
+    {Setting::MetricsExportMS, L"Performance", L"fMetricsExportMS",
+     SettingType::Float, L"60000.0", 0.0, 86400000.0, false,
+     L"Controls how frequently timing statistics are written to metrics.json "
+     L"next to the program. 0 disables writing them."},
+    {Setting::VolumeStepDB, L"Performance", L"fVolumeStepDB",
+     SettingType::Float, L"0.5", 0.0, 20.0, false,
+     L"During a fade, the volume is only set when it has changed by a step "
+     L"of this many decibels, which is too small to hear. Every change is "
+     L"sent to each program watching the volume. 0 sets every change."},
+    {Setting::VolumeWriteIntervalMS, L"Performance", L"fVolumeWriteIntervalMS",
+     SettingType::Float, L"30.0", 0.0, 1000.0, false,
+     L"The volume of a program is set at most once in this many "
+     L"milliseconds, later changes wait for the newest one. 0 sets every "
+     L"change straight away."},
+
+    {Setting::AttackMS, L"General", L"fAttackMS", SettingType::Float,
+     L"1000.0", 0.0, 600000.0, true,
+     L"Duration of the fade down when ducking, and of the fade up when "
+     L"unducking, between fVolumeMax and fVolumeMin."},
+    {Setting::ReleaseMS, L"General", L"fReleaseMS", SettingType::Float,
+     L"1000.0", 0.0, 600000.0, true, nullptr},
+    {Setting::AttackCurve, L"General", L"sAttackCurve", SettingType::FadeCurve,
+     L"linear", 0.0, 0.0, true,
+     L"Shape of the fades down and up. One of linear, decibel (sounds most "
+     L"even), scurve or equalpower."},
+    {Setting::ReleaseCurve, L"General", L"sReleaseCurve",
+     SettingType::FadeCurve, L"linear", 0.0, 0.0, true, nullptr},
+    {Setting::ConsecutiveMinimumsToTrigger, L"General",
+     L"iConsecutiveMinimumsToTrigger", SettingType::Int, L"1", 1.0, 100000.0,
+     false,
+     L"Number of consecutive samples that the volume needs to be above the "
+     L"fVolumeMinimumToTrigger to trigger the duck. 1 will trigger the duck "
+     L"immediately."},
+    {Setting::ConsecutiveMinimumsToEnd, L"General",
+     L"iConsecutiveMinimumsToEnd", SettingType::Int, L"3", 1.0, 100000.0,
+     false,
+     L"Number of consecutive samples that the volume needs to be below the "
+     L"fVolumeMinimumToTrigger to end the duck."},
+    {Setting::VolumeMinimumToTrigger, L"General", L"fVolumeMinimumToTrigger",
+     SettingType::Float, L"0.0", 0.0, 1.0, false,
+     L"Minimum volume of programs not excluded or controlled to trigger the "
+     L"duck. This is compared against the smoothed level below."},
+    {Setting::DetectorWindowMS, L"General", L"fDetectorWindowMS",
+     SettingType::Float, L"100.0", 0.0, 60000.0, false,
+     L"The audio level of other programs is averaged over this window, then "
+     L"follows rises in level over the attack time and falls over the release "
+     L"time. Higher values ignore short sounds such as clicks."},
+    {Setting::DetectorAttackMS, L"General", L"fDetectorAttackMS",
+     SettingType::Float, L"50.0", 0.0, 60000.0, false, nullptr},
+    {Setting::DetectorReleaseMS, L"General", L"fDetectorReleaseMS",
+     SettingType::Float, L"100.0", 0.0, 60000.0, false, nullptr},
+    {Setting::VolumeMin, L"General", L"fVolumeMin", SettingType::Float,
+     L"0.0", 0.0, 1.0, true,
+     L"The minimum volume the controlled program will be lowered to. 0.0 is "
+     L"muted."},
+    {Setting::VolumeMax, L"General", L"fVolumeMax", SettingType::Float,
+     L"0.2", 0.0, 1.0, true,
+     L"The maximum volume the controlled program will be raised to. For "
+     L"background music, set to a lower value."},
+    {Setting::VolumeRestore, L"General", L"fVolumeRestore",
+     SettingType::Float, L"1.0", 0.0, 1.0, true,
+     L"The volume to restore the controlled program to when this program is "
+     L"closed or bypassed."},
+    {Setting::DuckThresholdDB, L"General", L"fDuckThresholdDB",
+     SettingType::Float, L"-30.0", -120.0, 0.0, true,
+     L"With fDuckRangeDB above 0, the duck goes deeper the louder the audio "
+     L"that triggers it, like a compressor: a quiet notification only dips "
+     L"the volume, while a loud game ducks it fully. Audio louder than the "
+     L"threshold (in decibels of the smoothed level, 0 being the loudest) "
+     L"is ducked by 1 - 1/fDuckRatio decibels for every decibel above it, "
+     L"easing in over a knee of fDuckKneeDB, and by at most fDuckRangeDB "
+     L"below fVolumeMax. The volume never goes below fVolumeMin. 0 for "
+     L"fDuckRangeDB always ducks fully to fVolumeMin."},
+    {Setting::DuckRatio, L"General", L"fDuckRatio", SettingType::Float,
+     L"4.0", 1.0, 100.0, true, nullptr},
+    {Setting::DuckKneeDB, L"General", L"fDuckKneeDB", SettingType::Float,
+     L"6.0", 0.0, 60.0, true, nullptr},
+    {Setting::DuckRangeDB, L"General", L"fDuckRangeDB", SettingType::Float,
+     L"0.0", 0.0, 120.0, true, nullptr},
+    {Setting::DuckLookbackMS, L"General", L"fDuckLookbackMS",
+     SettingType::Float, L"500.0", 0.0, 60000.0, false,
+     L"The deepest duck the audio called for over this many milliseconds is "
+     L"kept, so the volume does not flutter with the level of the audio."},
+    {Setting::ExcludedExecutables, L"General", L"sExcludedExecutables",
+     SettingType::List, L"nvcontainer.exe/amdow.exe/amddvr.exe", 0.0, 0.0,
+     false,
+     L"Excluded executable names that are ignored when calculating whether "
+     L"to trigger. Separated by a \"/\" character. Case is ignored, and a "
+     L"\"*\" matches any characters and a \"?\" any one character, e.g. "
+     L"\"*helper*.exe\". A program also matches through the programs that "
+     L"started it, so the audio processes of a browser match the browser."},
+    {Setting::ControlledExecutable, L"General", L"sControlledExecutable",
+     SettingType::List, L"foobar2000.exe", 0.0, 0.0, false,
+     L"The programs that are targeted. Separated by a \"/\" character and "
+     L"matched like sExcludedExecutables. A program matched by several is "
+     L"targeted by the first.\n"
+     L"The volume and fade settings above apply to every targeted program, "
+     L"unless overridden in a [Target:<program>] section below."},
+    {Setting::CommandOnDuck, L"General", L"sCommandOnDuck",
+     SettingType::String, L"", 0.0, 0.0, false,
+     L"Run a Windows command when ducked or unducked. Leave empty for no "
+     L"commands."},
+    {Setting::CommandOnUnduck, L"General", L"sCommandOnUnduck",
+     SettingType::String, L"", 0.0, 0.0, false, nullptr},
+    {Setting::CommandTimeoutMS, L"General", L"fCommandTimeoutMS",
+     SettingType::Float, L"10000.0", 0.0, 86400000.0, false,
+     L"Commands still running after this many milliseconds are killed. 0 "
+     L"lets them run forever."},
+
+    {Setting::SidechainEnabled, L"Sidechain", L"iSidechainEnabled",
+     SettingType::Int, L"0", 0.0, 1.0, false,
+     L"1 also ducks every targeted program while you talk into the "
+     L"microphone, e.g. on a call, and not only while the other side does. "
+     L"The default recording devices are only listened to while a program "
+     L"is recording from them."},
+    {Setting::SidechainOpenLevel, L"Sidechain", L"fSidechainOpenLevel",
+     SettingType::Float, L"0.1", 0.001, 1.0, false,
+     L"Microphone level that starts the duck, and the lower level it needs "
+     L"to stay above to keep it. Raise these if background noise or typing "
+     L"ducks the music."},
+    {Setting::SidechainCloseLevel, L"Sidechain", L"fSidechainCloseLevel",
+     SettingType::Float, L"0.05", 0.0, 1.0, false, nullptr},
+    {Setting::SidechainHangoverMS, L"Sidechain", L"fSidechainHangoverMS",
+     SettingType::Float, L"400.0", 0.0, 60000.0, false,
+     L"How long the duck is kept after the microphone level last stayed "
+     L"above fSidechainCloseLevel, so it holds through pauses between "
+     L"words."},
+
+    {Setting::Priority, TARGET_SECTION, L"iPriority", SettingType::Int, L"0",
+     -1000.0, 1000.0, true,
+     L"While playing, a targeted program ducks every targeted program with a "
+     L"lower priority."},
+};
+
+// settingrename is a key that a setting was given under by an older version,
+// in the same section. a value under the old key is used when the setting's
+// own key is not given, and migrating writes it out under the new key.
+struct SettingRename {
+    const wchar_t *previousKey;
+    Setting id;
+};
+
+constexpr SettingRename SETTING_RENAMES[] = {
+    // the fade speed was split into the fades down and up
+    {L"fFadeSpeedMS", Setting::AttackMS},
+    {L"fFadeSpeedMS", Setting::ReleaseMS},
+};
+
+constexpr bool isSettingsSchemaInOrder() {
+    for (size_t i = 0; i < SETTING_COUNT; i++) {
+        if (SETTINGS_SCHEMA[i].id != (Setting)i)
+            return false;
+    }
+    return true;
+}
+
+static_assert(sizeof(SETTINGS_SCHEMA) / sizeof(SETTINGS_SCHEMA[0]) ==
+                  SETTING_COUNT,
+              "every setting needs an entry in SETTINGS_SCHEMA");
+static_assert(isSettingsSchemaInOrder(),
+              "SETTINGS_SCHEMA must be in the order of Setting");
+
+inline const SettingSpec &getSettingSpec(Setting id) {
+    return SETTINGS_SCHEMA[(size_t)id];
+}
+
+// whether the setting can only be given in [Target:<executable>] sections
+inline bool isTargetOnlySetting(const SettingSpec &spec) {
+    return std::wcscmp(spec.section, TARGET_SECTION) == 0;
+}
+
+// the default settings ini, with every setting at its default and documented
+std::wstring generateDefaultSettingsINI();
+
+// the comment of a setting, which may be shared with the settings before it
+const wchar_t *getSettingDoc(Setting id);
+
+// a setting as written to the ini, i.e. "key=default\n", preceded by its
+// comment as "; " lines if withDoc is set. a value other than nullptr is
+// written instead of the default.
+std::wstring formatSettingINI(Setting id, bool withDoc,
+                              const wchar_t *value = nullptr);
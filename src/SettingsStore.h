@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// settingsstore hands immutable snapshots of settings from the threads that
+// load them to a single reader thread, rcu style. publishing swaps in a whole
+// new snapshot, so the reader never sees one half updated.
+// the reader picks up the latest snapshot with acquire(), which never takes a
+// lock or allocates, and is a single atomic load unless the snapshot changed.
+// a snapshot it got stays valid until its next acquire(): replaced snapshots
+// are only freed by a later publish(), once the reader has moved on from
+// them.
+// publish() can be called from any thread, acquire() only from the reader.
+template <typename T> class SettingsStore {
+  private:
+    struct Retired {
+        std::unique_ptr<const T> snapshot;
+
+        // readerEpoch when it was replaced, the reader may still use it until
+        // the epoch moves past this
+        std::uint64_t epoch;
+    };
+
+    std::atomic<const T *> current;
+
+    // bumped whenever the reader lets go of the snapshot it held
+    std::atomic<std::uint64_t> readerEpoch{0};
+
+    // only touched by the reader
+    std::uint64_t readerEpochLocal = 0;
+    const T *held = nullptr;
+
+    std::mutex publishMutex; // guards retired, and orders publishers
+    std::vector<Retired> retired;
+
+  public:
+    explicit SettingsStore(T initial)
+        : current(new T(std::move(initial))) {}
+
+    ~SettingsStore() { delete current.load(); }
+
+    SettingsStore(const SettingsStore &) = delete;
+    SettingsStore &operator=(const SettingsStore &) = delete;
+
+    // only called from the reader thread. the returned snapshot stays valid
+    // until the next call.
+    const T &acquire() {
+        // while nothing has been published this is the only atomic access.
+        // the pointer is only compared, it may already have been replaced.
+        if (current.load() == held)
+            return *held;
+
+        // both are sequentially consistent: a publish() either sees the new
+        // epoch, or the load after it sees its snapshot
+        readerEpoch.store(++readerEpochLocal);
+        held = current.load();
+        return *held;
+    }
+
+    void publish(T snapshot) {
+        std::lock_guard<std::mutex> lock(publishMutex);
+
+        const T *previous = current.exchange(new T(std::move(snapshot)));
+        std::uint64_t epoch = readerEpoch.load();
+
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                     [epoch](const Retired &entry) {
+                                         return entry.epoch < epoch;
+                                     }),
+                      retired.end());
+        retired.push_back({std::unique_ptr<const T>(previous), epoch});
+    }
+};
@@ -0,0 +1,228 @@
+#include "SimulatedBackend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "DuckController.h"
+
+PeakCurve PeakCurves::constant(float level) {
+    return [level](double) { return level; };
+}
+
+PeakCurve PeakCurves::burst(double startMS, double durationMS, float level) {
+    return [=](double timeMS) {
+        return (timeMS >= startMS && timeMS < startMS + durationMS) ? level
+                                                                    : 0.0f;
+    };
+}
+
+PeakCurve PeakCurves::periodic(double periodMS, double onMS, float level) {
+    return [=](double timeMS) {
+        return (std::fmod(timeMS, periodMS) < onMS) ? level : 0.0f;
+    };
+}
+
+constexpr double SimulatedBackend::NOTIFICATION_RESOLUTION_MS;
+
+SimulatedBackend::SimulatedBackend(Clock &clock) : clock(clock) {
+    activityCallback = [&clock] { clock.wake(); };
+    sessions.setActivityCallback(activityCallback);
+}
+
+SessionKey SimulatedBackend::addSession(const std::wstring &name,
+                                        PeakCurve peak, float volume,
+                                        double startMS, double endMS,
+                                        size_t channels) {
+    auto session = std::make_shared<SimulatedSession>();
+    session->name = name;
+    session->nameId = names.intern(name);
+    session->peak = peak;
+    session->channels = channels;
+    session->volume = volume;
+    session->startMS = startMS;
+    session->endMS = endMS;
+    script.push_back(session);
+    return script.size();
+}
+
+std::shared_ptr<SimulatedBackend::SimulatedSession>
+SimulatedBackend::findScripted(const std::wstring &name) {
+    for (auto &session : script) {
+        if (session->name == name)
+            return session;
+    }
+    throw std::runtime_error("No scripted session with that name");
+}
+
+void SimulatedBackend::setCapture(PeakCurve peak, double startMS,
+                                  double endMS) {
+    capturePeak = peak;
+    captureStartMS = startMS;
+    captureEndMS = endMS;
+}
+
+size_t SimulatedBackend::getCapturePeakReadCount() const {
+    return capturePeakReadCount;
+}
+
+void SimulatedBackend::setTickJitter(double maxLateMS, std::uint32_t seed) {
+    tickJitterMS = maxLateMS;
+    jitterState = seed ? seed : 1;
+}
+
+double SimulatedBackend::nextTickJitterMS() {
+    if (tickJitterMS <= 0.0)
+        return 0.0;
+
+    // xorshift32
+    jitterState ^= jitterState << 13;
+    jitterState ^= jitterState >> 17;
+    jitterState ^= jitterState << 5;
+    return tickJitterMS * (jitterState / 4294967296.0);
+}
+
+size_t SimulatedBackend::run(DuckController &controller, double untilMS,
+                             bool bypassed) {
+    size_t ticks = 0;
+    while (clock.nowMS() < untilMS) {
+        double waitNeeded = controller.tick(bypassed);
+        ticks++;
+
+        // step through the wait so that scripted activity can cut it short, as
+        // a session notification would
+        double wakeMS = clock.nowMS() + waitNeeded + nextTickJitterMS();
+        // parked until activity, which may never come before untilMS
+        if (waitNeeded >= Clock::FOREVER_MS)
+            wakeMS = untilMS;
+        while (clock.nowMS() < wakeMS) {
+            double step = (std::min)(NOTIFICATION_RESOLUTION_MS,
+                                     wakeMS - clock.nowMS());
+            if (clock.waitMS(step))
+                break;
+            postScriptEvents();
+        }
+    }
+    return ticks;
+}
+
+float SimulatedBackend::getScriptedVolume(const std::wstring &name) {
+    return findScripted(name)->volume;
+}
+
+size_t SimulatedBackend::getScriptedVolumeSetCount(const std::wstring &name) {
+    return findScripted(name)->volumeSetCount;
+}
+
+double SimulatedBackend::getScriptedLastVolumeSetMS(const std::wstring &name) {
+    return findScripted(name)->lastVolumeSetMS;
+}
+
+size_t SimulatedBackend::getScriptedVolumeReadCount(const std::wstring &name) {
+    return findScripted(name)->volumeReadCount;
+}
+
+void SimulatedBackend::setScriptedVolume(const std::wstring &name,
+                                         float volume) {
+    auto session = findScripted(name);
+    session->volume = volume;
+    session->volumeChanges++;
+}
+
+void SimulatedBackend::postScriptEvents() {
+    double now = clock.nowMS();
+
+    // a session is active while its peak curve is above silence
+    for (size_t i = 0; i < script.size(); i++) {
+        auto &session = script[i];
+        SessionKey key = i + 1;
+
+        if (session->removed || now < session->startMS)
+            continue;
+
+        if (now >= session->endMS) {
+            if (session->added)
+                sessions.sessionRemoved(key);
+            session->removed = true;
+            continue;
+        }
+
+        SessionState state = (session->peak(now - session->startMS) > 0.0f)
+                                  ? SessionState::Active
+                                  : SessionState::Inactive;
+        if (!session->added) {
+            sessions.sessionAdded(key, state, session);
+            session->added = true;
+        } else if (state != session->state) {
+            sessions.sessionStateChanged(key, state);
+        }
+        session->state = state;
+    }
+
+    // the microphone is recorded from for the whole scripted span, whatever
+    // its level
+    bool wasCapturing = capturing;
+    capturing = capturePeak && now >= captureStartMS && now < captureEndMS;
+    if (capturing && !wasCapturing && activityCallback)
+        activityCallback();
+}
+
+bool SimulatedBackend::updateSessions() {
+    postScriptEvents();
+    return sessions.applyPendingEvents();
+}
+
+void SimulatedBackend::setActivityCallback(std::function<void()> callback) {
+    activityCallback = callback;
+    sessions.setActivityCallback(std::move(callback));
+}
+
+size_t SimulatedBackend::getSessionCount() { return sessions.size(); }
+
+SessionKey SimulatedBackend::getSessionKey(size_t index) {
+    return sessions[index].key;
+}
+
+SessionState SimulatedBackend::getSessionState(size_t index) {
+    return sessions[index].state;
+}
+
+NameId SimulatedBackend::getExecutableNameId(size_t index) {
+    return sessions[index].session->nameId;
+}
+
+size_t SimulatedBackend::getChannelPeakLevels(size_t index, float *levels,
+                                              size_t maxChannels) {
+    auto &session = sessions[index].session;
+    float level = session->peak(clock.nowMS() - session->startMS);
+
+    size_t count = (std::min)(session->channels, maxChannels);
+    std::fill(levels, levels + count, level);
+    return count;
+}
+
+float SimulatedBackend::getSessionVolume(size_t index) {
+    auto &session = sessions[index].session;
+    session->volumeReadCount++;
+    return session->volume;
+}
+
+void SimulatedBackend::setSessionVolume(size_t index, float volume) {
+    auto &session = sessions[index].session;
+    session->volume = volume;
+    session->volumeSetCount++;
+    session->lastVolumeSetMS = clock.nowMS();
+}
+
+std::uint32_t SimulatedBackend::getVolumeChangeCount(size_t index) {
+    return sessions[index].session->volumeChanges;
+}
+
+bool SimulatedBackend::getCapturePeakLevel(float &peak) {
+    if (!capturing)
+        return false;
+    capturePeakReadCount++;
+    peak = capturePeak(clock.nowMS() - captureStartMS);
+    return true;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Clock.h"
+#include "SessionRegistry.h"
+
+class DuckController;
+
+// peak level of a simulated session at the given time in ms since it started.
+// every channel of the session has the same level.
+using PeakCurve = std::function<float(double timeMS)>;
+
+// a few synthetic peak curves for scripting sessions
+namespace PeakCurves {
+// the same level for the whole lifetime of the session
+PeakCurve constant(float level);
+
+// silent except for level between startMS and startMS + durationMS
+PeakCurve burst(double startMS, double durationMS, float level);
+
+// level for the first onMS of every periodMS, silent otherwise
+PeakCurve periodic(double periodMS, double onMS, float level);
+} // namespace PeakCurves
+
+// simulatedbackend is a deterministic audio backend that plays back scripted
+// sessions against a clock, normally a VirtualClock, so the duck controller can
+// be run for hours of virtual time without any audio stack.
+// sessions appear and expire through the same session registry as the windows
+// backend, and session activity wakes the clock the same way notifications
+// wake the windows engine, so onset latency is measured the same way too.
+class SimulatedBackend : public AudioBackend {
+  private:
+    struct SimulatedSession {
+        std::wstring name;
+        NameId nameId;
+        PeakCurve peak;
+        size_t channels;
+        float volume;
+        double startMS;
+        double endMS;
+        SessionState state = SessionState::Inactive;
+        bool added = false;
+        bool removed = false;
+
+        // how many times the volume was set, and when it was last set
+        size_t volumeSetCount = 0;
+        double lastVolumeSetMS = -1.0;
+
+        // how many times the volume was read, and changed by the script
+        size_t volumeReadCount = 0;
+        std::uint32_t volumeChanges = 0;
+    };
+
+    Clock &clock;
+    std::vector<std::shared_ptr<SimulatedSession>> script;
+    SessionRegistry<std::shared_ptr<SimulatedSession>> sessions;
+    std::function<void()> activityCallback;
+
+    // the scripted microphone, recorded from between captureStartMS and
+    // captureEndMS
+    PeakCurve capturePeak;
+    double captureStartMS = 0.0;
+    double captureEndMS = 0.0;
+    bool capturing = false;
+    size_t capturePeakReadCount = 0;
+
+    // ticks wake up late by a pseudo-random amount up to this, like a real
+    // sleep would
+    double tickJitterMS = 0.0;
+    std::uint32_t jitterState = 1;
+    double nextTickJitterMS();
+
+    std::shared_ptr<SimulatedSession> findScripted(const std::wstring &name);
+
+    // post the events a real audio stack would have sent since the last call
+    void postScriptEvents();
+
+  public:
+    // how often the script is checked for activity while the controller waits,
+    // i.e. the latency of a simulated session notification
+    static constexpr double NOTIFICATION_RESOLUTION_MS = 1.0;
+
+    // session activity wakes the given clock unless another activity callback
+    // is set
+    SimulatedBackend(Clock &clock);
+
+    // script a session that exists from startMS until endMS on the clock and
+    // whose peak level follows the given curve. returns the session id.
+    SessionKey addSession(const std::wstring &name, PeakCurve peak,
+                          float volume = 1.0f, double startMS = 0.0,
+                          double endMS = 1e300, size_t channels = 2);
+
+    // script a program recording from the microphone from startMS until
+    // endMS on the clock, with the microphone level following the given curve
+    // (in ms since startMS). the recording starting wakes the clock like
+    // session activity.
+    void setCapture(PeakCurve peak, double startMS = 0.0,
+                    double endMS = 1e300);
+
+    // number of times the microphone level was read
+    size_t getCapturePeakReadCount() const;
+
+    // make every wait between ticks run late by up to maxLateMS. the amounts
+    // come from a fixed seed, so runs stay deterministic.
+    void setTickJitter(double maxLateMS, std::uint32_t seed = 1);
+
+    // run the controller against this backend until the clock reaches
+    // untilMS, waiting between ticks as the controller requests, or until
+    // session activity wakes the clock. returns the number of ticks run.
+    size_t run(DuckController &controller, double untilMS,
+               bool bypassed = false);
+
+    // current volume, number of volume changes and time of the last volume
+    // change of the first scripted session with the given name
+    float getScriptedVolume(const std::wstring &name);
+    size_t getScriptedVolumeSetCount(const std::wstring &name);
+    double getScriptedLastVolumeSetMS(const std::wstring &name);
+
+    // number of times the volume of the first scripted session with the given
+    // name was read
+    size_t getScriptedVolumeReadCount(const std::wstring &name);
+
+    // change the volume of the first scripted session with the given name
+    // from outside, as the user would in the mixer
+    void setScriptedVolume(const std::wstring &name, float volume);
+
+    bool updateSessions() override;
+    void setActivityCallback(std::function<void()> callback) override;
+
+    size_t getSessionCount() override;
+    SessionKey getSessionKey(size_t index) override;
+    SessionState getSessionState(size_t index) override;
+    NameId getExecutableNameId(size_t index) override;
+    size_t getChannelPeakLevels(size_t index, float *levels,
+                                size_t maxChannels) override;
+    float getSessionVolume(size_t index) override;
+    void setSessionVolume(size_t index, float volume) override;
+    std::uint32_t getVolumeChangeCount(size_t index) override;
+    bool getCapturePeakLevel(float &peak) override;
+};
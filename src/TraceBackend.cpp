@@ -0,0 +1,291 @@
+#include "TraceBackend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "DuckController.h"
+
+template <typename T> static T readField(const std::uint8_t *bytes) {
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+TraceBackend::TraceBackend(Clock &clock, const std::uint8_t *data,
+                           size_t size)
+    : clock(clock), data(data) {
+    if (size < TRACE_HEADER_BYTES ||
+        readField<std::uint32_t>(data) != TRACE_MAGIC)
+        throw std::runtime_error("Not a trace file");
+    if (readField<std::uint32_t>(data + 4) != TRACE_VERSION)
+        throw std::runtime_error("Unsupported trace version");
+
+    scan(size);
+}
+
+size_t TraceBackend::decode(size_t offset, Record &record) const {
+    if (offset >= size)
+        return 0;
+    const std::uint8_t *bytes = data + offset;
+    size_t left = size - offset;
+
+    record.type = (TraceRecord)bytes[0];
+    switch (record.type) {
+    case TraceRecord::Tick:
+        if (left < 9)
+            return 0;
+        record.timeMS = readField<double>(bytes + 1);
+        return 9;
+    case TraceRecord::Sessions: {
+        if (left < 3)
+            return 0;
+        record.count = readField<std::uint16_t>(bytes + 1);
+        record.payload = bytes + 3;
+        size_t length = 3 + record.count * TRACE_SESSION_BYTES;
+        return (left < length) ? 0 : length;
+    }
+    case TraceRecord::Name: {
+        if (left < 7)
+            return 0;
+        record.number = readField<std::uint32_t>(bytes + 1);
+        record.count = readField<std::uint16_t>(bytes + 5);
+        record.payload = bytes + 7;
+        size_t length = 7 + record.count * 2;
+        return (left < length) ? 0 : length;
+    }
+    case TraceRecord::Peaks: {
+        if (left < 4)
+            return 0;
+        record.number = readField<std::uint16_t>(bytes + 1);
+        record.count = bytes[3];
+        record.payload = bytes + 4;
+        size_t length = 4 + record.count * 2;
+        return (left < length) ? 0 : length;
+    }
+    case TraceRecord::VolumeRead:
+    case TraceRecord::VolumeWrite:
+        if (left < 7)
+            return 0;
+        record.number = readField<std::uint16_t>(bytes + 1);
+        record.volume = readField<float>(bytes + 3);
+        return 7;
+    case TraceRecord::Command:
+        if (left < 10)
+            return 0;
+        record.timeMS = readField<double>(bytes + 1);
+        record.number = bytes[9];
+        return 10;
+    }
+    throw std::runtime_error("Unknown record at byte " +
+                             std::to_string(offset) + " of the trace");
+}
+
+void TraceBackend::scan(size_t fullSize) {
+    size = fullSize;
+
+    std::unordered_map<SessionKey, SessionState> states;
+    bool ticked = false;
+    double tickMS = 0.0;
+
+    size_t offset = TRACE_HEADER_BYTES;
+    Record record;
+    while (size_t length = decode(offset, record)) {
+        if (record.type == TraceRecord::Tick) {
+            if (!ticked)
+                startMS = record.timeMS;
+            ticked = true;
+            tickMS = endMS = record.timeMS;
+        } else if (record.type == TraceRecord::Command) {
+            auto kind = record.number == 0 ? CommandKind::Duck
+                                           : CommandKind::Unduck;
+            recordedCommands.push_back({record.timeMS, kind});
+        } else if (record.type == TraceRecord::Sessions) {
+            std::unordered_map<SessionKey, SessionState> newStates;
+            bool activity = false;
+            for (size_t i = 0; i < record.count; i++) {
+                auto entry = record.payload + i * TRACE_SESSION_BYTES;
+                auto key = (SessionKey)readField<std::uint64_t>(entry);
+                auto state = (SessionState)entry[12];
+
+                auto previous = states.find(key);
+                activity = activity || previous == states.end() ||
+                           (state == SessionState::Active &&
+                            previous->second != SessionState::Active);
+                newStates[key] = state;
+            }
+            if (activity)
+                activityMS.push_back(tickMS);
+            states = std::move(newStates);
+        }
+        offset += length;
+    }
+    size = offset;
+
+    for (auto &command : recordedCommands)
+        command.timeMS -= startMS;
+    for (auto &activity : activityMS)
+        activity -= startMS;
+}
+
+double TraceBackend::getDurationMS() const { return endMS - startMS; }
+
+const std::vector<TraceBackend::Command> &
+TraceBackend::getRecordedCommands() const {
+    return recordedCommands;
+}
+
+size_t TraceBackend::run(DuckController &controller, double untilMS) {
+    size_t ticks = 0;
+    while (clock.nowMS() < untilMS) {
+        double waitNeeded = controller.tick(false);
+        ticks++;
+
+        // recorded activity cuts the wait short, as a session notification
+        // would
+        double now = clock.nowMS();
+        double wakeMS = (std::min)(now + waitNeeded, untilMS);
+        auto next = std::upper_bound(activityMS.begin(), activityMS.end(), now);
+        if (next != activityMS.end())
+            wakeMS = (std::min)(wakeMS, *next);
+        clock.waitMS(wakeMS - now);
+    }
+    return ticks;
+}
+
+void TraceBackend::applyName(const Record &record) {
+    std::wstring name;
+    for (size_t i = 0; i < record.count; i++)
+        name += (wchar_t)readField<std::uint16_t>(record.payload + i * 2);
+
+    if (nameIds.size() <= record.number)
+        nameIds.resize(record.number + 1, (NameId)NameTable::Unknown);
+    nameIds[record.number] = names.intern(name);
+}
+
+void TraceBackend::applySessions(const Record &record) {
+    std::unordered_map<SessionKey, size_t> previous;
+    for (size_t i = 0; i < sessions.size(); i++)
+        previous[sessions[i].key] = i;
+
+    std::vector<ReplaySession> updated(record.count);
+    for (size_t i = 0; i < record.count; i++) {
+        auto entry = record.payload + i * TRACE_SESSION_BYTES;
+        auto &session = updated[i];
+        session.key = (SessionKey)readField<std::uint64_t>(entry);
+        auto nameId = readField<std::uint32_t>(entry + 8);
+        session.nameId =
+            (nameId < nameIds.size()) ? nameIds[nameId] : NameTable::Unknown;
+        session.state = (SessionState)entry[12];
+
+        // volumes carry over, the meters are read again on this tick
+        auto found = previous.find(session.key);
+        if (found != previous.end()) {
+            auto &old = sessions[found->second];
+            session.recordedVolume = old.recordedVolume;
+            session.volumeSet = old.volumeSet;
+            session.volume = old.volume;
+            session.volumeChanges = old.volumeChanges;
+        }
+    }
+    sessions = std::move(updated);
+}
+
+TraceBackend::ReplaySession *
+TraceBackend::getRecordSession(const Record &record) {
+    return (record.number < sessions.size()) ? &sessions[record.number]
+                                             : nullptr;
+}
+
+bool TraceBackend::updateSessions() {
+    double now = startMS + clock.nowMS();
+    bool changed = false;
+
+    Record record;
+    while (size_t length = decode(position, record)) {
+        if (record.type == TraceRecord::Tick) {
+            if (record.timeMS > now)
+                break;
+            for (auto &session : sessions)
+                session.channels = 0;
+        } else if (record.type == TraceRecord::Sessions) {
+            applySessions(record);
+            changed = true;
+        } else if (record.type == TraceRecord::Name) {
+            applyName(record);
+        } else if (record.type == TraceRecord::Peaks) {
+            if (auto session = getRecordSession(record)) {
+                session->channels =
+                    (std::min)(record.count, LevelDetector::MAX_CHANNELS);
+                for (size_t i = 0; i < session->channels; i++) {
+                    session->peaks[i] =
+                        readField<std::uint16_t>(record.payload + i * 2) /
+                        TRACE_PEAK_SCALE;
+                }
+            }
+        } else if (record.type == TraceRecord::VolumeRead) {
+            // the recording controller only reads volumes it does not know,
+            // so a read that differs was changed from outside
+            auto session = getRecordSession(record);
+            if (session && session->recordedVolume != record.volume) {
+                session->recordedVolume = record.volume;
+                session->volumeSet = false;
+                session->volumeChanges++;
+            }
+        } else if (record.type == TraceRecord::VolumeWrite) {
+            if (auto session = getRecordSession(record))
+                session->recordedVolume = record.volume;
+        }
+        position += length;
+    }
+    return changed;
+}
+
+void TraceBackend::setActivityCallback(std::function<void()>) {
+    // recorded activity wakes the replay in run() instead
+}
+
+size_t TraceBackend::getSessionCount() { return sessions.size(); }
+
+SessionKey TraceBackend::getSessionKey(size_t index) {
+    return sessions[index].key;
+}
+
+SessionState TraceBackend::getSessionState(size_t index) {
+    return sessions[index].state;
+}
+
+NameId TraceBackend::getExecutableNameId(size_t index) {
+    return sessions[index].nameId;
+}
+
+size_t TraceBackend::getChannelPeakLevels(size_t index, float *levels,
+                                          size_t maxChannels) {
+    auto &session = sessions[index];
+    if (session.channels == 0 && maxChannels > 0) {
+        levels[0] = 0.0f;
+        return 1;
+    }
+
+    size_t count = (std::min)(session.channels, maxChannels);
+    std::copy(session.peaks, session.peaks + count, levels);
+    return count;
+}
+
+float TraceBackend::getSessionVolume(size_t index) {
+    auto &session = sessions[index];
+    return session.volumeSet ? session.volume : session.recordedVolume;
+}
+
+void TraceBackend::setSessionVolume(size_t index, float volume) {
+    auto &session = sessions[index];
+    session.volumeSet = true;
+    session.volume = volume;
+}
+
+std::uint32_t TraceBackend::getVolumeChangeCount(size_t index) {
+    return sessions[index].volumeChanges;
+}
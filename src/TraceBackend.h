@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Clock.h"
+#include "CommandExecutor.h"
+#include "LevelDetector.h"
+#include "TraceFormat.h"
+
+class DuckController;
+
+// tracebackend replays a trace recorded by TraceRecorder (see TraceFormat.h)
+// against a clock, normally a VirtualClock, so a duck controller with other
+// settings can be run over real audio as fast as it ticks. the trace is read
+// in place, e.g. from a memory-mapped file, which must outlive the backend.
+// each tick sees the sessions and meters of the latest recorded tick at or
+// before the clock's time, where the clock's 0 is the start of the trace.
+// volumes written by the replayed controller read back as written, volumes it
+// never wrote read as recorded. a recorded read that differs from the volume
+// last recorded is taken as a change from outside, which the replay then
+// reads back as recorded too.
+// only the meters the recording controller read are in the trace. the others,
+// e.g. of sessions it excluded or targets it did not sample, read as silent,
+// so replaying with a different set of such sessions is only approximate.
+class TraceBackend : public AudioBackend {
+  public:
+    // a command the recording controller ran, at ms from the trace start
+    struct Command {
+        double timeMS;
+        CommandKind kind;
+    };
+
+  private:
+    struct ReplaySession {
+        SessionKey key;
+        NameId nameId;
+        SessionState state;
+
+        // meter read at the current recorded tick, none if it was not read
+        size_t channels = 0;
+        float peaks[LevelDetector::MAX_CHANNELS];
+
+        float recordedVolume = 1.0f;
+        bool volumeSet = false;
+        float volume = 1.0f;
+        std::uint32_t volumeChanges = 0;
+    };
+
+    // a record decoded in place, the fields used depend on its type
+    struct Record {
+        TraceRecord type;
+        double timeMS = 0.0;
+        std::uint32_t number = 0; // name id, session index or command kind
+        size_t count = 0;         // sessions, name length or channels
+        const std::uint8_t *payload = nullptr;
+        float volume = 0.0f;
+    };
+
+    Clock &clock;
+    const std::uint8_t *data;
+
+    // bytes up to the end of the last whole record, a trace cut short by the
+    // recording being killed is replayed up to there
+    size_t size = 0;
+
+    double startMS = 0.0;
+    double endMS = 0.0;
+    std::vector<Command> recordedCommands;
+
+    // ms from the start at which a session was added or became active, which
+    // wakes the replay like a session notification would
+    std::vector<double> activityMS;
+
+    size_t position = TRACE_HEADER_BYTES;
+    std::vector<ReplaySession> sessions;
+
+    // names of the replay by trace name id
+    std::vector<NameId> nameIds;
+
+    // decode the record at offset, returns its size or 0 if it is cut short.
+    // throws if it is not a record.
+    size_t decode(size_t offset, Record &record) const;
+
+    // one pass over the trace for its length, commands and activity
+    void scan(size_t fullSize);
+
+    void applySessions(const Record &record);
+    void applyName(const Record &record);
+    ReplaySession *getRecordSession(const Record &record);
+
+  public:
+    // throws std::runtime_error if the data is not a trace
+    TraceBackend(Clock &clock, const std::uint8_t *data, size_t size);
+
+    // length of the trace in ms
+    double getDurationMS() const;
+
+    const std::vector<Command> &getRecordedCommands() const;
+
+    // run the controller against the trace until the clock reaches untilMS,
+    // waiting between ticks as the controller requests or until recorded
+    // activity. returns the number of ticks run.
+    size_t run(DuckController &controller, double untilMS);
+
+    bool updateSessions() override;
+    void setActivityCallback(std::function<void()> callback) override;
+
+    size_t getSessionCount() override;
+    SessionKey getSessionKey(size_t index) override;
+    SessionState getSessionState(size_t index) override;
+    NameId getExecutableNameId(size_t index) override;
+    size_t getChannelPeakLevels(size_t index, float *levels,
+                                size_t maxChannels) override;
+    float getSessionVolume(size_t index) override;
+    void setSessionVolume(size_t index, float volume) override;
+    std::uint32_t getVolumeChangeCount(size_t index) override;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// a trace is what the duck controller read from and wrote to the audio
+// backend, recorded by TraceRecorder and replayed by TraceBackend.
+// a trace file starts with TRACE_MAGIC and TRACE_VERSION, followed by records
+// appended one after another. each record is a TraceRecord byte and the fields
+// listed next to it, packed without padding in little endian order (the
+// native order of every platform this runs on). times are ms on the
+// recording clock.
+// the records of a tick follow its Tick record. session indices refer to the
+// list of the latest Sessions record, which is written on every tick the
+// sessions changed, after a Name record for every name it uses for the first
+// time.
+static const std::uint32_t TRACE_MAGIC = 0x54424441; // "ADBT"
+static const std::uint32_t TRACE_VERSION = 1;
+
+enum class TraceRecord : std::uint8_t {
+    Tick = 1,        // f64 time
+    Sessions = 2,    // u16 count, count * (u64 key, u32 name id, u8 state)
+    Name = 3,        // u32 name id, u16 length, length * u16 utf-16 unit
+    Peaks = 4,       // u16 session, u8 channels, channels * u16 peak
+    VolumeRead = 5,  // u16 session, f32 volume
+    VolumeWrite = 6, // u16 session, f32 volume
+    Command = 7,     // f64 time, u8 CommandKind
+};
+
+static const size_t TRACE_HEADER_BYTES = 8;
+static const size_t TRACE_SESSION_BYTES = 13;
+
+// peaks are stored as a fraction of this, which keeps 1/65535 of resolution
+static const float TRACE_PEAK_SCALE = 65535.0f;
+
+// sessions past this many are left out of the trace
+static const size_t TRACE_MAX_SESSIONS = 0xffff;
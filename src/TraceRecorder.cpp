@@ -0,0 +1,165 @@
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "Log.h"
+
+const size_t TraceRecorder::BUFFER_BYTES;
+
+TraceRecorder::TraceRecorder(AudioBackend &inner, Clock &clock)
+    : inner(inner), clock(clock) {}
+
+void TraceRecorder::start(std::ostream &out) {
+    this->out = &out;
+    buffer.clear();
+    buffer.reserve(BUFFER_BYTES);
+    namesWritten.clear();
+    sessionsPending = true;
+
+    put(TRACE_MAGIC);
+    put(TRACE_VERSION);
+}
+
+void TraceRecorder::stop() {
+    if (!out)
+        return;
+    flush(true);
+    out->flush();
+    out = nullptr;
+}
+
+void TraceRecorder::flush(bool force) {
+    // half the buffer is kept free for the records of the next tick, so they
+    // fit without growing it
+    if (!out || buffer.empty() ||
+        (!force && buffer.size() < BUFFER_BYTES / 2))
+        return;
+
+    out->write(buffer.data(), (std::streamsize)buffer.size());
+    buffer.clear();
+
+    // a failing disk should not stop the ducking, only the recording
+    if (!*out) {
+        LOG_WARNING("failed to write the trace, recording stopped");
+        out = nullptr;
+    }
+}
+
+void TraceRecorder::recordCommand(CommandKind kind) {
+    if (!out)
+        return;
+    putRecord(TraceRecord::Command);
+    put(clock.nowMS());
+    put((std::uint8_t)kind);
+}
+
+void TraceRecorder::writeSessions() {
+    auto &names = inner.getNameTable();
+    size_t count = (std::min)(inner.getSessionCount(), TRACE_MAX_SESSIONS);
+
+    if (namesWritten.size() < names.size())
+        namesWritten.resize(names.size(), false);
+    for (size_t i = 0; i < count; i++) {
+        NameId id = inner.getExecutableNameId(i);
+        if (namesWritten[id])
+            continue;
+
+        auto &name = names.getName(id);
+        size_t length = (std::min)(name.size(), (size_t)0xffff);
+        putRecord(TraceRecord::Name);
+        put((std::uint32_t)id);
+        put((std::uint16_t)length);
+        for (size_t c = 0; c < length; c++)
+            put((std::uint16_t)name[c]);
+        namesWritten[id] = true;
+    }
+
+    putRecord(TraceRecord::Sessions);
+    put((std::uint16_t)count);
+    for (size_t i = 0; i < count; i++) {
+        put((std::uint64_t)inner.getSessionKey(i));
+        put((std::uint32_t)inner.getExecutableNameId(i));
+        put((std::uint8_t)inner.getSessionState(i));
+    }
+}
+
+bool TraceRecorder::updateSessions() {
+    bool changed = inner.updateSessions();
+    if (!out)
+        return changed;
+
+    flush(false);
+    putRecord(TraceRecord::Tick);
+    put(clock.nowMS());
+    if (changed || sessionsPending) {
+        writeSessions();
+        sessionsPending = false;
+    }
+    return changed;
+}
+
+void TraceRecorder::setActivityCallback(std::function<void()> callback) {
+    inner.setActivityCallback(std::move(callback));
+}
+
+NameTable &TraceRecorder::getNameTable() { return inner.getNameTable(); }
+
+size_t TraceRecorder::getSessionCount() { return inner.getSessionCount(); }
+
+SessionKey TraceRecorder::getSessionKey(size_t index) {
+    return inner.getSessionKey(index);
+}
+
+SessionState TraceRecorder::getSessionState(size_t index) {
+    return inner.getSessionState(index);
+}
+
+NameId TraceRecorder::getExecutableNameId(size_t index) {
+    return inner.getExecutableNameId(index);
+}
+
+size_t TraceRecorder::getChannelPeakLevels(size_t index, float *levels,
+                                           size_t maxChannels) {
+    size_t channels = inner.getChannelPeakLevels(index, levels, maxChannels);
+    if (!out || index >= TRACE_MAX_SESSIONS)
+        return channels;
+
+    putRecord(TraceRecord::Peaks);
+    put((std::uint16_t)index);
+    put((std::uint8_t)(std::min)(channels, (size_t)0xff));
+    for (size_t channel = 0; channel < channels && channel < 0xff;
+         channel++) {
+        float peak = (std::min)((std::max)(levels[channel], 0.0f), 1.0f);
+        put((std::uint16_t)std::lround(peak * TRACE_PEAK_SCALE));
+    }
+    return channels;
+}
+
+float TraceRecorder::getSessionVolume(size_t index) {
+    float volume = inner.getSessionVolume(index);
+    if (out && index < TRACE_MAX_SESSIONS) {
+        putRecord(TraceRecord::VolumeRead);
+        put((std::uint16_t)index);
+        put(volume);
+    }
+    return volume;
+}
+
+void TraceRecorder::setSessionVolume(size_t index, float volume) {
+    inner.setSessionVolume(index, volume);
+    if (out && index < TRACE_MAX_SESSIONS) {
+        putRecord(TraceRecord::VolumeWrite);
+        put((std::uint16_t)index);
+        put(volume);
+    }
+}
+
+std::uint32_t TraceRecorder::getVolumeChangeCount(size_t index) {
+    return inner.getVolumeChangeCount(index);
+}
+
+bool TraceRecorder::getCapturePeakLevel(float &peak) {
+    return inner.getCapturePeakLevel(peak);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Clock.h"
+#include "CommandExecutor.h"
+#include "TraceFormat.h"
+
+// tracerecorder is an audio backend that passes every call through to another
+// backend and, while started, records what the duck controller read and wrote
+// into a binary trace (see TraceFormat.h): the sessions, the meters and
+// volumes read on each tick, the volumes written and the commands run. a trace
+// can be replayed with other settings by TraceBackend, see
+// tools/TraceReplay.cpp.
+// records are gathered in a buffer that is only written out once it fills, so
+// recording a tick neither allocates nor usually touches the stream. the
+// controller is only given a recorder when recording, so it costs nothing
+// otherwise.
+// only use from the engine thread.
+class TraceRecorder : public AudioBackend {
+  private:
+    static const size_t BUFFER_BYTES = 64 * 1024;
+
+    AudioBackend &inner;
+    Clock &clock;
+    std::ostream *out = nullptr;
+
+    std::vector<char> buffer;
+
+    // whether a Name record was written, by name id
+    std::vector<bool> namesWritten;
+
+    // the next tick writes a Sessions record even if nothing changed
+    bool sessionsPending = false;
+
+    template <typename T> void put(T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putRecord(TraceRecord type) { put((std::uint8_t)type); }
+
+    void writeSessions();
+
+    // write the buffer out if it is half full, or regardless if forced
+    void flush(bool force);
+
+  public:
+    TraceRecorder(AudioBackend &inner, Clock &clock);
+
+    // start recording a new trace into out, which must stay open until
+    // stop()
+    void start(std::ostream &out);
+
+    // write out what is buffered and stop recording
+    void stop();
+
+    bool isRecording() const { return out != nullptr; }
+
+    // record a command run by the controller
+    void recordCommand(CommandKind kind);
+
+    bool updateSessions() override;
+    void setActivityCallback(std::function<void()> callback) override;
+    NameTable &getNameTable() override;
+
+    size_t getSessionCount() override;
+    SessionKey getSessionKey(size_t index) override;
+    SessionState getSessionState(size_t index) override;
+    NameId getExecutableNameId(size_t index) override;
+    size_t getChannelPeakLevels(size_t index, float *levels,
+                                size_t maxChannels) override;
+    float getSessionVolume(size_t index) override;
+    void setSessionVolume(size_t index, float volume) override;
+    std::uint32_t getVolumeChangeCount(size_t index) override;
+
+    // passed through but not recorded, so replays never hear the microphone
+    bool getCapturePeakLevel(float &peak) override;
+};
@@ -34,7 +34,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
             break;
 
         case ID_TRAYMENU_RELOAD_SETTINGS:
-            Engine::get()->readSettingsINI();
+            Engine::get()->requestReloadSettings();
             break;
 
         case ID_TRAYMENU_TOGGLE:
@@ -44,6 +44,27 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam,
         }
         break;
 
+    case WM_POWERBROADCAST:
+        // registered for in runUI()
+        if (wParam == PBT_POWERSETTINGCHANGE) {
+            auto setting = (const POWERBROADCAST_SETTING *)lParam;
+            DWORD value = *(const DWORD *)setting->Data;
+            // 0 is mains power, anything else a battery or ups
+            if (setting->PowerSetting == GUID_ACDC_POWER_SOURCE)
+                Engine::get()->setOnBattery(value != 0);
+            // 0 is off, 1 on and 2 dimmed
+            else if (setting->PowerSetting == GUID_CONSOLE_DISPLAY_STATE)
+                Engine::get()->setDisplayOff(value == 0);
+        }
+        return TRUE;
+
+    case WM_WTSSESSION_CHANGE:
+        if (wParam == WTS_SESSION_LOCK)
+            Engine::get()->setSessionLocked(true);
+        else if (wParam == WTS_SESSION_UNLOCK)
+            Engine::get()->setSessionLocked(false);
+        break;
+
     case WM_QUERYENDSESSION:
         // windows is asking if this app can exit when shutdown
         return TRUE;
@@ -102,6 +123,42 @@ void createContextMenu(HWND hwnd) {
                 MF_BYCOMMAND | MF_STRING | MF_DISABLED, ID_TRAYMENU_STATUSTEXT,
                 Engine::get()->getShortStatusString().c_str());
 
+    // show how often each thread wakes up below the status
+    std::wstring wakeupsString =
+        L"Wakeups per minute: " +
+        std::to_wstring((int)Engine::get()->getWakeupsPerMinute()) +
+        L" engine, " + std::to_wstring((int)uiWakeups.getPerMinute()) +
+        L" UI";
+    InsertMenuW(hSubMenu, ID_TRAYMENU_STATUSTEXT,
+                MF_BYCOMMAND | MF_STRING | MF_DISABLED, 0,
+                wakeupsString.c_str());
+
+    // and how many audio devices are watched
+    std::wstring devicesString =
+        L"Audio devices: " + std::to_wstring(Engine::get()->getEndpointCount());
+    double rebindLatencyMS = Engine::get()->getRebindLatencyMS();
+    if (rebindLatencyMS >= 0.0)
+        devicesString += L", last change handled in " +
+                         std::to_wstring((int)(rebindLatencyMS + 0.5)) +
+                         L" ms";
+    InsertMenuW(hSubMenu, ID_TRAYMENU_STATUSTEXT,
+                MF_BYCOMMAND | MF_STRING | MF_DISABLED, 0,
+                devicesString.c_str());
+
+    // and a summary of the metrics
+    InsertMenuW(hSubMenu, ID_TRAYMENU_STATUSTEXT,
+                MF_BYCOMMAND | MF_STRING | MF_DISABLED, 0,
+                Engine::get()->getMetricsSummary().c_str());
+    InsertMenuW(hSubMenu, ID_TRAYMENU_STATUSTEXT,
+                MF_BYCOMMAND | MF_STRING | MF_DISABLED, 0,
+                Engine::get()->getPipelineSummary().c_str());
+    InsertMenuW(hSubMenu, ID_TRAYMENU_STATUSTEXT,
+                MF_BYCOMMAND | MF_STRING | MF_DISABLED, 0,
+                Engine::get()->getVolumeWriteSummary().c_str());
+    InsertMenuW(hSubMenu, ID_TRAYMENU_STATUSTEXT,
+                MF_BYCOMMAND | MF_STRING | MF_DISABLED, 0,
+                Engine::get()->getPowerSummary().c_str());
+
     // show the menu at the appropriate point based on cursor pos
     POINT pt;
     GetCursorPos(&pt);
@@ -124,20 +181,40 @@ void runUI() {
 
     createTrayIcon(hwnd);
 
-    // handle messages while a quit is not requested...
+    // the power source, display and lock state pick the power profile of the
+    // engine. power settings are also sent once straight away.
+    HPOWERNOTIFY powerSourceNotify = RegisterPowerSettingNotification(
+        hwnd, &GUID_ACDC_POWER_SOURCE, DEVICE_NOTIFY_WINDOW_HANDLE);
+    HPOWERNOTIFY displayNotify = RegisterPowerSettingNotification(
+        hwnd, &GUID_CONSOLE_DISPLAY_STATE, DEVICE_NOTIFY_WINDOW_HANDLE);
+    WTSRegisterSessionNotification(hwnd, NOTIFY_FOR_THIS_SESSION);
+
+    // block until there are messages or a quit is requested...
     MSG msg{};
-    while (!quitRequested) {
-        // cannot use GetMessage as it blocks the while loop so we cant quit
-        // from other threads...
-        if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+    while (true) {
+        DWORD wait = MsgWaitForMultipleObjects(1, &quitEvent, FALSE, INFINITE,
+                                               QS_ALLINPUT);
+        uiWakeups.wakeup((double)GetTickCount64());
+
+        if (wait != WAIT_OBJECT_0 + 1)
+            break; // quit requested, or the wait failed
+
+        // a wait only reports messages that arrived since the last wait, so
+        // empty the queue each time
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
             TranslateMessage(&msg);
             DispatchMessage(&msg);
         }
-        Sleep((DWORD)(UI_POLL_RATE_MS));
     }
+
+    WTSUnRegisterSessionNotification(hwnd);
+    if (displayNotify)
+        UnregisterPowerSettingNotification(displayNotify);
+    if (powerSourceNotify)
+        UnregisterPowerSettingNotification(powerSourceNotify);
 }
 
-void createErrorBox(std::wstring &errorString) {
+void createErrorBox(const std::wstring &errorString) {
     std::wstring errorStringFormatted = L"Fatal error:\n";
     errorStringFormatted += errorString;
 
@@ -156,9 +233,12 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 }
 
 int run() {
-    uiThread = std::thread(runUI);
+    quitEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
 
+    // create the engine before the ui thread can use it
     auto engine = Engine::get();
+
+    uiThread = std::thread(runUI);
     if (engine->running())
         createErrorBox(engine->getErrorString());
 
@@ -168,12 +248,14 @@ int run() {
     int error = (engine->hasError()) ? 1 : 0;
     engine = nullptr; // to call deconstructor
 
+    CloseHandle(quitEvent);
+
     return error;
 }
 
 void quit() {
-    // technically, this can be called from multiple threads, but as the values
-    // are only ever getting changed to true, there should be no need for mutex
-    quitRequested = true;
+    // can be called from either thread, both requests wake the thread they
+    // are meant for
+    SetEvent(quitEvent);
     Engine::get()->requestQuit();
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <windows.h>
+#include <wtsapi32.h>
+
 #include "resource.h"
 
 #include "Engine.h"
@@ -9,11 +12,12 @@ static HWND hwnd;
 
 static std::thread uiThread;
 
-// the poll rate to check and process new messages in ms
-static const float UI_POLL_RATE_MS = 50.0f;
+// set when quitting is requested from any thread. the ui thread waits on this
+// alongside its message queue, so it only wakes up when there is work to do.
+static HANDLE quitEvent;
 
-// use for handling when quitting is requested from across multiple threads
-static bool quitRequested = false;
+// how often the ui thread wakes up
+static WakeupCounter uiWakeups;
 
 int main(); // console entry point (debug)
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
@@ -25,7 +29,7 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
 
 void createTrayIcon(HWND hwnd);
 void createContextMenu(HWND hwnd);
-void createErrorBox(std::wstring &errorString);
+void createErrorBox(const std::wstring &errorString);
 
 // function that handles creating ui and processing messages.
 // should run on a separate thread.
@@ -0,0 +1,24 @@
+#include "VoiceGate.h"
+
+#include <algorithm>
+
+void VoiceGate::configure(float openLevel, float closeLevel,
+                          double hangoverMS) {
+    this->openLevel = openLevel;
+    this->closeLevel = (std::min)(closeLevel, openLevel);
+    this->hangoverMS = (std::max)(hangoverMS, 0.0);
+}
+
+bool VoiceGate::sample(double nowMS, float peak) {
+    if (peak >= (open ? closeLevel : openLevel)) {
+        open = true;
+        lastVoiceMS = nowMS;
+    } else if (open && nowMS - lastVoiceMS >= hangoverMS) {
+        open = false;
+    }
+    return open;
+}
+
+void VoiceGate::reset() { open = false; }
+
+bool VoiceGate::isOpen() const { return open; }
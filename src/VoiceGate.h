@@ -0,0 +1,31 @@
+#pragma once
+
+// voicegate decides from the peak level of the microphone whether someone is
+// talking into it. the gate opens on the first sample at or above the open
+// level, so speech is caught within a single sample, and stays open while the
+// samples stay at or above the lower close level. it then holds open for the
+// hangover time after the last of them, so it does not close in the pauses
+// between words.
+// a sample is a few comparisons and makes no allocations.
+class VoiceGate {
+  private:
+    float openLevel = 0.1f;
+    float closeLevel = 0.05f;
+    double hangoverMS = 400.0;
+
+    bool open = false;
+    double lastVoiceMS = 0.0;
+
+  public:
+    // a close level above the open level is taken as the open level
+    void configure(float openLevel, float closeLevel, double hangoverMS);
+
+    // feed the peak level of the microphone at nowMS. returns whether the gate
+    // is open.
+    bool sample(double nowMS, float peak);
+
+    // close the gate straight away, e.g. when nothing records the microphone
+    void reset();
+
+    bool isOpen() const;
+};
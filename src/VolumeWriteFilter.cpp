@@ -0,0 +1,103 @@
+#include "VolumeWriteFilter.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "Fade.h"
+
+constexpr double VolumeWriteFilter::SETTLE_MS;
+
+// sessions not written to for this long are forgotten, their next write is
+// then always made
+static const double FORGET_AFTER_MS = 600000.0;
+
+void VolumeWriteFilter::configure(float stepDB, double intervalMS) {
+    this->stepDB = (std::max)(stepDB, 0.0f);
+    this->intervalMS = (std::max)(intervalMS, 0.0);
+}
+
+int VolumeWriteFilter::getStep(float volume) const {
+    // silence is a step of its own, so muting is always written
+    if (volume <= 0.0f)
+        return INT_MIN;
+    float decibels = 20.0f * std::log10(volume);
+    if (decibels <= FADE_DECIBEL_FLOOR)
+        return INT_MIN;
+    return (int)std::floor(decibels / stepDB);
+}
+
+void VolumeWriteFilter::setWritten(SessionWrites &session, float volume,
+                                   double nowMS) {
+    session.written = volume;
+    session.step = (stepDB > 0.0f) ? getStep(volume) : 0;
+    session.writtenMS = nowMS;
+    session.held = false;
+}
+
+VolumeWriteDecision VolumeWriteFilter::offer(SessionKey key, float volume,
+                                             std::uint32_t changes,
+                                             double nowMS) {
+    auto found = sessions.find(key);
+    if (found == sessions.end() || found->second.changes != changes) {
+        // a session changed from outside may be at any volume now
+        SessionWrites &session = sessions[key];
+        session.changes = changes;
+        setWritten(session, volume, nowMS);
+        return VolumeWriteDecision::Write;
+    }
+
+    SessionWrites &session = found->second;
+    if (volume == session.written) {
+        session.held = false;
+        return VolumeWriteDecision::Unchanged;
+    }
+
+    double intervalEndMS = session.writtenMS + intervalMS;
+    if (stepDB > 0.0f && getStep(volume) == session.step) {
+        session.held = true;
+        session.heldVolume = volume;
+        session.dueMS = (std::max)(nowMS + SETTLE_MS, intervalEndMS);
+        return VolumeWriteDecision::HeldStep;
+    }
+
+    if (nowMS < intervalEndMS) {
+        session.held = true;
+        session.heldVolume = volume;
+        session.dueMS = intervalEndMS;
+        return VolumeWriteDecision::HeldRate;
+    }
+
+    setWritten(session, volume, nowMS);
+    return VolumeWriteDecision::Write;
+}
+
+double VolumeWriteFilter::takeDue(double nowMS, std::vector<Write> &due) {
+    double nextDueMS = -1.0;
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        SessionWrites &session = it->second;
+        if (session.held && session.dueMS <= nowMS) {
+            due.push_back({it->first, session.heldVolume});
+            setWritten(session, session.heldVolume, nowMS);
+        }
+
+        if (session.held) {
+            if (nextDueMS < 0.0 || session.dueMS < nextDueMS)
+                nextDueMS = session.dueMS;
+        } else if (nowMS - session.writtenMS > FORGET_AFTER_MS) {
+            it = sessions.erase(it);
+            continue;
+        }
+        ++it;
+    }
+    return nextDueMS;
+}
+
+void VolumeWriteFilter::takeAll(std::vector<Write> &due) {
+    for (auto &entry : sessions) {
+        if (entry.second.held) {
+            due.push_back({entry.first, entry.second.heldVolume});
+            entry.second.held = false;
+        }
+    }
+}
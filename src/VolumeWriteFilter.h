@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "SessionRegistry.h"
+
+// what VolumeWriteFilter::offer() decided about a volume
+enum class VolumeWriteDecision {
+    Write,     // write it now
+    Unchanged, // already written
+    HeldStep,  // in the step of the last write, held back until it settles
+    HeldRate,  // too soon after the last write, held back until it is not
+};
+
+// volumewritefilter decides which volume writes to sessions are worth making,
+// as every write is sent on to every process watching the session (the volume
+// mixer, for one).
+// volumes are quantised to steps of stepDB on the decibel scale. a volume in
+// the same step as the last one written is held back until no other volume
+// came for the session for SETTLE_MS, so a fade only writes when it crosses a
+// step but still lands exactly on its target. writes less than intervalMS
+// apart are coalesced: the later one is held back until the interval is over
+// and replaced by anything that comes before then.
+// the filter only knows the volumes it wrote itself, so every volume comes
+// with the volume change count of its session (see
+// AudioBackend::getVolumeChangeCount()). once that moves, the volume was
+// changed from outside, e.g. in the mixer, and the next volume is written
+// whatever the filter wrote before.
+// only used from a single thread.
+class VolumeWriteFilter {
+  public:
+    struct Write {
+        SessionKey key;
+        float volume;
+    };
+
+    // how long a volume in the step of the last write waits for another one
+    static constexpr double SETTLE_MS = 100.0;
+
+  private:
+    struct SessionWrites {
+        float written = 0.0f;
+        int step = 0;
+        double writtenMS = 0.0;
+        std::uint32_t changes = 0;
+
+        bool held = false;
+        float heldVolume = 0.0f;
+        double dueMS = 0.0;
+    };
+    std::unordered_map<SessionKey, SessionWrites> sessions;
+
+    float stepDB = 0.0f;
+    double intervalMS = 0.0;
+
+    int getStep(float volume) const;
+    void setWritten(SessionWrites &session, float volume, double nowMS);
+
+  public:
+    // a stepDB or intervalMS of 0 turns that part off
+    void configure(float stepDB, double intervalMS);
+
+    // decide about writing the volume to the session now, given the volume
+    // change count of the session it was decided on. a held back volume
+    // replaces any held before it.
+    VolumeWriteDecision offer(SessionKey key, float volume,
+                              std::uint32_t changes, double nowMS);
+
+    // add the held back volumes that are due by nowMS to due, which are then
+    // taken as written. returns when the next held back volume is due, or a
+    // negative if none is held.
+    double takeDue(double nowMS, std::vector<Write> &due);
+
+    // add every held back volume to due, e.g. before stopping
+    void takeAll(std::vector<Write> &due);
+};
@@ -0,0 +1,757 @@
+#include "WASAPIBackend.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Log.h"
+
+// sessions are updated and the meters of every playing session are read on
+// every tick, so only a sample of those calls is timed
+static const unsigned TICK_SAMPLE_EVERY = 8;
+
+// event context passed with every volume this program sets, so the volume
+// change notifications for them can be told apart from changes by the user
+static const GUID VOLUME_CHANGE_CONTEXT = {
+    0x6d0c3c51, 0x2a4e, 0x4f3b, {0x9a, 0x57, 0x1e, 0x84, 0xb2, 0x0d, 0xc6,
+                                 0x3f}};
+
+// fnv-1a, used to turn a session instance identifier into a session key
+static SessionKey hashSessionIdentifier(const wchar_t *identifier) {
+    SessionKey hash = 14695981039346656037ull;
+    for (; *identifier; identifier++) {
+        hash ^= (SessionKey)*identifier;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static std::int64_t steadyNowNS() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now);
+    // 0 means no change is pending
+    return (std::max)((std::int64_t)ns.count(), (std::int64_t)1);
+}
+
+static SessionState toSessionState(AudioSessionState state) {
+    switch (state) {
+    case AudioSessionStateActive:
+        return SessionState::Active;
+    case AudioSessionStateExpired:
+        return SessionState::Expired;
+    default:
+        return SessionState::Inactive;
+    }
+}
+
+AudioSession::AudioSession(CComPtr<IAudioSessionControl> session) {
+    this->session = session;
+
+    LPWSTR wIdentifier;
+    HRESULT hr = getSession2()->GetSessionInstanceIdentifier(&wIdentifier);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get session instance identifier");
+    key = hashSessionIdentifier(wIdentifier);
+    CoTaskMemFree(wIdentifier);
+}
+
+AudioSession::~AudioSession() {
+    if (events)
+        session->UnregisterAudioSessionNotification(events);
+}
+
+IAudioSessionControl *AudioSession::getSession() { return session; }
+
+SessionKey AudioSession::getKey() const { return key; }
+
+SessionState AudioSession::getState() {
+    AudioSessionState state;
+    HRESULT hr = getSession()->GetState(&state);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get session state");
+    return toSessionState(state);
+}
+
+bool AudioSession::watchEvents(AudioSessionEventSink *sink,
+                               Counter &notifications) {
+    if (events)
+        return false;
+
+    CComPtr<AudioSessionEvents> newEvents;
+    newEvents.Attach(new AudioSessionEvents(sink, key, notifications));
+    HRESULT hr = getSession()->RegisterAudioSessionNotification(newEvents);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to register session notification");
+    events = newEvents;
+    return true;
+}
+
+IAudioSessionControl2 *AudioSession::getSession2() {
+    if (!session2) {
+        HRESULT hr = getSession()->QueryInterface(
+            __uuidof(IAudioSessionControl2), (void **)&session2);
+        if (FAILED(hr))
+            throw std::runtime_error(
+                "Failed to get session control 2 interface");
+    }
+    return session2;
+}
+
+ISimpleAudioVolume *AudioSession::getSimpleAudioVolume() {
+    std::lock_guard<std::mutex> lock(simpleAudioVolumeMutex);
+    if (!simpleAudioVolume) {
+        HRESULT hr = getSession()->QueryInterface(__uuidof(ISimpleAudioVolume),
+                                                  (void **)&simpleAudioVolume);
+        if (FAILED(hr))
+            throw std::runtime_error(
+                "Failed to get simple audio volume interface");
+    }
+    return simpleAudioVolume;
+}
+
+NameId AudioSession::getExecutableNameId(NameTable &names,
+                                         ProcessTable &processes) {
+    if (!nameRead) {
+        // sessions of several processes (AUDCLNT_S_NO_SINGLE_PROCESS) and of
+        // the system have no process to look up
+        DWORD processId = 0;
+        HRESULT hr = getSession2()->GetProcessId(&processId);
+        if (hr == S_OK && processId != 0)
+            nameId = processes.getLineageId(processId, names);
+        nameRead = nameId != NameTable::Unknown;
+    }
+    if (!nameRead) {
+        LPWSTR wName;
+        HRESULT hr = getSession2()->GetSessionIdentifier(&wName);
+        if (FAILED(hr))
+            throw std::runtime_error(
+                "Failed to get session identifier/executable name");
+        std::wstring wideString(wName);
+        CoTaskMemFree(wName);
+
+        // extract "abc.exe" from the returned string
+        std::wstring name;
+        auto endOfPathBackslash = wideString.rfind(L"\\");
+        if (endOfPathBackslash != std::wstring::npos) {
+            std::wstring executableRegion =
+                wideString.substr(endOfPathBackslash + 1);
+            auto endOfPathPercentage = executableRegion.find(L"%");
+            if (endOfPathPercentage != std::wstring::npos) {
+                name = executableRegion.substr(0, endOfPathPercentage);
+            }
+        }
+        nameId = names.intern(name);
+        nameRead = true;
+    }
+    return nameId;
+}
+
+float AudioSession::getSessionVolume() {
+    float volume;
+    HRESULT hr = getSimpleAudioVolume()->GetMasterVolume(&volume);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get volume");
+    return volume;
+}
+
+void AudioSession::setSessionVolume(float newVolume) {
+    HRESULT hr = getSimpleAudioVolume()->SetMasterVolume(
+        newVolume, &VOLUME_CHANGE_CONTEXT);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to set volume");
+    LOG_DEBUG("volume set", {{"volume", newVolume}});
+}
+
+std::uint32_t AudioSession::getVolumeChangeCount() const {
+    return events ? events->getVolumeChangeCount() : 0;
+}
+
+IAudioMeterInformation *AudioSession::getAudioMeterInformation() {
+    if (!audioMeterInformation) {
+        HRESULT hr = getSession()->QueryInterface(
+            __uuidof(IAudioMeterInformation), (void **)&audioMeterInformation);
+        if (FAILED(hr))
+            throw std::runtime_error("Failed to get audio meter interface");
+
+        hr = audioMeterInformation->GetMeteringChannelCount(&channelCount);
+        if (FAILED(hr))
+            throw std::runtime_error("Failed to get meter channel count");
+    }
+    return audioMeterInformation;
+}
+
+size_t AudioSession::getChannelPeakLevels(float *levels, size_t maxChannels) {
+    IAudioMeterInformation *meter = getAudioMeterInformation();
+    UINT count = (UINT)(std::min)((size_t)channelCount, maxChannels);
+    if (count == 0)
+        return 0;
+
+    HRESULT hr = meter->GetChannelsPeakValues(count, levels);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get peak audio level");
+    return count;
+}
+
+AudioSessionEvents::AudioSessionEvents(AudioSessionEventSink *sink,
+                                       SessionKey key, Counter &notifications)
+    : sink(sink), key(key), notifications(notifications) {}
+
+std::uint32_t AudioSessionEvents::getVolumeChangeCount() const {
+    return volumeChanges;
+}
+
+HRESULT STDMETHODCALLTYPE AudioSessionEvents::QueryInterface(REFIID riid,
+                                                             void **object) {
+    if (!object)
+        return E_POINTER;
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(IAudioSessionEvents)) {
+        *object = static_cast<IAudioSessionEvents *>(this);
+        AddRef();
+        return S_OK;
+    }
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG STDMETHODCALLTYPE AudioSessionEvents::AddRef() {
+    return InterlockedIncrement(&refCount);
+}
+
+ULONG STDMETHODCALLTYPE AudioSessionEvents::Release() {
+    ULONG count = InterlockedDecrement(&refCount);
+    if (count == 0)
+        delete this;
+    return count;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionEvents::OnDisplayNameChanged(LPCWSTR name, LPCGUID context) {
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionEvents::OnIconPathChanged(LPCWSTR path, LPCGUID context) {
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE AudioSessionEvents::OnSimpleVolumeChanged(
+    float volume, BOOL mute, LPCGUID context) {
+    // every volume set, ours included, is sent to each process watching the
+    // session, this one being one of them
+    notifications.add();
+    if (!context || !IsEqualGUID(*context, VOLUME_CHANGE_CONTEXT))
+        volumeChanges++;
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE AudioSessionEvents::OnChannelVolumeChanged(
+    DWORD channelCount, float volumes[], DWORD changedChannel,
+    LPCGUID context) {
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionEvents::OnGroupingParamChanged(LPCGUID param, LPCGUID context) {
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionEvents::OnStateChanged(AudioSessionState state) {
+    sink->sessionStateChanged(key, toSessionState(state));
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionEvents::OnSessionDisconnected(AudioSessionDisconnectReason reason) {
+    sink->sessionRemoved(key);
+    return S_OK;
+}
+
+AudioSessionNotification::AudioSessionNotification(AudioSessionEventSink *sink)
+    : sink(sink) {}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionNotification::QueryInterface(REFIID riid, void **object) {
+    if (!object)
+        return E_POINTER;
+    if (riid == __uuidof(IUnknown) ||
+        riid == __uuidof(IAudioSessionNotification)) {
+        *object = static_cast<IAudioSessionNotification *>(this);
+        AddRef();
+        return S_OK;
+    }
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG STDMETHODCALLTYPE AudioSessionNotification::AddRef() {
+    return InterlockedIncrement(&refCount);
+}
+
+ULONG STDMETHODCALLTYPE AudioSessionNotification::Release() {
+    ULONG count = InterlockedDecrement(&refCount);
+    if (count == 0)
+        delete this;
+    return count;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioSessionNotification::OnSessionCreated(IAudioSessionControl *newSession) {
+    // exceptions must not cross the com boundary. a session that cannot be
+    // queried is ignored, as it would have been when enumerating.
+    try {
+        auto session = std::make_shared<AudioSession>(newSession);
+        sink->sessionAdded(session->getKey(), session->getState(), session);
+    } catch (std::exception &) {
+    }
+    return S_OK;
+}
+
+AudioEndpoint::AudioEndpoint(CComPtr<IMMDevice> device,
+                             const std::wstring &id,
+                             std::function<void()> activityCallback,
+                             Counter &volumeNotifications)
+    : id(id), device(device), volumeNotifications(volumeNotifications) {
+    sessions.setActivityCallback(std::move(activityCallback));
+
+    HRESULT hr = device->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL,
+                                  NULL, (void **)&sessionManager2);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to activate session manager");
+
+    // register before enumerating so no session created in between is
+    // missed, duplicates are ignored by the registry
+    sessionNotification.Attach(new AudioSessionNotification(&sessions));
+    hr = sessionManager2->RegisterSessionNotification(sessionNotification);
+    if (FAILED(hr))
+        throw std::runtime_error(
+            "Failed to register for session notifications");
+
+    // the destructor does not run if this throws
+    try {
+        enumerateAudioSessions();
+    } catch (std::exception &) {
+        sessionManager2->UnregisterSessionNotification(sessionNotification);
+        throw;
+    }
+}
+
+AudioEndpoint::~AudioEndpoint() {
+    if (sessionManager2 && sessionNotification)
+        sessionManager2->UnregisterSessionNotification(sessionNotification);
+    sessions.clear();
+}
+
+const std::wstring &AudioEndpoint::getId() const { return id; }
+
+AudioSessionRegistry &AudioEndpoint::getSessions() { return sessions; }
+
+void AudioEndpoint::enumerateAudioSessions() {
+    HRESULT hr;
+
+    CComPtr<IAudioSessionEnumerator> sessionEnumerator;
+
+    hr = sessionManager2->GetSessionEnumerator(&sessionEnumerator);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get session enumerator");
+
+    int count;
+    hr = sessionEnumerator->GetCount(&count);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get session count");
+
+    for (int i = 0; i < count; i++) {
+        CComPtr<IAudioSessionControl> pSessionControl;
+        hr = sessionEnumerator->GetSession(i, &pSessionControl);
+        if (FAILED(hr))
+            throw std::runtime_error("Failed to get session " +
+                                     std::to_string(i));
+
+        auto session = std::make_shared<AudioSession>(pSessionControl);
+        sessions.sessionAdded(session->getKey(), session->getState(), session);
+    }
+}
+
+bool AudioEndpoint::updateSessions() {
+    if (!sessions.applyPendingEvents())
+        return false;
+
+    // the state of a new session may have changed before it was watched.
+    // sessions watched already are kept current by OnStateChanged, so are
+    // not queried again.
+    for (auto &entry : sessions) {
+        if (entry.session->watchEvents(&sessions, volumeNotifications))
+            entry.state = entry.session->getState();
+    }
+    return true;
+}
+
+AudioDeviceNotification::AudioDeviceNotification(WASAPIBackend *backend)
+    : backend(backend) {}
+
+HRESULT STDMETHODCALLTYPE
+AudioDeviceNotification::QueryInterface(REFIID riid, void **object) {
+    if (!object)
+        return E_POINTER;
+    if (riid == __uuidof(IUnknown) ||
+        riid == __uuidof(IMMNotificationClient)) {
+        *object = static_cast<IMMNotificationClient *>(this);
+        AddRef();
+        return S_OK;
+    }
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG STDMETHODCALLTYPE AudioDeviceNotification::AddRef() {
+    return InterlockedIncrement(&refCount);
+}
+
+ULONG STDMETHODCALLTYPE AudioDeviceNotification::Release() {
+    ULONG count = InterlockedDecrement(&refCount);
+    if (count == 0)
+        delete this;
+    return count;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioDeviceNotification::OnDeviceStateChanged(LPCWSTR deviceId,
+                                              DWORD newState) {
+    backend->markEndpointsChanged();
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioDeviceNotification::OnDeviceAdded(LPCWSTR deviceId) {
+    backend->markEndpointsChanged();
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE
+AudioDeviceNotification::OnDeviceRemoved(LPCWSTR deviceId) {
+    backend->markEndpointsChanged();
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE AudioDeviceNotification::OnDefaultDeviceChanged(
+    EDataFlow flow, ERole role, LPCWSTR deviceId) {
+    // the capture endpoints followed are the default ones
+    if (flow == EDataFlow::eRender || flow == EDataFlow::eCapture)
+        backend->markEndpointsChanged();
+    return S_OK;
+}
+
+HRESULT STDMETHODCALLTYPE AudioDeviceNotification::OnPropertyValueChanged(
+    LPCWSTR deviceId, const PROPERTYKEY key) {
+    return S_OK;
+}
+
+WASAPIBackend::WASAPIBackend(MetricsRegistry &metrics)
+    : updateLatency(
+          metrics.histogram("backend.updateSessions", TICK_SAMPLE_EVERY)),
+      peakLatency(metrics.histogram("session.getChannelPeakLevels",
+                                    TICK_SAMPLE_EVERY)),
+      volumeGetLatency(metrics.histogram("session.getVolume")),
+      volumeSetLatency(metrics.histogram("session.setVolume")),
+      capturePeakLatency(
+          metrics.histogram("capture.getPeakLevel", TICK_SAMPLE_EVERY)),
+      rebindCount(metrics.counter("backend.rebinds")),
+      volumeNotifications(metrics.counter("session.volumeNotifications")),
+      processes([this](ProcessId id, ProcessInfo &info) {
+          return processWatcher.query(id, info);
+      }) {}
+
+WASAPIBackend::~WASAPIBackend() {
+    if (deviceEnumerator && deviceNotification)
+        deviceEnumerator->UnregisterEndpointNotificationCallback(
+            deviceNotification);
+    locations.clear();
+    sessionsByKey.clear();
+    endpoints.clear();
+    captureEndpoints.clear();
+    // explicitly free CComPtrs before CoUninitialize()
+    deviceNotification = nullptr;
+    deviceEnumerator = nullptr;
+    if (comInitialised)
+        CoUninitialize();
+}
+
+void WASAPIBackend::init() {
+    // session notifications are only delivered to multithreaded apartments
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to initialize COM");
+    comInitialised = true;
+
+    hr = deviceEnumerator.CoCreateInstance(__uuidof(MMDeviceEnumerator),
+                                           nullptr, CLSCTX_ALL);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to create device enumerator");
+
+    // register before binding so no device change in between is missed
+    deviceNotification.Attach(new AudioDeviceNotification(this));
+    hr = deviceEnumerator->RegisterEndpointNotificationCallback(
+        deviceNotification);
+    if (FAILED(hr))
+        throw std::runtime_error(
+            "Failed to register for device notifications");
+
+    // capture enabled from here on is rebound like a device change, what was
+    // enabled before is bound straight away
+    endpointsBound = true;
+    rebindEndpoints();
+    updateSessions();
+}
+
+void WASAPIBackend::setCaptureEnabled(bool enabled) {
+    if (captureEnabled.exchange(enabled) != enabled && endpointsBound)
+        markEndpointsChanged();
+}
+
+void WASAPIBackend::markEndpointsChanged() {
+    // keep the time of the first change, the latency is measured from there
+    std::int64_t expected = 0;
+    endpointsChangedNS.compare_exchange_strong(expected, steadyNowNS());
+    if (activityCallback)
+        activityCallback();
+}
+
+bool WASAPIBackend::rebindEndpoints() {
+    CComPtr<IMMDeviceCollection> devices;
+    HRESULT hr = deviceEnumerator->EnumAudioEndpoints(
+        EDataFlow::eRender, DEVICE_STATE_ACTIVE, &devices);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to enumerate audio endpoints");
+
+    UINT count;
+    hr = devices->GetCount(&count);
+    if (FAILED(hr))
+        throw std::runtime_error("Failed to get audio endpoint count");
+
+    bool changed = false;
+    std::vector<std::unique_ptr<AudioEndpoint>> bound;
+
+    for (UINT i = 0; i < count; i++) {
+        CComPtr<IMMDevice> device;
+        LPWSTR wId;
+        if (FAILED(devices->Item(i, &device)) || FAILED(device->GetId(&wId)))
+            continue;
+        std::wstring id(wId);
+        CoTaskMemFree(wId);
+
+        // endpoints that are still active keep their sessions
+        auto existing = std::find_if(
+            endpoints.begin(), endpoints.end(),
+            [&](const std::unique_ptr<AudioEndpoint> &endpoint) {
+                return endpoint && endpoint->getId() == id;
+            });
+        if (existing != endpoints.end()) {
+            bound.push_back(std::move(*existing));
+            continue;
+        }
+
+        // a device can go away while it is being bound. it is skipped rather
+        // than failing, the notification for it rebinds again anyway.
+        try {
+            bound.push_back(std::make_unique<AudioEndpoint>(
+                device, id, activityCallback, volumeNotifications));
+            changed = true;
+        } catch (std::exception &) {
+            LOG_WARNING("failed to watch an audio endpoint, skipping");
+        }
+    }
+
+    for (auto &endpoint : endpoints)
+        changed |= endpoint != nullptr;
+
+    // endpoints no longer active are released here
+    endpoints.swap(bound);
+    endpointCount = endpoints.size();
+
+    // capture sessions are not in the session list, so they never count as a
+    // change
+    rebindCaptureEndpoints();
+    return changed;
+}
+
+void WASAPIBackend::rebindCaptureEndpoints() {
+    std::vector<CaptureEndpoint> bound;
+
+    for (ERole role : {ERole::eConsole, ERole::eCommunications}) {
+        if (!captureEnabled)
+            break;
+
+        // having no microphone is not an error, there is just nothing to hear
+        CComPtr<IMMDevice> device;
+        LPWSTR wId;
+        if (FAILED(deviceEnumerator->GetDefaultAudioEndpoint(
+                EDataFlow::eCapture, role, &device)) ||
+            FAILED(device->GetId(&wId)))
+            continue;
+        std::wstring id(wId);
+        CoTaskMemFree(wId);
+
+        auto sameId = [&](const CaptureEndpoint &capture) {
+            return capture.endpoint && capture.endpoint->getId() == id;
+        };
+        if (std::any_of(bound.begin(), bound.end(), sameId))
+            continue;
+
+        // endpoints that are still the default keep their sessions
+        auto existing = std::find_if(captureEndpoints.begin(),
+                                     captureEndpoints.end(), sameId);
+        if (existing != captureEndpoints.end()) {
+            bound.push_back(std::move(*existing));
+            continue;
+        }
+
+        try {
+            CaptureEndpoint capture;
+            HRESULT hr = device->Activate(__uuidof(IAudioMeterInformation),
+                                          CLSCTX_ALL, NULL,
+                                          (void **)&capture.meter);
+            if (FAILED(hr))
+                throw std::runtime_error("Failed to activate capture meter");
+            capture.endpoint = std::make_unique<AudioEndpoint>(
+                device, id, activityCallback, volumeNotifications);
+            bound.push_back(std::move(capture));
+        } catch (std::exception &) {
+            LOG_WARNING("failed to watch a capture endpoint, skipping");
+        }
+    }
+
+    // endpoints no longer the default, or all of them if capture was
+    // disabled, are released here
+    captureEndpoints.swap(bound);
+}
+
+bool WASAPIBackend::updateSessions() {
+    ScopedTimer timer(updateLatency);
+    bool changed = false;
+
+    std::int64_t changedNS = endpointsChangedNS.exchange(0);
+    if (changedNS != 0) {
+        changed |= rebindEndpoints();
+        rebindCount.add();
+        rebindLatencyMS = (double)(steadyNowNS() - changedNS) / 1000000.0;
+    }
+
+    // processes are only looked up as new sessions are named, so keeping the
+    // table current only takes dropping the ones that exited
+    processWatcher.takeExited(exitedProcesses);
+    for (ProcessId id : exitedProcesses)
+        processes.removeProcess(id);
+    exitedProcesses.clear();
+
+    for (auto &endpoint : endpoints)
+        changed |= endpoint->updateSessions();
+    for (auto &capture : captureEndpoints)
+        capture.endpoint->updateSessions();
+    if (!changed)
+        return false;
+
+    std::lock_guard<std::mutex> lock(sessionsByKeyMutex);
+    locations.clear();
+    sessionsByKey.clear();
+    for (auto &endpoint : endpoints) {
+        AudioSessionRegistry &sessions = endpoint->getSessions();
+        for (size_t i = 0; i < sessions.size(); i++) {
+            locations.push_back({&sessions, i});
+            sessionsByKey[sessions[i].key] = sessions[i].session;
+        }
+    }
+    return true;
+}
+
+void WASAPIBackend::setActivityCallback(std::function<void()> callback) {
+    activityCallback = callback;
+    for (auto &endpoint : endpoints)
+        endpoint->getSessions().setActivityCallback(callback);
+    for (auto &capture : captureEndpoints)
+        capture.endpoint->getSessions().setActivityCallback(callback);
+}
+
+double WASAPIBackend::getRebindLatencyMS() const { return rebindLatencyMS; }
+
+size_t WASAPIBackend::getEndpointCount() const { return endpointCount; }
+
+AudioSessionRegistry::Entry &WASAPIBackend::getEntry(size_t index) {
+    const SessionLocation &location = locations[index];
+    return (*location.sessions)[location.index];
+}
+
+size_t WASAPIBackend::getSessionCount() { return locations.size(); }
+
+SessionKey WASAPIBackend::getSessionKey(size_t index) {
+    return getEntry(index).key;
+}
+
+SessionState WASAPIBackend::getSessionState(size_t index) {
+    return getEntry(index).state;
+}
+
+NameId WASAPIBackend::getExecutableNameId(size_t index) {
+    return getEntry(index).session->getExecutableNameId(names, processes);
+}
+
+size_t WASAPIBackend::getChannelPeakLevels(size_t index, float *levels,
+                                           size_t maxChannels) {
+    ScopedTimer timer(peakLatency);
+    return getEntry(index).session->getChannelPeakLevels(levels, maxChannels);
+}
+
+float WASAPIBackend::getSessionVolume(size_t index) {
+    ScopedTimer timer(volumeGetLatency);
+    return getEntry(index).session->getSessionVolume();
+}
+
+void WASAPIBackend::setSessionVolume(size_t index, float volume) {
+    ScopedTimer timer(volumeSetLatency);
+    getEntry(index).session->setSessionVolume(volume);
+}
+
+std::uint32_t WASAPIBackend::getVolumeChangeCount(size_t index) {
+    return getEntry(index).session->getVolumeChangeCount();
+}
+
+void WASAPIBackend::setSessionVolumeByKey(SessionKey key, float volume) {
+    std::shared_ptr<AudioSession> session;
+    {
+        std::lock_guard<std::mutex> lock(sessionsByKeyMutex);
+        auto found = sessionsByKey.find(key);
+        if (found == sessionsByKey.end())
+            return;
+        session = found->second;
+    }
+
+    // the session may have expired since the volume was decided on, which
+    // the next update picks up
+    ScopedTimer timer(volumeSetLatency);
+    try {
+        session->setSessionVolume(volume);
+    } catch (std::exception &) {
+        LOG_WARNING("failed to set the volume of a session, skipping");
+    }
+}
+
+bool WASAPIBackend::getCapturePeakLevel(float &peak) {
+    // the session states are kept current by notifications, so telling that
+    // nothing records makes no calls into the audio system
+    bool capturing = false;
+    for (auto &capture : captureEndpoints) {
+        for (auto &entry : capture.endpoint->getSessions())
+            capturing |= entry.state == SessionState::Active;
+    }
+    if (!capturing)
+        return false;
+
+    // the endpoint meter is the level of the microphone whichever program
+    // records from it
+    ScopedTimer timer(capturePeakLatency);
+    peak = 0.0f;
+    for (auto &capture : captureEndpoints) {
+        float value;
+        if (SUCCEEDED(capture.meter->GetPeakValue(&value)))
+            peak = (std::max)(peak, value);
+    }
+    return true;
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <atlbase.h>
+#include <audiopolicy.h>
+#include <endpointvolume.h>
+#include <mmdeviceapi.h>
+#include <windows.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AudioBackend.h"
+#include "Metrics.h"
+#include "NameTable.h"
+#include "ProcessTable.h"
+#include "SessionRegistry.h"
+#include "Win32ProcessWatcher.h"
+
+class AudioSession;
+class AudioSessionEvents;
+class WASAPIBackend;
+
+using AudioSessionEventSink = SessionEventSink<std::shared_ptr<AudioSession>>;
+using AudioSessionRegistry = SessionRegistry<std::shared_ptr<AudioSession>>;
+
+// audiosession store info about a single IAudioSessionControl for as long as
+// the session exists. interfaces other than IAudioSessionControl are not
+// requested/created until they are accessed, and are then kept for the
+// lifetime of the session.
+// the executable name is read and interned once, the id is kept for the
+// lifetime of the session. it is the lineage of the session's process where
+// that can be queried, so sessions also match the programs that started them.
+// volume and peak values are read on every call, the caller keeps them for the
+// tick (see SessionFrame). the volume can be read and set from two threads at
+// once.
+class AudioSession {
+  private:
+    CComPtr<IAudioSessionControl> session = nullptr;
+    CComPtr<IAudioSessionControl2> session2 = nullptr;
+    std::mutex simpleAudioVolumeMutex; // guards creating simpleAudioVolume
+    CComPtr<ISimpleAudioVolume> simpleAudioVolume = nullptr;
+    CComPtr<IAudioMeterInformation> audioMeterInformation = nullptr;
+    CComPtr<AudioSessionEvents> events = nullptr;
+    NameId nameId = NameTable::Unknown;
+    bool nameRead = false;
+    UINT channelCount = 0; // read with the meter interface
+    SessionKey key = 0;
+
+  public:
+    AudioSession(CComPtr<IAudioSessionControl> session);
+    ~AudioSession();
+
+    IAudioSessionControl *getSession();
+    IAudioSessionControl2 *getSession2();
+    ISimpleAudioVolume *getSimpleAudioVolume();
+    IAudioMeterInformation *getAudioMeterInformation();
+
+    // key derived from the session instance identifier, unique per session
+    SessionKey getKey() const;
+
+    SessionState getState();
+
+    // start forwarding state changes and disconnection of this session to the
+    // sink, counting every volume change notification into notifications.
+    // does nothing if already watching. returns whether it started watching.
+    bool watchEvents(AudioSessionEventSink *sink, Counter &notifications);
+
+    // looks up the lineage of the session's process in the process table,
+    // or failing that attempts to extract the executable name from the
+    // session identifier in the form of "ABC.exe", and interns it into the
+    // given table
+    NameId getExecutableNameId(NameTable &names, ProcessTable &processes);
+
+    // session volume is volume level set on the mixer (Sndvol)
+    float getSessionVolume();
+    void setSessionVolume(float newVolume);
+
+    // number of volume changes made by anything but setSessionVolume() since
+    // the events were first watched
+    std::uint32_t getVolumeChangeCount() const;
+
+    // peak level of each channel of the session over the last device period.
+    // this has NO averaging, the level detector smooths the samples.
+    size_t getChannelPeakLevels(float *levels, size_t maxChannels);
+};
+
+// audiosessionevents forwards the state changes and disconnection of a single
+// session to a session event sink, and counts the volume changes not made by
+// this program. other notifications are ignored.
+class AudioSessionEvents : public IAudioSessionEvents {
+  private:
+    LONG refCount = 1;
+    AudioSessionEventSink *sink;
+    SessionKey key;
+    Counter &notifications;
+    std::atomic<std::uint32_t> volumeChanges{0};
+
+  public:
+    AudioSessionEvents(AudioSessionEventSink *sink, SessionKey key,
+                       Counter &notifications);
+
+    std::uint32_t getVolumeChangeCount() const;
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                             void **object) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    HRESULT STDMETHODCALLTYPE OnDisplayNameChanged(LPCWSTR name,
+                                                   LPCGUID context) override;
+    HRESULT STDMETHODCALLTYPE OnIconPathChanged(LPCWSTR path,
+                                                LPCGUID context) override;
+    HRESULT STDMETHODCALLTYPE OnSimpleVolumeChanged(float volume, BOOL mute,
+                                                    LPCGUID context) override;
+    HRESULT STDMETHODCALLTYPE OnChannelVolumeChanged(DWORD channelCount,
+                                                     float volumes[],
+                                                     DWORD changedChannel,
+                                                     LPCGUID context) override;
+    HRESULT STDMETHODCALLTYPE OnGroupingParamChanged(LPCGUID param,
+                                                     LPCGUID context) override;
+    HRESULT STDMETHODCALLTYPE OnStateChanged(AudioSessionState state) override;
+    HRESULT STDMETHODCALLTYPE
+    OnSessionDisconnected(AudioSessionDisconnectReason reason) override;
+};
+
+// audiosessionnotification forwards sessions created after the initial
+// enumeration to a session event sink.
+class AudioSessionNotification : public IAudioSessionNotification {
+  private:
+    LONG refCount = 1;
+    AudioSessionEventSink *sink;
+
+  public:
+    AudioSessionNotification(AudioSessionEventSink *sink);
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                             void **object) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    HRESULT STDMETHODCALLTYPE
+    OnSessionCreated(IAudioSessionControl *newSession) override;
+};
+
+// audioendpoint watches the sessions of a single render or capture endpoint.
+// every endpoint has its own registry, so session notifications from one
+// device never wait on another.
+class AudioEndpoint {
+  private:
+    std::wstring id;
+    CComPtr<IMMDevice> device = nullptr;
+    CComPtr<IAudioSessionManager2> sessionManager2 = nullptr;
+    CComPtr<AudioSessionNotification> sessionNotification = nullptr;
+
+    // kept current by session notifications, never re-enumerated
+    AudioSessionRegistry sessions;
+
+    // volume change notifications of the sessions
+    Counter &volumeNotifications;
+
+    // add all audio sessions currently reported by the session manager to the
+    // registry. only needed once, later sessions arrive as notifications.
+    void enumerateAudioSessions();
+
+  public:
+    // activate the session manager of the device and start watching its
+    // sessions. throws on failure.
+    AudioEndpoint(CComPtr<IMMDevice> device, const std::wstring &id,
+                  std::function<void()> activityCallback,
+                  Counter &volumeNotifications);
+    ~AudioEndpoint();
+
+    // endpoint id string of the device
+    const std::wstring &getId() const;
+
+    // apply pending session notifications to the registry and start watching
+    // any newly added sessions. returns whether any session changed.
+    bool updateSessions();
+
+    AudioSessionRegistry &getSessions();
+};
+
+// audiodevicenotification tells the backend when endpoints are added, removed
+// or change state, or a default render or capture endpoint changes.
+class AudioDeviceNotification : public IMMNotificationClient {
+  private:
+    LONG refCount = 1;
+    WASAPIBackend *backend;
+
+  public:
+    AudioDeviceNotification(WASAPIBackend *backend);
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                                             void **object) override;
+    ULONG STDMETHODCALLTYPE AddRef() override;
+    ULONG STDMETHODCALLTYPE Release() override;
+
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR deviceId,
+                                                   DWORD newState) override;
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR deviceId) override;
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR deviceId) override;
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow flow,
+                                                     ERole role,
+                                                     LPCWSTR deviceId) override;
+    HRESULT STDMETHODCALLTYPE
+    OnPropertyValueChanged(LPCWSTR deviceId, const PROPERTYKEY key) override;
+};
+
+// wasapibackend is the windows audio backend. it watches the sessions of every
+// active render endpoint through the core audio api, so audio on any device
+// (headset, hdmi, the communications device...) is seen at once.
+// endpoints are rebound on the engine thread at the next updateSessions()
+// after a device notification, and the notification wakes the engine so that
+// happens straight away.
+// sessions of all endpoints are addressed by a single index. volumes can also
+// be set by session key from one other thread.
+// while capture is enabled, the default capture endpoints are watched too:
+// their sessions only tell whether anything records from them, and their
+// meters are only read while something does.
+// the time spent in the core audio calls made every tick is recorded into the
+// metrics registry.
+class WASAPIBackend : public AudioBackend {
+  private:
+    bool comInitialised = false;
+
+    LatencyHistogram &updateLatency;
+    LatencyHistogram &peakLatency;
+    LatencyHistogram &volumeGetLatency;
+    LatencyHistogram &volumeSetLatency;
+    LatencyHistogram &capturePeakLatency;
+    Counter &rebindCount;
+    Counter &volumeNotifications;
+
+    CComPtr<IMMDeviceEnumerator> deviceEnumerator = nullptr;
+    CComPtr<AudioDeviceNotification> deviceNotification = nullptr;
+    std::vector<std::unique_ptr<AudioEndpoint>> endpoints;
+
+    // the default console and communications capture endpoints (once if they
+    // are the same device) and their meters, bound along with the render
+    // endpoints while capture is enabled
+    struct CaptureEndpoint {
+        std::unique_ptr<AudioEndpoint> endpoint;
+        CComPtr<IAudioMeterInformation> meter;
+    };
+    std::vector<CaptureEndpoint> captureEndpoints;
+    std::atomic<bool> captureEnabled{false};
+
+    // set by init() before the first bind. until then changing capture needs
+    // no rebind, as the first bind picks it up.
+    std::atomic<bool> endpointsBound{false};
+
+    std::function<void()> activityCallback;
+
+    // the processes of the sessions and their ancestors, dropped as they exit
+    Win32ProcessWatcher processWatcher;
+    ProcessTable processes;
+    std::vector<ProcessId> exitedProcesses;
+
+    // where each session index is found, rebuilt when any session changes
+    struct SessionLocation {
+        AudioSessionRegistry *sessions;
+        size_t index;
+    };
+    std::vector<SessionLocation> locations;
+
+    // every session by key, rebuilt along with locations, for
+    // setSessionVolumeByKey() from another thread
+    std::mutex sessionsByKeyMutex;
+    std::unordered_map<SessionKey, std::shared_ptr<AudioSession>> sessionsByKey;
+
+    // steady clock time in ns of the first device notification not yet
+    // handled, 0 if none
+    std::atomic<std::int64_t> endpointsChangedNS{0};
+
+    // time from a device notification until its endpoints were rebound, -1 if
+    // no device has changed yet
+    std::atomic<double> rebindLatencyMS{-1.0};
+    std::atomic<size_t> endpointCount{0};
+
+    // watch every active render endpoint, keeping the endpoints that are still
+    // active and dropping the rest. returns whether any endpoint was added or
+    // removed.
+    bool rebindEndpoints();
+
+    // watch the default capture endpoints if capture is enabled, keeping those
+    // that are still the default, or drop them all if not
+    void rebindCaptureEndpoints();
+
+    AudioSessionRegistry::Entry &getEntry(size_t index);
+
+  public:
+    // registers its metrics in the given registry
+    WASAPIBackend(MetricsRegistry &metrics);
+    ~WASAPIBackend();
+
+    // initialise com on the calling thread and start watching the render
+    // endpoints and their sessions. throws on failure.
+    void init();
+
+    // called from any thread when the endpoints may have changed
+    void markEndpointsChanged();
+
+    // start or stop watching the default capture endpoints for
+    // getCapturePeakLevel(), picked up at the next updateSessions(), or by
+    // init() if it has not run yet. off until set. can be called from any
+    // thread.
+    void setCaptureEnabled(bool enabled);
+
+    // rebind endpoints if a device has changed, then apply pending session
+    // notifications of every endpoint
+    bool updateSessions() override;
+    void setActivityCallback(std::function<void()> callback) override;
+
+    // can be called from any thread
+    double getRebindLatencyMS() const;
+    size_t getEndpointCount() const;
+
+    size_t getSessionCount() override;
+    SessionKey getSessionKey(size_t index) override;
+    SessionState getSessionState(size_t index) override;
+    NameId getExecutableNameId(size_t index) override;
+    size_t getChannelPeakLevels(size_t index, float *levels,
+                                size_t maxChannels) override;
+    float getSessionVolume(size_t index) override;
+    void setSessionVolume(size_t index, float volume) override;
+    void setSessionVolumeByKey(SessionKey key, float volume) override;
+    std::uint32_t getVolumeChangeCount(size_t index) override;
+    bool getCapturePeakLevel(float &peak) override;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+
+// wakeupcounter measures how often a thread wakes up, as a rate per minute.
+// wakeup() must only be called from the thread being measured, the rate can be
+// read from any thread.
+// the rate is updated at the first wakeup after each minute, so a thread that
+// sleeps for longer than a minute reports the rate over the whole sleep.
+class WakeupCounter {
+  private:
+    static constexpr double PERIOD_MS = 60000.0;
+
+    unsigned count = 0;
+    double periodStartMS = -1.0;
+    std::atomic<double> perMinute{0.0};
+
+  public:
+    void wakeup(double nowMS) {
+        if (periodStartMS < 0.0)
+            periodStartMS = nowMS;
+
+        count++;
+        double elapsedMS = nowMS - periodStartMS;
+        if (elapsedMS >= PERIOD_MS) {
+            perMinute.store(count * PERIOD_MS / elapsedMS,
+                            std::memory_order_relaxed);
+            count = 0;
+            periodStartMS = nowMS;
+        }
+    }
+
+    double getPerMinute() const {
+        return perMinute.load(std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,60 @@
+#include "Win32Clock.h"
+
+#include <cmath>
+#include <stdexcept>
+
+Win32Clock::Win32Clock() {
+    wakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!wakeEvent)
+        throw std::runtime_error("Failed to create wake event");
+
+    // high-resolution timers need windows 10 1803, fall back to a normal
+    // waitable timer on older versions
+    preciseTimer = CreateWaitableTimerExW(
+        NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!preciseTimer)
+        preciseTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+}
+
+Win32Clock::~Win32Clock() {
+    if (preciseTimer)
+        CloseHandle(preciseTimer);
+    CloseHandle(wakeEvent);
+}
+
+double Win32Clock::nowMS() {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+bool Win32Clock::waitMS(double ms) {
+    // waits too long for a timeout, FOREVER_MS among them, last until woken
+    DWORD timeout = 0;
+    if (ms >= (double)INFINITE)
+        timeout = INFINITE;
+    else if (ms > 0.0)
+        timeout = (DWORD)std::ceil(ms);
+    return WaitForSingleObject(wakeEvent, timeout) == WAIT_OBJECT_0;
+}
+
+bool Win32Clock::waitPreciseMS(double ms) {
+    if (!preciseTimer || ms <= 0.0 || ms >= FOREVER_MS)
+        return waitMS(ms);
+
+    // negative due times are relative, in 100ns units
+    LARGE_INTEGER dueTime;
+    dueTime.QuadPart = -(LONGLONG)(ms * 10000.0);
+    if (!SetWaitableTimer(preciseTimer, &dueTime, 0, NULL, NULL, FALSE))
+        return waitMS(ms);
+
+    HANDLE handles[] = {wakeEvent, preciseTimer};
+    DWORD wait = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    if (wait == WAIT_OBJECT_0) {
+        CancelWaitableTimer(preciseTimer);
+        return true;
+    }
+    return false;
+}
+
+void Win32Clock::wake() { SetEvent(wakeEvent); }
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <windows.h>
+
+#include "Clock.h"
+
+// win32clock is the real-time clock used on windows. waits block on an
+// auto-reset event, so wake() can be called from com notification threads and
+// the ui thread without any polling.
+// precise waits also wait on a high-resolution waitable timer, which is only
+// armed for the duration of the wait (i.e., while a fade is in progress), so
+// the system timer resolution is never raised while idle.
+class Win32Clock : public Clock {
+  private:
+    HANDLE wakeEvent;
+    HANDLE preciseTimer;
+
+  public:
+    Win32Clock();
+    ~Win32Clock();
+
+    double nowMS() override;
+    bool waitMS(double ms) override;
+    bool waitPreciseMS(double ms) override;
+    void wake() override;
+};
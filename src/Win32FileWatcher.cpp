@@ -0,0 +1,128 @@
+#include "Win32FileWatcher.h"
+
+#include <stdexcept>
+
+const DWORD Win32FileWatcher::SETTLE_MS;
+
+Win32FileWatcher::Win32FileWatcher(std::function<void()> onChange)
+    : onChange(onChange) {
+    changeEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    triggerEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!changeEvent || !triggerEvent || !stopEvent)
+        throw std::runtime_error("Failed to create file watcher events");
+}
+
+Win32FileWatcher::~Win32FileWatcher() {
+    stop();
+    CloseHandle(stopEvent);
+    CloseHandle(triggerEvent);
+    CloseHandle(changeEvent);
+}
+
+void Win32FileWatcher::start(const std::wstring &directoryPath,
+                             const std::wstring &filename) {
+    if (thread.joinable())
+        return;
+
+    this->filename = filename;
+    directory = CreateFileW(
+        directoryPath.c_str(), FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+    ResetEvent(stopEvent);
+    thread = std::thread(&Win32FileWatcher::run, this);
+}
+
+void Win32FileWatcher::stop() {
+    if (!thread.joinable())
+        return;
+
+    SetEvent(stopEvent);
+    thread.join();
+
+    if (directory != INVALID_HANDLE_VALUE) {
+        CloseHandle(directory);
+        directory = INVALID_HANDLE_VALUE;
+    }
+}
+
+void Win32FileWatcher::trigger() { SetEvent(triggerEvent); }
+
+bool Win32FileWatcher::readChanges() {
+    if (directory == INVALID_HANDLE_VALUE)
+        return false;
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = changeEvent;
+    ResetEvent(changeEvent);
+
+    // renames are included as editors often save to a temporary file and
+    // rename it over the original
+    return ReadDirectoryChangesW(
+               directory, buffer, sizeof(buffer), FALSE,
+               FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME |
+                   FILE_NOTIFY_CHANGE_SIZE,
+               NULL, &overlapped, NULL) != 0;
+}
+
+bool Win32FileWatcher::changesIncludeFile(DWORD bytes) const {
+    // no bytes means the changes overflowed the buffer, so any of them could
+    // have been the file
+    if (bytes == 0)
+        return true;
+
+    auto record = (const BYTE *)buffer;
+    while (true) {
+        auto info = (const FILE_NOTIFY_INFORMATION *)record;
+        if (CompareStringOrdinal(info->FileName,
+                                 info->FileNameLength / sizeof(WCHAR),
+                                 filename.c_str(), (int)filename.size(),
+                                 TRUE) == CSTR_EQUAL)
+            return true;
+
+        if (info->NextEntryOffset == 0)
+            return false;
+        record += info->NextEntryOffset;
+    }
+}
+
+void Win32FileWatcher::run() {
+    bool watching = readChanges();
+    bool pending = false;
+
+    while (true) {
+        HANDLE handles[] = {stopEvent, triggerEvent, changeEvent};
+        DWORD result = WaitForMultipleObjects(watching ? 3 : 2, handles, FALSE,
+                                              pending ? SETTLE_MS : INFINITE);
+
+        if (result == WAIT_OBJECT_0) {
+            break;
+        } else if (result == WAIT_OBJECT_0 + 1) {
+            pending = false;
+            onChange();
+        } else if (result == WAIT_OBJECT_0 + 2) {
+            DWORD bytes = 0;
+            if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE)) {
+                watching = false;
+                continue;
+            }
+            if (changesIncludeFile(bytes))
+                pending = true;
+            watching = readChanges();
+        } else if (result == WAIT_TIMEOUT && pending) {
+            pending = false;
+            onChange();
+        } else if (result == WAIT_FAILED) {
+            break;
+        }
+    }
+
+    // the read must finish before the buffer and overlapped can go away
+    if (watching) {
+        DWORD bytes = 0;
+        CancelIoEx(directory, &overlapped);
+        GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+    }
+}
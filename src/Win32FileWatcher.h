@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+
+#include <functional>
+#include <string>
+#include <thread>
+
+// win32filewatcher watches a single file on its own thread, using
+// ReadDirectoryChangesW on the directory that holds it. the callback runs on
+// the watcher thread once no further change to the file has arrived for
+// SETTLE_MS, since editors often save a file in several writes.
+// trigger() runs the callback as if the file had changed. if the directory
+// cannot be watched, only triggers run the callback.
+class Win32FileWatcher {
+  private:
+    static const DWORD SETTLE_MS = 100;
+
+    std::function<void()> onChange;
+    std::wstring filename;
+
+    HANDLE directory = INVALID_HANDLE_VALUE;
+    HANDLE changeEvent;
+    HANDLE triggerEvent;
+    HANDLE stopEvent;
+
+    OVERLAPPED overlapped;
+    DWORD buffer[1024]; // FILE_NOTIFY_INFORMATION records are dword aligned
+
+    std::thread thread;
+
+    // queue the next read of changes. returns false if it failed.
+    bool readChanges();
+
+    // whether the changes read into the buffer include the file
+    bool changesIncludeFile(DWORD bytes) const;
+
+    void run();
+
+  public:
+    explicit Win32FileWatcher(std::function<void()> onChange);
+    ~Win32FileWatcher();
+
+    // start watching the given file in the given directory
+    void start(const std::wstring &directoryPath,
+               const std::wstring &filename);
+
+    // stop watching and join the watcher thread
+    void stop();
+
+    // can be called from any thread, before or after start()
+    void trigger();
+};
@@ -0,0 +1,114 @@
+#include "Win32ProcessWatcher.h"
+
+#include <string>
+#include <utility>
+
+// the parent of a process is only reported by the native api. the layout of
+// PROCESS_BASIC_INFORMATION, whose public header hides the parent field.
+struct ProcessBasicInformation {
+    LONG exitStatus;
+    PVOID pebBaseAddress;
+    ULONG_PTR affinityMask;
+    LONG basePriority;
+    ULONG_PTR uniqueProcessId;
+    ULONG_PTR inheritedFromUniqueProcessId;
+};
+
+using NtQueryInformationProcessFunction = LONG(WINAPI *)(HANDLE, ULONG, PVOID,
+                                                         ULONG, PULONG);
+
+static const ULONG PROCESS_BASIC_INFORMATION_CLASS = 0;
+
+static NtQueryInformationProcessFunction getNtQueryInformationProcess() {
+    static NtQueryInformationProcessFunction function =
+        (NtQueryInformationProcessFunction)GetProcAddress(
+            GetModuleHandleW(L"ntdll.dll"), "NtQueryInformationProcess");
+    return function;
+}
+
+Win32ProcessWatcher::~Win32ProcessWatcher() {
+    while (!watches.empty())
+        unwatch(watches.begin()->first);
+}
+
+VOID CALLBACK Win32ProcessWatcher::onExit(PVOID context, BOOLEAN) {
+    auto watch = (Watch *)context;
+    Win32ProcessWatcher *watcher = watch->watcher;
+    std::lock_guard<std::mutex> lock(watcher->exitedMutex);
+    watcher->exited.push_back(watch->id);
+    watcher->exitPending = true;
+}
+
+void Win32ProcessWatcher::unwatch(ProcessId id) {
+    auto found = watches.find(id);
+    if (found == watches.end())
+        return;
+
+    Watch &watch = *found->second;
+    if (watch.wait)
+        UnregisterWaitEx(watch.wait, INVALID_HANDLE_VALUE);
+    CloseHandle(watch.process);
+    watches.erase(found);
+}
+
+bool Win32ProcessWatcher::query(ProcessId id, ProcessInfo &info) {
+    auto queryInformationProcess = getNtQueryInformationProcess();
+    if (!queryInformationProcess)
+        return false;
+
+    HANDLE process = OpenProcess(
+        PROCESS_QUERY_LIMITED_INFORMATION | SYNCHRONIZE, FALSE, id);
+    if (!process)
+        return false;
+
+    WCHAR path[MAX_PATH];
+    DWORD pathLength = MAX_PATH;
+    ProcessBasicInformation basic;
+    FILETIME creation, exit, kernel, user;
+    if (!QueryFullProcessImageNameW(process, 0, path, &pathLength) ||
+        queryInformationProcess(process, PROCESS_BASIC_INFORMATION_CLASS,
+                                &basic, sizeof(basic), nullptr) < 0 ||
+        !GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+        CloseHandle(process);
+        return false;
+    }
+
+    // extract "abc.exe" from the image path
+    std::wstring name(path, pathLength);
+    auto endOfPathBackslash = name.rfind(L'\\');
+    if (endOfPathBackslash != std::wstring::npos)
+        name = name.substr(endOfPathBackslash + 1);
+
+    info.parentId = (ProcessId)basic.inheritedFromUniqueProcessId;
+    info.startTime =
+        ((std::uint64_t)creation.dwHighDateTime << 32) | creation.dwLowDateTime;
+    info.name = std::move(name);
+
+    // replace any watch left from an earlier process with the same id
+    unwatch(id);
+    std::unique_ptr<Watch> watch(new Watch{this, id, process});
+    if (!RegisterWaitForSingleObject(&watch->wait, process, onExit,
+                                     watch.get(), INFINITE,
+                                     WT_EXECUTEONLYONCE)) {
+        // without a wait the exit is never seen, so the process is not kept
+        CloseHandle(process);
+        return false;
+    }
+    watches.emplace(id, std::move(watch));
+    return true;
+}
+
+void Win32ProcessWatcher::takeExited(std::vector<ProcessId> &ids) {
+    if (!exitPending)
+        return;
+
+    size_t first = ids.size();
+    {
+        std::lock_guard<std::mutex> lock(exitedMutex);
+        ids.insert(ids.end(), exited.begin(), exited.end());
+        exited.clear();
+        exitPending = false;
+    }
+    for (size_t i = first; i < ids.size(); i++)
+        unwatch(ids[i]);
+}
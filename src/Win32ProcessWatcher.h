@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ProcessTable.h"
+
+// win32processwatcher is the windows query of a ProcessTable. it reads the
+// executable name, parent and start time of a process, and keeps a wait on
+// the process so its exit is reported without enumerating all processes.
+// query() and takeExited() must come from a single thread, exits are noted on
+// the thread pool.
+class Win32ProcessWatcher {
+  private:
+    struct Watch {
+        Win32ProcessWatcher *watcher;
+        ProcessId id;
+        HANDLE process = NULL;
+        HANDLE wait = NULL;
+    };
+
+    // heap allocated, as waits refer to them
+    std::unordered_map<ProcessId, std::unique_ptr<Watch>> watches;
+
+    std::mutex exitedMutex; // guards exited
+    std::vector<ProcessId> exited;
+    std::atomic<bool> exitPending{false};
+
+    static VOID CALLBACK onExit(PVOID context, BOOLEAN timedOut);
+
+    // stop waiting on the process, blocking until a running callback is done
+    void unwatch(ProcessId id);
+
+  public:
+    Win32ProcessWatcher() = default;
+    ~Win32ProcessWatcher();
+
+    Win32ProcessWatcher(const Win32ProcessWatcher &) = delete;
+    Win32ProcessWatcher &operator=(const Win32ProcessWatcher &) = delete;
+
+    // see ProcessTable::Query. processes that cannot be opened (protected
+    // ones, or processes of other users) are not queried.
+    bool query(ProcessId id, ProcessInfo &info);
+
+    // add the processes that exited since the last call to ids. cheap when
+    // none did.
+    void takeExited(std::vector<ProcessId> &ids);
+};
@@ -0,0 +1,203 @@
+// process table check: builds lineages with the process table from a
+// synthetic process tree and checks them, and when the platform is queried.
+// needs no windows process functions, so it builds and runs anywhere, e.g. on
+// linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -Isrc -o process-table-check tests/ProcessTableCheck.cpp
+//       src/ProcessTable.cpp
+//   ./process-table-check
+//
+// every failed check is printed, and the program exits with 1 if any failed.
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+#include "NameTable.h"
+#include "ProcessTable.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        std::fprintf(stderr, "Check failed: %s\n", what);
+        failures++;
+    }
+}
+
+// the running processes, as the platform would report them
+struct ProcessTree {
+    std::unordered_map<ProcessId, ProcessInfo> processes;
+    size_t queries = 0;
+
+    void add(ProcessId id, ProcessId parentId, std::uint64_t startTime,
+             const std::wstring &name) {
+        ProcessInfo info;
+        info.parentId = parentId;
+        info.startTime = startTime;
+        info.name = name;
+        processes[id] = info;
+    }
+
+    ProcessTable::Query getQuery() {
+        return [this](ProcessId id, ProcessInfo &info) {
+            queries++;
+            auto found = processes.find(id);
+            if (found == processes.end())
+                return false;
+            info = found->second;
+            return true;
+        };
+    }
+};
+
+// the lineage as text, e.g. "a.exe\b.exe"
+static std::wstring lineageOf(ProcessTable &table, NameTable &names,
+                              ProcessId id) {
+    return names.getName(table.getLineageId(id, names));
+}
+
+static size_t countNames(const std::wstring &lineage) {
+    size_t count = lineage.empty() ? 0 : 1;
+    for (wchar_t c : lineage)
+        count += c == NameTable::LINEAGE_SEPARATOR;
+    return count;
+}
+
+static void checkLineage() {
+    ProcessTree tree;
+    tree.add(10, 0, 1, L"explorer.exe");
+    tree.add(20, 10, 2, L"browser.exe");
+    tree.add(30, 20, 3, L"audio.exe");
+    tree.add(31, 20, 4, L"gpu.exe");
+    ProcessTable table(tree.getQuery());
+    NameTable names;
+
+    check(lineageOf(table, names, 30) ==
+              L"audio.exe\\browser.exe\\explorer.exe",
+          "a lineage is the process and its ancestors, nearest first");
+    check(tree.queries == 3 && table.size() == 3,
+          "each process of a lineage is queried once");
+
+    check(lineageOf(table, names, 31) == L"gpu.exe\\browser.exe\\explorer.exe",
+          "siblings share their ancestors");
+    check(tree.queries == 4 && table.size() == 4,
+          "ancestors that are known already are not queried again");
+
+    check(table.getLineageId(99, names) == NameTable::Unknown &&
+              table.size() == 4,
+          "a process that cannot be queried has no lineage");
+
+    tree.add(40, 98, 5, L"orphan.exe");
+    check(lineageOf(table, names, 40) == L"orphan.exe",
+          "a lineage ends at a parent that cannot be queried");
+}
+
+static void checkDepth() {
+    // a chain of processes deeper than MAX_DEPTH, each started by the one
+    // before
+    ProcessTree tree;
+    const ProcessId DEEPEST = ProcessTable::MAX_DEPTH + 4;
+    for (ProcessId id = 1; id <= DEEPEST; id++)
+        tree.add(id, id - 1, id, L"p" + std::to_wstring(id) + L".exe");
+    ProcessTable table(tree.getQuery());
+    NameTable names;
+
+    std::wstring lineage = lineageOf(table, names, DEEPEST);
+    std::wstring nearest = L"p" + std::to_wstring(DEEPEST) + L".exe\\p" +
+                           std::to_wstring(DEEPEST - 1) + L".exe\\";
+    std::wstring last = L"\\p" +
+                        std::to_wstring(DEEPEST - ProcessTable::MAX_DEPTH + 1) +
+                        L".exe";
+    check(countNames(lineage) == ProcessTable::MAX_DEPTH &&
+              lineage.compare(0, nearest.size(), nearest) == 0 &&
+              lineage.compare(lineage.size() - last.size(), last.size(),
+                              last) == 0,
+          "a lineage is cut after the nearest MAX_DEPTH executables");
+    check(tree.queries == ProcessTable::MAX_DEPTH,
+          "ancestors past MAX_DEPTH are not queried");
+    check(lineageOf(table, names, 1) == L"p1.exe",
+          "a process without a parent is its own lineage");
+}
+
+static void checkReusedIds() {
+    ProcessTree tree;
+    // the parent exited, and its id was reused by a process started later
+    tree.add(50, 0, 200, L"reused.exe");
+    tree.add(60, 50, 100, L"child.exe");
+    // started by itself, as reported for some system processes
+    tree.add(70, 70, 1, L"self.exe");
+    // two processes that are each other's parent, from reused ids
+    tree.add(80, 81, 1, L"a.exe");
+    tree.add(81, 80, 1, L"b.exe");
+    ProcessTable table(tree.getQuery());
+    NameTable names;
+
+    check(lineageOf(table, names, 60) == L"child.exe",
+          "a parent started after its child is a reused id, not the parent");
+    check(lineageOf(table, names, 70) == L"self.exe",
+          "a process that is its own parent ends its lineage");
+
+    std::wstring cycle = lineageOf(table, names, 80);
+    check(countNames(cycle) == ProcessTable::MAX_DEPTH &&
+              cycle.compare(0, 12, L"a.exe\\b.exe\\") == 0,
+          "a cycle of parents is cut at MAX_DEPTH");
+    check(lineageOf(table, names, 81).compare(0, 12, L"b.exe\\a.exe\\") == 0,
+          "each process of a cycle starts its own lineage");
+}
+
+static void checkCache() {
+    ProcessTree tree;
+    tree.add(10, 0, 1, L"explorer.exe");
+    tree.add(20, 10, 2, L"browser.exe");
+    tree.add(30, 20, 3, L"audio.exe");
+    ProcessTable table(tree.getQuery());
+    NameTable names;
+
+    NameId first = table.getLineageId(30, names);
+    size_t queries = tree.queries;
+    size_t interned = names.size();
+
+    // the lineage is kept while the process runs, even once an ancestor
+    // exited and its id was reused
+    table.removeProcess(20);
+    tree.add(20, 10, 2, L"renamed.exe");
+    NameId second = table.getLineageId(30, names);
+    check(second == first && tree.queries == queries &&
+              names.size() == interned,
+          "a cached lineage returns the same id without any queries");
+
+    // another process with the same lineage shares its id
+    tree.add(20, 10, 2, L"browser.exe");
+    tree.add(31, 20, 4, L"audio.exe");
+    check(table.getLineageId(31, names) == first,
+          "processes with the same lineage share its id");
+
+    // the id of an exited process is reused by an unrelated one, which is
+    // queried afresh
+    table.removeProcess(30);
+    tree.add(30, 10, 5, L"player.exe");
+    queries = tree.queries;
+    check(lineageOf(table, names, 30) == L"player.exe\\explorer.exe" &&
+              tree.queries == queries + 1,
+          "a reused id is queried again once the process was removed");
+    check(table.getLineageId(30, names) != first,
+          "a reused id gets the lineage of the new process");
+
+    table.removeProcess(12345);
+    check(table.size() == 4, "removing an unknown process is harmless");
+}
+
+int main() {
+    checkLineage();
+    checkDepth();
+    checkReusedIds();
+    checkCache();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+// session registry check: posts session events to a session registry, as the
+// windows session notifications would, and checks the entries it keeps and
+// when it calls the activity callback, for scripted cases and for a long run
+// of random churn against a plain model. needs no audio stack, so it builds
+// and runs anywhere, e.g. on linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -Isrc -pthread -o session-registry-check
+//       tests/SessionRegistryCheck.cpp
+//   ./session-registry-check
+//
+// every failed check is printed, and the program exits with 1 if any failed.
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+
+#include "SessionRegistry.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        std::fprintf(stderr, "Check failed: %s\n", what);
+        failures++;
+    }
+}
+
+// sessions are shared pointers, as in the simulated backend, so it can be
+// checked which one an entry holds and that events let go of theirs
+using Session = std::shared_ptr<int>;
+using Registry = SessionRegistry<Session>;
+
+static Registry::Entry *findEntry(Registry &registry, SessionKey key) {
+    for (auto &entry : registry) {
+        if (entry.key == key)
+            return &entry;
+    }
+    return nullptr;
+}
+
+static void checkEvents() {
+    Registry registry;
+    size_t activity = 0;
+    registry.setActivityCallback([&activity] { activity++; });
+
+    check(!registry.applyPendingEvents() && registry.empty(),
+          "applying no events changes nothing");
+
+    // the initial enumeration, and a notification for a session in it
+    Session first = std::make_shared<int>(1);
+    registry.sessionAdded(1, SessionState::Inactive, first);
+    registry.sessionAdded(2, SessionState::Active, std::make_shared<int>(2));
+    registry.sessionAdded(1, SessionState::Active, std::make_shared<int>(3));
+    check(registry.size() == 0, "events are only applied when asked to");
+    check(registry.applyPendingEvents() && registry.size() == 2,
+          "added sessions are applied");
+    Registry::Entry *entry = findEntry(registry, 1);
+    check(entry && entry->session == first &&
+              entry->state == SessionState::Inactive,
+          "adding a session that is there already keeps the first");
+    check(first.use_count() == 2,
+          "applied events let go of their sessions");
+
+    // the callback only fires for what may start new audio
+    check(activity == 2, "adding an active session calls the callback");
+    registry.sessionStateChanged(1, SessionState::Active);
+    registry.sessionStateChanged(2, SessionState::Inactive);
+    registry.sessionAdded(3, SessionState::Inactive, std::make_shared<int>(4));
+    registry.sessionRemoved(3);
+    check(activity == 3,
+          "only becoming active calls the callback, not other events");
+    check(registry.applyPendingEvents() && registry.size() == 2 &&
+              findEntry(registry, 1)->state == SessionState::Active &&
+              findEntry(registry, 2)->state == SessionState::Inactive,
+          "state changes are applied");
+
+    registry.sessionStateChanged(1, SessionState::Active);
+    check(!registry.applyPendingEvents(),
+          "a state change to the same state changes nothing");
+
+    registry.sessionStateChanged(99, SessionState::Inactive);
+    registry.sessionRemoved(98);
+    check(!registry.applyPendingEvents() && registry.size() == 2,
+          "events for unknown sessions change nothing");
+
+    // a session expiring is dropped, and one added expired is never kept
+    size_t activityBefore = activity;
+    registry.sessionStateChanged(2, SessionState::Expired);
+    registry.sessionAdded(4, SessionState::Expired, std::make_shared<int>(5));
+    check(activity == activityBefore, "expiring does not call the callback");
+    check(registry.applyPendingEvents() && registry.size() == 1 &&
+              !findEntry(registry, 2) && !findEntry(registry, 4),
+          "expired sessions are dropped by applying the events");
+
+    // a session removed and added again under the same key, in one batch
+    // and in two
+    Session again = std::make_shared<int>(6);
+    registry.sessionRemoved(1);
+    registry.sessionAdded(1, SessionState::Inactive, again);
+    check(registry.applyPendingEvents() && registry.size() == 1 &&
+              findEntry(registry, 1)->session == again,
+          "a session removed and added again in one batch is the new one");
+    check(first.use_count() == 1, "a removed session is let go of");
+    registry.sessionRemoved(1);
+    check(registry.applyPendingEvents() && registry.empty(),
+          "a removed session is dropped");
+    registry.sessionAdded(1, SessionState::Active, first);
+    check(registry.applyPendingEvents() && registry.size() == 1 &&
+              findEntry(registry, 1)->session == first,
+          "a session can be added again after it was removed");
+
+    registry.sessionAdded(5, SessionState::Active, std::make_shared<int>(7));
+    registry.clear();
+    check(!registry.applyPendingEvents() && registry.empty(),
+          "clearing drops the entries and pending events");
+}
+
+// the registry against a map of what it should hold, through random adds,
+// state changes and removals of a few keys, so keys are reused often and
+// entries are swapped around on removal
+static void checkChurn() {
+    Registry registry;
+    size_t activity = 0;
+    registry.setActivityCallback([&activity] { activity++; });
+
+    struct Expected {
+        SessionState state;
+        int session;
+    };
+    std::map<SessionKey, Expected> model;
+    size_t expectedActivity = 0;
+
+    std::uint32_t random = 1;
+    auto next = [&random](std::uint32_t range) {
+        // xorshift32
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return random % range;
+    };
+
+    bool matches = true;
+    bool changedMatches = true;
+    for (int round = 0; round < 20000; round++) {
+        bool changed = false;
+        size_t events = 1 + next(8);
+        for (size_t i = 0; i < events; i++) {
+            SessionKey key = 1 + next(16);
+            auto state = (SessionState)next(3);
+            auto found = model.find(key);
+
+            switch (next(3)) {
+            case 0: {
+                int session = round * 8 + (int)i;
+                registry.sessionAdded(key, state,
+                                      std::make_shared<int>(session));
+                expectedActivity += state == SessionState::Active;
+                if (found == model.end() && state != SessionState::Expired) {
+                    model[key] = {state, session};
+                    changed = true;
+                }
+                break;
+            }
+            case 1:
+                registry.sessionStateChanged(key, state);
+                expectedActivity += state == SessionState::Active;
+                if (found == model.end() || found->second.state == state)
+                    break;
+                if (state == SessionState::Expired)
+                    model.erase(found);
+                else
+                    found->second.state = state;
+                changed = true;
+                break;
+            default:
+                registry.sessionRemoved(key);
+                if (found != model.end()) {
+                    model.erase(found);
+                    changed = true;
+                }
+                break;
+            }
+        }
+
+        changedMatches &= registry.applyPendingEvents() == changed;
+        matches &= registry.size() == model.size();
+        for (auto &entry : registry) {
+            auto found = model.find(entry.key);
+            matches &= found != model.end() &&
+                       found->second.state == entry.state &&
+                       found->second.session == *entry.session;
+        }
+    }
+    check(matches, "churned entries match the model");
+    check(changedMatches, "applying the events reports every change");
+    check(activity == expectedActivity,
+          "churn calls the callback for every active add or change");
+}
+
+int main() {
+    checkEvents();
+    checkChurn();
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,337 @@
+// settings check: parses and migrates inis with the settings file reader and
+// checks what it makes of them: the settings, the settings reported missing,
+// the errors for invalid values and the migrated text. needs no windows ini
+// functions, so it builds and runs anywhere, e.g. on linux, from the
+// repository root (as one line):
+//
+//   g++ -std=c++14 -Isrc -o settings-check tests/SettingsCheck.cpp
+//       src/Fade.cpp src/SettingsFile.cpp src/SettingsSchema.cpp
+//   ./settings-check
+//
+// every failed check is printed, and the program exits with 1 if any failed.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SettingsFile.h"
+#include "SettingsSchema.h"
+
+static int failures = 0;
+
+static void check(bool passed, const char *what) {
+    if (!passed) {
+        std::fprintf(stderr, "Check failed: %s\n", what);
+        failures++;
+    }
+}
+
+static SettingsFile parse(const std::wstring &text) {
+    SettingsFile file;
+    file.parse(text);
+    return file;
+}
+
+// the message of the error parsing the text throws, or "" if it does not
+static std::string parseError(const std::wstring &text) {
+    try {
+        parse(text);
+    } catch (std::runtime_error &e) {
+        return e.what();
+    }
+    return "";
+}
+
+static bool isMissing(const SettingsFile &file, Setting id) {
+    auto &missing = file.getMissing();
+    return std::find(missing.begin(), missing.end(), id) != missing.end();
+}
+
+static void checkErrors() {
+    check(parseError(L"[General]\nfVolumeMax=loud\n") ==
+              "Invalid value for fVolumeMax on line 2 of the INI file: not "
+              "a number",
+          "a value that is not a number names its key and line");
+    check(parseError(L"; comment\n\n[General]\nfVolumeMin=0.0\n"
+                     L"fVolumeMax=1.5\n") ==
+              "Invalid value for fVolumeMax on line 5 of the INI file: must "
+              "be between 0 and 1",
+          "a value out of range names its range and line");
+    check(parseError(L"[General]\nfVolumeMax=nan\n") ==
+              "Invalid value for fVolumeMax on line 2 of the INI file: must "
+              "be between 0 and 1",
+          "nan is out of range");
+    check(parseError(L"[General]\nfVolumeMax=-0.1\n").find("line 2") !=
+              std::string::npos,
+          "a value below the range is rejected");
+    check(parseError(L"[General]\niConsecutiveMinimumsToEnd=2.5\n") ==
+              "Invalid value for iConsecutiveMinimumsToEnd on line 2 of the "
+              "INI file: not a whole number",
+          "an int that is not whole is rejected");
+    check(parseError(L"[General]\nfVolumeMax=\n") ==
+              "Invalid value for fVolumeMax on line 2 of the INI file: not "
+              "a number",
+          "an empty number is rejected");
+    check(parseError(L"[General]\nsAttackCurve=log\n") ==
+              "Invalid value for sAttackCurve on line 2 of the INI file: "
+              "must be one of linear, decibel, scurve or equalpower",
+          "an unknown fade curve is rejected");
+    check(parseError(L"[General]\r\n\r\n[Sidechain\r\n") ==
+              "Missing \"]\" after the section name on line 3 of the INI "
+              "file",
+          "an unclosed section names its line");
+    check(parseError(L"[General]\nfVolumeMax 0.2\n") ==
+              "Expected key=value on line 2 of the INI file",
+          "a line without = names its line");
+    check(parseError(L"[Target:game.exe]\nfVolumeMax=2\n") ==
+              "Invalid value for fVolumeMax on line 2 of the INI file: must "
+              "be between 0 and 1",
+          "values of target sections are checked too");
+    check(parseError(L"[General]\nfFadeSpeedMS=-5\n") ==
+              "Invalid value for fAttackMS on line 2 of the INI file: must "
+              "be between 0 and 600000",
+          "a previous key is checked as the setting it became");
+    check(parseError(L"[Other]\nfVolumeMax=loud\nfUnknown=loud\n").empty(),
+          "keys in the wrong section and unknown keys are ignored");
+}
+
+static void checkValues() {
+    // the default ini has every setting, and gives the controller's defaults
+    auto defaults = parse(generateDefaultSettingsINI());
+    check(defaults.getMissing().empty(), "the default ini misses nothing");
+    DuckSettings settings = defaults.getDuckSettings();
+    DuckSettings expected;
+    check(settings.tickIdleMS == expected.tickIdleMS &&
+              settings.tickTransitionMS == expected.tickTransitionMS &&
+              settings.tickInactiveMS == expected.tickInactiveMS &&
+              settings.detectorSampleMS == expected.detectorSampleMS &&
+              settings.consecutiveMinimumsToEnd ==
+                  expected.consecutiveMinimumsToEnd &&
+              settings.sidechainOpenLevel == expected.sidechainOpenLevel,
+          "the default ini gives the default settings");
+    check(settings.targets.size() == 1 &&
+              settings.targets[0].executable == L"foobar2000.exe" &&
+              settings.targets[0].volumeMax == 0.2f &&
+              settings.targets[0].attackCurve == FadeCurve::Linear,
+          "the default ini targets foobar2000.exe");
+    check(settings.excludedExecutables.size() == 3 &&
+              settings.excludedExecutables[2] == L"amddvr.exe",
+          "lists are split on /");
+
+    // an empty ini misses every setting outside the target sections
+    auto empty = parse(L"");
+    size_t shared = 0;
+    for (auto &spec : SETTINGS_SCHEMA)
+        shared += !isTargetOnlySetting(spec);
+    check(empty.getMissing().size() == shared &&
+              !isMissing(empty, Setting::Priority),
+          "an empty ini misses every setting but target only ones");
+
+    // the first of duplicate keys wins, whatever their case, and quotes are
+    // taken off
+    auto duplicates = parse(L"[general]\nfVolumeMax=0.3\nFVOLUMEMAX=0.4\n"
+                            L"fVolumeMax=2\nsCommandOnDuck=\"a b\"\n");
+    settings = duplicates.getDuckSettings();
+    check(settings.targets.size() == 1 &&
+              settings.targets[0].volumeMax == 0.3f,
+          "the first of duplicate keys wins");
+    check(settings.commandOnDuck == L"a b", "quotes are taken off values");
+    check(!isMissing(duplicates, Setting::VolumeMax) &&
+              isMissing(duplicates, Setting::VolumeMin),
+          "a given key is not missing, others are");
+
+    // target sections override [General] for their executable alone
+    auto targets = parse(L"[General]\nsControlledExecutable=game.exe/music.exe"
+                         L"\nfVolumeMax=0.4\niPriority=5\n\n"
+                         L"[Target: Game.exe ]\nfVolumeMax=0.8\niPriority=2\n"
+                         L"fTickIdleMS=5\n");
+    settings = targets.getDuckSettings();
+    check(settings.targets.size() == 2 &&
+              settings.targets[0].volumeMax == 0.8f &&
+              settings.targets[0].priority == 2 &&
+              settings.targets[1].volumeMax == 0.4f &&
+              settings.targets[1].priority == 0,
+          "target sections override [General] for their executable");
+    check(settings.tickIdleMS == 1000.0f,
+          "settings that are not per target are ignored in target sections");
+    check(!isMissing(targets, Setting::Priority),
+          "target only settings are never missing");
+}
+
+static void checkRenames() {
+    // fFadeSpeedMS fills in both fades of an old ini, which are missing
+    auto old = parse(L"[General]\nfFadeSpeedMS=750\n");
+    DuckSettings settings = old.getDuckSettings();
+    check(settings.targets.size() == 1 &&
+              settings.targets[0].attackMS == 750.0f &&
+              settings.targets[0].releaseMS == 750.0f,
+          "fFadeSpeedMS gives both fade durations");
+    check(isMissing(old, Setting::AttackMS) &&
+              isMissing(old, Setting::ReleaseMS),
+          "settings read from a previous key are missing");
+
+    // its own key wins, before or after the previous one
+    for (auto text : {L"[General]\nfAttackMS=300\nfFadeSpeedMS=750\n",
+                      L"[General]\nfFadeSpeedMS=750\nfAttackMS=300\n"}) {
+        auto both = parse(text);
+        settings = both.getDuckSettings();
+        check(settings.targets[0].attackMS == 300.0f &&
+                  settings.targets[0].releaseMS == 750.0f,
+              "a setting's own key wins over its previous key");
+        check(!isMissing(both, Setting::AttackMS) &&
+                  isMissing(both, Setting::ReleaseMS),
+              "a setting given under its own key is not missing");
+    }
+
+    // the previous key also works in a target section
+    auto target = parse(L"[General]\nsControlledExecutable=game.exe\n"
+                        L"fFadeSpeedMS=750\n[Target:game.exe]\n"
+                        L"fFadeSpeedMS=200\n");
+    settings = target.getDuckSettings();
+    check(settings.targets[0].attackMS == 200.0f &&
+              settings.targets[0].releaseMS == 200.0f,
+          "fFadeSpeedMS works in target sections");
+
+    // migrating writes the value of the previous key under the new keys
+    auto migrated = old.migrate();
+    check(migrated.find(L"fAttackMS=750\n") != std::wstring::npos &&
+              migrated.find(L"fReleaseMS=750\n") != std::wstring::npos,
+          "migrating keeps the fade speed under the new keys");
+    auto reparsed = parse(migrated);
+    check(reparsed.getMissing().empty() &&
+              reparsed.getDuckSettings().targets[0].attackMS == 750.0f,
+          "a migrated ini misses nothing and keeps the fade speed");
+}
+
+static void checkMigrate() {
+    // an old ini, with [Performance] and [General] missing keys, [Sidechain]
+    // missing entirely, comments and an unknown key
+    const std::wstring original = L"; my settings\r\n"
+                                  L"[Performance]\r\n"
+                                  L"fTickIdleMS=500\r\n"
+                                  L"\r\n"
+                                  L"[General]\r\n"
+                                  L"; the music player\r\n"
+                                  L"sControlledExecutable=music.exe\r\n"
+                                  L"fUnknown=1\r\n"
+                                  L"\r\n"
+                                  L"; trailing comment\r\n";
+    auto file = parse(original);
+    auto migrated = file.migrate();
+
+    bool crlf = true;
+    for (size_t i = 0; i < migrated.size(); i++) {
+        if (migrated[i] == L'\n')
+            crlf = crlf && i > 0 && migrated[i - 1] == L'\r';
+    }
+    check(crlf, "migrating keeps CRLF line endings");
+
+    // everything that was there is kept, in order
+    size_t position = 0;
+    bool kept = true;
+    for (auto line : {L"; my settings\r\n", L"[Performance]\r\n",
+                      L"fTickIdleMS=500\r\n", L"[General]\r\n",
+                      L"; the music player\r\n",
+                      L"sControlledExecutable=music.exe\r\n",
+                      L"fUnknown=1\r\n", L"; trailing comment\r\n"}) {
+        position = migrated.find(line, position);
+        kept = kept && position != std::wstring::npos;
+    }
+    check(kept, "migrating keeps every line, in order");
+
+    // missing keys go after the last key of their section, and missing
+    // sections at the end
+    size_t idle = migrated.find(L"fTickIdleMS=500");
+    size_t transition = migrated.find(L"fTickTransitionsMS=50.0\r\n");
+    size_t general = migrated.find(L"[General]");
+    size_t controlled = migrated.find(L"sControlledExecutable=music.exe");
+    size_t attack = migrated.find(L"fAttackMS=1000.0\r\n");
+    size_t trailing = migrated.find(L"; trailing comment");
+    size_t sidechain = migrated.find(L"[Sidechain]\r\n");
+    size_t hangover = migrated.find(L"fSidechainHangoverMS=400.0\r\n");
+    check(idle < transition && transition < general,
+          "missing keys are added to the end of an existing section");
+    check(controlled < attack && attack < trailing,
+          "missing keys go after the last key of their section");
+    check(trailing < sidechain && sidechain < hangover &&
+              hangover != std::wstring::npos,
+          "missing sections are added at the end");
+    check(migrated.find(L"; Controls how frequently the program queries "
+                         L"volume information when transitioning.") <
+              transition,
+          "added keys are documented");
+    check(migrated.find(L"[Target") == std::wstring::npos &&
+              migrated.find(L"iPriority") == std::wstring::npos,
+          "target only settings are not added");
+
+    // what was given is kept, and nothing is missing once migrated
+    auto reparsed = parse(migrated);
+    DuckSettings settings = reparsed.getDuckSettings();
+    check(reparsed.getMissing().empty(), "a migrated ini misses nothing");
+    check(settings.tickIdleMS == 500.0f && settings.targets.size() == 1 &&
+              settings.targets[0].executable == L"music.exe",
+          "a migrated ini keeps its settings");
+    check(reparsed.migrate() == migrated, "migrating again changes nothing");
+
+    // an ini with nothing missing is left exactly as it was
+    auto complete = generateDefaultSettingsINI();
+    check(parse(complete).migrate() == complete,
+          "migrating a complete ini changes nothing");
+}
+
+static void checkDecoding() {
+    const std::wstring expected = L"[General]\r\nsCommandOnDuck=caf\u00e9 "
+                                  L"\u266b\r\n";
+
+    // utf-16 with a byte order mark, as notepad saves "unicode"
+    std::string utf16 = "\xff\xfe";
+    for (wchar_t c : expected) {
+        utf16 += (char)(c & 0xff);
+        utf16 += (char)(c >> 8);
+    }
+    check(decodeSettingsText(utf16) == expected, "utf-16 is decoded");
+
+    // a code point outside the basic plane, as a surrogate pair
+    std::wstring decoded = decodeSettingsText(std::string(
+        "\xff\xfe\x3d\xd8\x00\xde", 6));
+    check(decodeSettingsText(encodeSettingsText(decoded)) == decoded &&
+              encodeSettingsText(decoded) == "\xf0\x9f\x98\x80",
+          "surrogate pairs are decoded");
+
+    // utf-8, with and without a byte order mark
+    std::string utf8 = encodeSettingsText(expected);
+    check(decodeSettingsText(utf8) == expected, "utf-8 is decoded");
+    check(decodeSettingsText("\xef\xbb\xbf" + utf8) == expected,
+          "the utf-8 byte order mark is skipped");
+
+    // bytes that are not utf-8 are read as latin-1
+    check(decodeSettingsText("caf\xe9") == L"caf\u00e9",
+          "invalid utf-8 is read as latin-1");
+
+    auto file = parse(decodeSettingsText(utf16));
+    check(file.getDuckSettings().commandOnDuck == L"caf\u00e9 \u266b",
+          "values decoded from utf-16 are read");
+}
+
+int main() {
+    for (auto checks : {checkErrors, checkValues, checkRenames, checkMigrate,
+                        checkDecoding}) {
+        // an ini that should parse but does not skips the rest of its checks
+        try {
+            checks();
+        } catch (std::runtime_error &e) {
+            std::fprintf(stderr, "Unexpected error: %s\n", e.what());
+            failures++;
+        }
+    }
+
+    if (failures > 0) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,321 @@
+// trace replay: replays a trace recorded with --record through the duck
+// controller, once with the settings of an ini and once more for each variant
+// of them, as fast as the controller ticks. reports how often each ducked,
+// how many of those were false triggers (ducks released again within
+// --short-ms) and how much of the time was spent ducked, next to what
+// happened while recording. needs no audio stack, so it builds and runs
+// anywhere, e.g. on linux, from the repository root (as one line):
+//
+//   g++ -std=c++14 -O2 -DNDEBUG -Isrc -pthread -o trace-replay
+//       tools/TraceReplay.cpp src/AllocationCounter.cpp
+//       src/CommandExecutor.cpp src/DuckController.cpp src/Fade.cpp
+//       src/GainComputer.cpp src/LevelDetector.cpp src/Log.cpp src/Metrics.cpp
+//       src/NameMatcher.cpp src/SettingsFile.cpp src/SettingsSchema.cpp
+//       src/TraceBackend.cpp src/VoiceGate.cpp
+//   ./trace-replay trace.bin [--ini settings.ini] [--short-ms 2000]
+//       [--timeline] [key=value[,key=value...]]...
+//
+// each variant overrides ini keys by name, e.g.
+// fVolumeMinimumToTrigger=0.05,iConsecutiveMinimumsToTrigger=4 (per-target
+// sections of the ini still take precedence). without --ini the defaults are
+// used, so the controlled executables should be given as a variant or in the
+// ini. the trace is memory-mapped and read in place.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "DuckController.h"
+#include "SettingsFile.h"
+#include "TraceBackend.h"
+
+// a read-only view of a whole file
+class MappedFile {
+  private:
+    const std::uint8_t *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+
+  public:
+    explicit MappedFile(const std::string &path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER fileSize;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize))
+            throw std::runtime_error("Failed to open " + path);
+        size = (size_t)fileSize.QuadPart;
+        if (size == 0)
+            return;
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping)
+            data = (const std::uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ,
+                                                       0, 0, 0);
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0) {
+            if (descriptor >= 0)
+                close(descriptor);
+            throw std::runtime_error("Failed to open " + path);
+        }
+        size = (size_t)status.st_size;
+        if (size > 0) {
+            void *view =
+                mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (view != MAP_FAILED)
+                data = (const std::uint8_t *)view;
+        }
+        close(descriptor);
+        if (size == 0)
+            return;
+#endif
+        if (!data)
+            throw std::runtime_error("Failed to map " + path);
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (data)
+            munmap(const_cast<std::uint8_t *>(data), size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const std::uint8_t *getData() const { return data; }
+    size_t getSize() const { return size; }
+};
+
+struct Options {
+    std::string tracePath;
+    std::string iniPath;
+    double shortMS = 2000.0;
+    bool timeline = false;
+    std::vector<std::string> variants;
+};
+
+// what a run of the controller did
+struct Outcome {
+    std::vector<TraceBackend::Command> commands;
+    size_t ticks = 0;
+    double replayMS = 0.0;
+};
+
+struct Summary {
+    size_t ducks = 0;
+    size_t falseTriggers = 0;
+    double duckedMS = 0.0;
+};
+
+static std::wstring widen(const std::string &text) {
+    return std::wstring(text.begin(), text.end());
+}
+
+static std::wstring toLower(std::wstring text) {
+    for (auto &c : text)
+        c = (wchar_t)std::towlower(c);
+    return text;
+}
+
+static std::string readFile(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open " + path);
+    return std::string((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+}
+
+// ini lines that override the keys of a variant. they go before the ini text,
+// where the first of duplicate keys wins.
+static std::wstring getVariantINI(const std::string &variant) {
+    std::wstring text;
+    size_t start = 0;
+    while (start < variant.size()) {
+        size_t end = variant.find(',', start);
+        if (end == std::string::npos)
+            end = variant.size();
+        auto assignment = widen(variant.substr(start, end - start));
+        start = end + 1;
+
+        size_t equals = assignment.find(L'=');
+        if (equals == std::wstring::npos)
+            throw std::runtime_error("Expected key=value in the variant " +
+                                     variant);
+        auto key = assignment.substr(0, equals);
+
+        const SettingSpec *found = nullptr;
+        for (auto &spec : SETTINGS_SCHEMA) {
+            if (!isTargetOnlySetting(spec) &&
+                toLower(spec.key) == toLower(key))
+                found = &spec;
+        }
+        if (!found)
+            throw std::runtime_error("Unknown setting in the variant " +
+                                     variant);
+        text += L"[" + std::wstring(found->section) + L"]\n" + assignment +
+                L"\n";
+    }
+    return text;
+}
+
+static Outcome replay(const MappedFile &trace, const DuckSettings &settings) {
+    VirtualClock clock;
+    TraceBackend backend(clock, trace.getData(), trace.getSize());
+    SettingsStore<DuckSettings> settingsStore(settings);
+
+    Outcome outcome;
+    DuckController controller(
+        backend, clock, settingsStore,
+        [&](CommandKind kind, const std::wstring &) {
+            outcome.commands.push_back({clock.nowMS(), kind});
+        });
+
+    auto start = std::chrono::steady_clock::now();
+    outcome.ticks = backend.run(controller, backend.getDurationMS());
+    outcome.replayMS = std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    return outcome;
+}
+
+static Summary summarise(const std::vector<TraceBackend::Command> &commands,
+                         double durationMS, double shortMS) {
+    Summary summary;
+    double duckedAtMS = -1.0;
+    for (auto &command : commands) {
+        if (command.kind == CommandKind::Duck && duckedAtMS < 0.0) {
+            summary.ducks++;
+            duckedAtMS = command.timeMS;
+        } else if (command.kind == CommandKind::Unduck && duckedAtMS >= 0.0) {
+            double lengthMS = command.timeMS - duckedAtMS;
+            if (lengthMS < shortMS)
+                summary.falseTriggers++;
+            summary.duckedMS += lengthMS;
+            duckedAtMS = -1.0;
+        }
+    }
+    if (duckedAtMS >= 0.0)
+        summary.duckedMS += durationMS - duckedAtMS;
+    return summary;
+}
+
+static void printTimeline(const std::vector<TraceBackend::Command> &commands) {
+    for (auto &command : commands) {
+        double seconds = command.timeMS / 1000.0;
+        std::printf("    %4d:%06.3f  %s\n", (int)(seconds / 60.0),
+                    seconds - 60.0 * (int)(seconds / 60.0),
+                    command.kind == CommandKind::Duck ? "duck" : "unduck");
+    }
+}
+
+static void printRow(const char *ticks, const char *speedup,
+                     const Summary &summary, double durationMS,
+                     const std::string &label) {
+    double ducked =
+        (durationMS > 0.0) ? summary.duckedMS / durationMS * 100.0 : 0.0;
+    std::printf("%10s %10s %6zu %6zu %7.1f%%  %s\n", ticks, speedup,
+                summary.ducks, summary.falseTriggers, ducked, label.c_str());
+}
+
+static Options parseOptions(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--ini" && i + 1 < argc)
+            options.iniPath = argv[++i];
+        else if (argument == "--short-ms" && i + 1 < argc)
+            options.shortMS = std::atof(argv[++i]);
+        else if (argument == "--timeline")
+            options.timeline = true;
+        else if (options.tracePath.empty())
+            options.tracePath = argument;
+        else
+            options.variants.push_back(argument);
+    }
+    if (options.tracePath.empty())
+        throw std::runtime_error(
+            "usage: trace-replay <trace> [--ini settings.ini] [--short-ms ms] "
+            "[--timeline] [key=value[,key=value...]]...");
+    return options;
+}
+
+int main(int argc, char **argv) {
+    try {
+        Options options = parseOptions(argc, argv);
+        MappedFile trace(options.tracePath);
+
+        std::wstring iniText;
+        if (!options.iniPath.empty())
+            iniText = decodeSettingsText(readFile(options.iniPath));
+
+        VirtualClock clock;
+        TraceBackend recorded(clock, trace.getData(), trace.getSize());
+        double durationMS = recorded.getDurationMS();
+        std::printf("%s: %.1f s, %zu bytes\n\n", options.tracePath.c_str(),
+                    durationMS / 1000.0, trace.getSize());
+
+        std::printf("%10s %10s %6s %6s %8s  %s\n", "ticks", "speedup",
+                    "ducks", "false", "ducked", "variant");
+        printRow("-", "-",
+                 summarise(recorded.getRecordedCommands(), durationMS,
+                           options.shortMS),
+                 durationMS, "recorded");
+        if (options.timeline)
+            printTimeline(recorded.getRecordedCommands());
+
+        std::vector<std::string> variants = {""};
+        variants.insert(variants.end(), options.variants.begin(),
+                        options.variants.end());
+        for (auto &variant : variants) {
+            SettingsFile file;
+            file.parse(getVariantINI(variant) + iniText);
+
+            Outcome outcome = replay(trace, file.getDuckSettings());
+
+            char ticks[32];
+            char speedup[32];
+            std::snprintf(ticks, sizeof(ticks), "%zu", outcome.ticks);
+            std::snprintf(speedup, sizeof(speedup), "%.0fx",
+                          durationMS / (std::max)(outcome.replayMS, 1e-3));
+            printRow(ticks, speedup,
+                     summarise(outcome.commands, durationMS, options.shortMS),
+                     durationMS, variant.empty() ? "settings" : variant);
+            if (options.timeline)
+                printTimeline(outcome.commands);
+        }
+    } catch (std::exception &exception) {
+        std::fprintf(stderr, "%s\n", exception.what());
+        return 1;
+    }
+    return 0;
+}